@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines a bump pointer arena allocator.
+ *
+ * Memory is carved out of large blocks and is only ever released all at
+ * once, by freeing the arena. A Pkg_Arena is not thread-safe, use one per
+ * thread.
+ *
+ * Example:
+ *
+ *     Pkg_Arena *arena = Pkg_InitArena();
+ *     Pkg_Package *pkg = Pkg_InitPackageInArena(arena);
+ *     int ret = Pkg_ParsePackageManifest("/path/to/package.xml", pkg);
+ *     // Use the pkg...
+ *     // Free the Pkg_Package along with everything else in the arena
+ *     Pkg_FreeArena(arena);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__ARENA_H_
+#define PACKAGE_MANIFEST_PARSING__ARENA_H_
+
+#include <stddef.h>
+
+/* Opaque arena, see Pkg_InitArena */
+typedef struct Pkg_Arena Pkg_Arena;
+
+/* Initializes a Pkg_Arena, call before using a Pkg_Arena */
+Pkg_Arena *
+Pkg_InitArena();
+
+/* Frees a Pkg_Arena and everything which was allocated from it */
+void
+Pkg_FreeArena(Pkg_Arena *arena);
+
+/* Allocates size bytes from the arena, suitably aligned for any type */
+void *
+Pkg_ArenaAlloc(Pkg_Arena *arena, size_t size);
+
+/* Copies the first len bytes of str into the arena, adding a terminator */
+char *
+Pkg_ArenaStrndup(Pkg_Arena *arena, const char *str, size_t len);
+
+/* Copies str into the arena */
+char *
+Pkg_ArenaStrdup(Pkg_Arena *arena, const char *str);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__ARENA_H_ */
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines a compact binary format for any number of Pkg_Package's.
+ *
+ * A blob is a single relocatable buffer: records refer to each other and to
+ * their strings by offsets and indices, never by pointers, so a blob can be
+ * written to a file or a socket and used wherever it ends up. Opening a blob
+ * only checks its header, the records are then read in place, without
+ * copying or decoding them. Every accessor checks its offsets against the
+ * blob, so a corrupt blob yields NULL's rather than reads out of bounds.
+ *
+ * Integers are stored in the byte order of the writer, which is recorded in
+ * the header, opening a blob written with the other byte order fails.
+ *
+ * Example:
+ *
+ *     void *data;
+ *     size_t size;
+ *     Pkg_WriteBlob(ws->packages, ws->package_count, &data, &size);
+ *     // send data to another process, which then reads it in place
+ *     Pkg_Blob *blob = Pkg_InitBlob();
+ *     if (0 == Pkg_OpenBlob(blob, data, size))
+ *     {
+ *         for (size_t i = 0; i < blob->package_count; ++i)
+ *         {
+ *             const Pkg_BlobPackage *pkg = &blob->packages[i];
+ *             printf("%s\n", Pkg_BlobGetString(blob, pkg->name));
+ *         }
+ *     }
+ *     Pkg_FreeBlob(blob);
+ *     free(data);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__BLOB_H_
+#define PACKAGE_MANIFEST_PARSING__BLOB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+/* Version of the format written by Pkg_WriteBlob */
+#define PKG_BLOB_VERSION 2
+
+/* Offset of a string which is not set, e.g. a maintainer without email */
+#define PKG_BLOB_NULL 0xffffffffu
+
+/* A maintainer or author, strings are offsets for Pkg_BlobGetString */
+typedef struct Pkg_BlobPerson
+{
+    uint32_t name;
+    uint32_t email;
+} Pkg_BlobPerson;
+
+/* A url, type is a Pkg_URLType */
+typedef struct Pkg_BlobURL
+{
+    uint32_t url;
+    uint32_t type;
+} Pkg_BlobURL;
+
+/* A dependency, with the same constraints as a Pkg_DependencyList */
+typedef struct Pkg_BlobDependency
+{
+    uint32_t name;
+    uint32_t constraints;
+    Pkg_VersionKey version_keys[PKG_VERSION_CONSTRAINT_COUNT];
+} Pkg_BlobDependency;
+
+/* A package, its lists are ranges of the arrays of the Pkg_Blob */
+typedef struct Pkg_BlobPackage
+{
+    uint32_t name;
+    uint32_t filename;
+    uint32_t description;
+    uint32_t exports;
+    uint32_t package_format;
+    uint32_t fields;
+    Pkg_VersionKey version;
+    Pkg_VersionKey abi_version;
+    uint64_t exports_offset;
+    uint64_t exports_size;
+    /* fingerprints, see Pkg_Package */
+    uint64_t content_hash;
+    uint64_t semantic_hash;
+    /* maintainers, directly followed by the authors */
+    uint32_t persons;
+    uint32_t maintainer_count;
+    uint32_t author_count;
+    uint32_t licenses;
+    uint32_t license_count;
+    uint32_t urls;
+    uint32_t url_count;
+    /* dependencies of every Pkg_DependencyType, one after the other */
+    uint32_t dependencies;
+    uint32_t dependency_counts[PKG_DEPEND_TYPE_COUNT];
+} Pkg_BlobPackage;
+
+/* Struct to read a blob in place, see Pkg_OpenBlob
+ *
+ * The arrays point into the blob's buffer, which must outlive them.
+ */
+typedef struct Pkg_Blob
+{
+    const void *data;
+    size_t size;
+    /* packages, in the order they were written */
+    const Pkg_BlobPackage *packages;
+    size_t package_count;
+    const Pkg_BlobDependency *dependencies;
+    size_t dependency_count;
+    const Pkg_BlobPerson *persons;
+    size_t person_count;
+    /* licenses, as string offsets */
+    const uint32_t *licenses;
+    size_t license_count;
+    const Pkg_BlobURL *urls;
+    size_t url_count;
+    /* NUL terminated strings, back to back */
+    const char *strings;
+    size_t strings_size;
+} Pkg_Blob;
+
+/* Serializes count packages into a single malloc'd buffer
+ *
+ * Strings which occur more than once, like the names of common
+ * dependencies, are only stored once. The caller frees *data. Returns 0 on
+ * success.
+ */
+int
+Pkg_WriteBlob(
+    Pkg_Package *const *packages,
+    size_t count,
+    void **data,
+    size_t *size);
+
+/* Initializes a Pkg_Blob, call before using a Pkg_Blob */
+Pkg_Blob *
+Pkg_InitBlob();
+
+/* Frees a Pkg_Blob, the buffer it was opened on is not touched */
+void
+Pkg_FreeBlob(Pkg_Blob *blob);
+
+/* Points blob at the blob in the size bytes at data
+ *
+ * Only the header is checked, in constant time. data must be 8 byte
+ * aligned, as memory from malloc or mmap is, and must outlive blob.
+ * Returns 1 if data is not a blob of this version and byte order.
+ */
+int
+Pkg_OpenBlob(Pkg_Blob *blob, const void *data, size_t size);
+
+/* Returns the string at offset, NULL if it is PKG_BLOB_NULL or invalid */
+const char *
+Pkg_BlobGetString(const Pkg_Blob *blob, uint32_t offset);
+
+/* Returns the dependencies of the given type of pkg, storing their number
+ * in count, NULL if there are none
+ */
+const Pkg_BlobDependency *
+Pkg_BlobGetDependencies(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    Pkg_DependencyType type,
+    size_t *count);
+
+/* Returns the maintainers of pkg, storing their number in count */
+const Pkg_BlobPerson *
+Pkg_BlobGetMaintainers(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count);
+
+/* Returns the authors of pkg, storing their number in count */
+const Pkg_BlobPerson *
+Pkg_BlobGetAuthors(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count);
+
+/* Returns the licenses of pkg as string offsets, storing their number in
+ * count
+ */
+const uint32_t *
+Pkg_BlobGetLicenses(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count);
+
+/* Returns the urls of pkg, storing their number in count */
+const Pkg_BlobURL *
+Pkg_BlobGetURLs(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count);
+
+/* Copies the package at index into pkg, as if parsed from its manifest
+ *
+ * pkg must be freshly initialized, it may be allocated from an arena.
+ * Returns 1 if index is out of range or the record is corrupt.
+ */
+int
+Pkg_BlobLoadPackage(const Pkg_Blob *blob, size_t index, Pkg_Package *pkg);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__BLOB_H_ */
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines a persistent cache of parsed package manifests.
+ *
+ * A Pkg_Cache remembers the parsed contents of manifests along with the
+ * modification time, size and content hash of the file they were parsed
+ * from. A manifest whose file still matches is read back from the cache,
+ * only manifests which changed are parsed again. The cache is kept in a
+ * binary file between runs, it is a pure optimization: a missing, stale or
+ * corrupt cache file just means manifests are parsed again.
+ *
+ * Example:
+ *
+ *     Pkg_Cache *cache = Pkg_InitCache();
+ *     Pkg_LoadCache(cache, "/path/to/build/manifests.cache");
+ *     Pkg_Workspace *ws = Pkg_InitWorkspace();
+ *     ws->cache = cache;
+ *     int ret = Pkg_ParseWorkspace("/path/to/src", 0, ws);
+ *     Pkg_SaveCache(cache, "/path/to/build/manifests.cache");
+ *     Pkg_FreeWorkspace(ws);
+ *     Pkg_FreeCache(cache);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__CACHE_H_
+#define PACKAGE_MANIFEST_PARSING__CACHE_H_
+
+#include <stddef.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+/* Opaque manifest cache, see Pkg_InitCache */
+typedef struct Pkg_Cache Pkg_Cache;
+
+/* Initializes an empty Pkg_Cache, call before using a Pkg_Cache */
+Pkg_Cache *
+Pkg_InitCache();
+
+/* Frees a Pkg_Cache, packages read from it stay valid */
+void
+Pkg_FreeCache(Pkg_Cache *cache);
+
+/* Loads the entries of a cache file written by Pkg_SaveCache
+ *
+ * A file which does not exist leaves the cache empty and is not an error.
+ * Returns 1 if the file exists but cannot be read or is not a valid cache
+ * file of this version, the cache is left empty then as well.
+ */
+int
+Pkg_LoadCache(Pkg_Cache *cache, const char *path);
+
+/* Writes the cache to a file, replacing it atomically
+ *
+ * Only entries which were used or added since the cache was loaded are
+ * written, so manifests which no longer exist are dropped from the file.
+ * Returns 0 on success.
+ */
+int
+Pkg_SaveCache(Pkg_Cache *cache, const char *path);
+
+/* Also compares the content hash before trusting an entry
+ *
+ * By default an entry is trusted if the modification time and size of the
+ * manifest match. With verify set the file is read and hashed as well,
+ * which catches changes that keep both, at the cost of reading every file.
+ */
+void
+Pkg_CacheSetVerifyContent(Pkg_Cache *cache, int verify);
+
+/* Fills pkg from the cache if it holds path, otherwise parses it
+ *
+ * Behaves like Pkg_ParserParsePackageManifest, and uses parser for the
+ * manifests which have to be parsed. Successfully parsed manifests are
+ * added to the cache, failures are not and are reported again next time.
+ * An entry only counts if it holds every field selected with
+ * Pkg_ParserSetFields, pkg then gets all of the fields of the entry.
+ * May be called by several threads at once, with a parser each.
+ */
+int
+Pkg_CacheParsePackageManifest(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg);
+
+/* Returns how many manifests were read from the cache and how many parsed */
+void
+Pkg_CacheGetStats(Pkg_Cache *cache, size_t *hits, size_t *misses);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__CACHE_H_ */
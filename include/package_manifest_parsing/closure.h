@@ -0,0 +1,125 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines transitive dependency closures over a Pkg_Graph.
+ *
+ * The closure of a package is the set of every package it depends on,
+ * directly or not. Sets of packages are bitsets indexed by the vertices of
+ * the graph, packed into words of 64 bits, so set operations work on 64
+ * packages at a time.
+ *
+ * Example:
+ *
+ *     Pkg_Closure *closure = Pkg_InitClosure();
+ *     Pkg_BuildClosure(closure, graph, PKG_DEPEND_BUILD_ALL);
+ *     // Everything the changed packages a and b need
+ *     uint64_t *needed = Pkg_InitBitset(closure);
+ *     Pkg_BitsetUnion(closure, needed, Pkg_ClosureGet(closure, a));
+ *     Pkg_BitsetUnion(closure, needed, Pkg_ClosureGet(closure, b));
+ *     size_t count = Pkg_BitsetCount(closure, needed);
+ *     Pkg_FreeBitset(needed);
+ *     Pkg_FreeClosure(closure);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__CLOSURE_H_
+#define PACKAGE_MANIFEST_PARSING__CLOSURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <package_manifest_parsing/graph.h>
+
+/* Struct to capture the closures of all vertices of a Pkg_Graph */
+typedef struct Pkg_Closure
+{
+    /* graph the closures were built from, must outlive them */
+    const Pkg_Graph *graph;
+    /* mask of the dependency kinds which were followed */
+    unsigned int kinds;
+    /* number of words in every bitset */
+    size_t words;
+    /* the closure of vertex v are the words starting at bits + v * words */
+    uint64_t *bits;
+} Pkg_Closure;
+
+/* Initializes an empty Pkg_Closure, call before using a Pkg_Closure */
+Pkg_Closure *
+Pkg_InitClosure();
+
+/* Frees a Pkg_Closure */
+void
+Pkg_FreeClosure(Pkg_Closure *closure);
+
+/* Computes the closure of every vertex of graph
+ *
+ * Only dependencies of the kinds in the kinds mask are followed, which
+ * should be a subset of the kinds the graph was built from. Closures are
+ * computed in the graph's topological order, each one as the union of the
+ * closures of its direct dependencies. A vertex on a dependency cycle is
+ * part of its own closure. Replaces closures built before.
+ */
+void
+Pkg_BuildClosure(
+    Pkg_Closure *closure,
+    const Pkg_Graph *graph,
+    unsigned int kinds);
+
+/* Returns the closure of vertex, which must not be modified */
+const uint64_t *
+Pkg_ClosureGet(const Pkg_Closure *closure, size_t vertex);
+
+/* Returns 1 if vertex depends on dependency, directly or not */
+int
+Pkg_ClosureDependsOn(
+    const Pkg_Closure *closure,
+    size_t vertex,
+    size_t dependency);
+
+/* Allocates an empty bitset sized for closure, free with Pkg_FreeBitset */
+uint64_t *
+Pkg_InitBitset(const Pkg_Closure *closure);
+
+/* Frees a bitset allocated by Pkg_InitBitset */
+void
+Pkg_FreeBitset(uint64_t *set);
+
+/* Adds vertex to set */
+void
+Pkg_BitsetAdd(uint64_t *set, size_t vertex);
+
+/* Returns 1 if vertex is in set */
+int
+Pkg_BitsetContains(const uint64_t *set, size_t vertex);
+
+/* Adds every vertex in other to set */
+void
+Pkg_BitsetUnion(
+    const Pkg_Closure *closure,
+    uint64_t *set,
+    const uint64_t *other);
+
+/* Removes every vertex which is not in other from set */
+void
+Pkg_BitsetIntersect(
+    const Pkg_Closure *closure,
+    uint64_t *set,
+    const uint64_t *other);
+
+/* Returns the number of vertices in set */
+size_t
+Pkg_BitsetCount(const Pkg_Closure *closure, const uint64_t *set);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__CLOSURE_H_ */
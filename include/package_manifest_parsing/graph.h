@@ -0,0 +1,183 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines the dependency graph of a set of packages.
+ *
+ * Vertices are the packages, in the order they were given, edges point from
+ * a package to the packages it depends on. Dependencies on names which are
+ * not in the set, like system dependencies, are not part of the graph.
+ * Building the graph also orders it topologically, grouped into levels: the
+ * packages of a level only depend on packages of earlier levels, so all of
+ * the packages of one level can be built in parallel.
+ *
+ * Example:
+ *
+ *     Pkg_Graph *graph = Pkg_InitGraph();
+ *     int ret = Pkg_BuildGraph(graph, ws->packages, ws->package_count,
+ *                              PKG_DEPEND_BIT(PKG_DEPEND_BUILD));
+ *     if (ret)
+ *     {
+ *         // graph->cycle holds a dependency cycle, or graph->duplicates
+ *         // the packages whose name was taken already
+ *         Pkg_PrintGraphErrors(graph, stderr);
+ *     }
+ *     for (size_t l = 0; l < graph->level_count; ++l)
+ *     {
+ *         for (size_t i = graph->level_offsets[l];
+ *              i < graph->level_offsets[l + 1]; ++i)
+ *         {
+ *             const Pkg_Package *pkg = graph->packages[graph->order[i]];
+ *         }
+ *     }
+ *     Pkg_FreeGraph(graph);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__GRAPH_H_
+#define PACKAGE_MANIFEST_PARSING__GRAPH_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+/* Bit of a Pkg_DependencyType in a mask of dependency kinds */
+#define PKG_DEPEND_BIT(type) (1u << (type))
+/* Mask of every kind of dependency */
+#define PKG_DEPEND_ALL ((1u << PKG_DEPEND_TYPE_COUNT) - 1)
+/* Mask of the dependencies needed to build a package */
+#define PKG_DEPEND_BUILD_ALL (PKG_DEPEND_BIT(PKG_DEPEND_BUILDTOOL) | \
+                              PKG_DEPEND_BIT(PKG_DEPEND_BUILD) | \
+                              PKG_DEPEND_BIT(PKG_DEPEND_RUN))
+
+/* Returned by Pkg_GraphFindPackage for names which are not in the graph */
+#define PKG_GRAPH_NOT_FOUND ((size_t)-1)
+
+/* Struct to capture the dependency graph of a set of packages
+ *
+ * Everything is stored in flat arrays of vertex indices. The dependencies
+ * of vertex v are dependencies[dependency_offsets[v]] up to, excluding,
+ * dependencies[dependency_offsets[v + 1]], each listed once along with the
+ * mask of kinds it was declared as in the matching dependency_kinds entry.
+ */
+typedef struct Pkg_Graph
+{
+    /* the packages, not owned by the graph, vertex v is packages[v] */
+    Pkg_Package **packages;
+    size_t package_count;
+    /* mask of the dependency kinds the edges were built from */
+    unsigned int kinds;
+    /* package_count + 1 offsets into dependencies */
+    size_t *dependency_offsets;
+    /* depended upon vertices */
+    size_t *dependencies;
+    /* mask of PKG_DEPEND_BIT's of each entry of dependencies */
+    unsigned char *dependency_kinds;
+    /* the reverse edges, laid out like the dependencies: the packages which
+     * depend on vertex v and the kinds they depend on it as */
+    size_t *dependent_offsets;
+    size_t *dependents;
+    unsigned char *dependent_kinds;
+    /* the reverse edges of each kind on their own, laid out the same way,
+     * see Pkg_GraphGetDependents */
+    size_t *kind_dependent_offsets[PKG_DEPEND_TYPE_COUNT];
+    size_t *kind_dependents[PKG_DEPEND_TYPE_COUNT];
+    /* vertices in topological order, dependencies first */
+    size_t *order;
+    /* level l is order[level_offsets[l]] up to order[level_offsets[l + 1]],
+     * vertices in or depending on a cycle are in no level */
+    size_t *level_offsets;
+    size_t level_count;
+    /* number of vertices in order */
+    size_t ordered_count;
+    /* a dependency cycle, each vertex depends on the next and the last one
+     * on the first, empty if the graph is acyclic */
+    size_t *cycle;
+    size_t cycle_length;
+    /* vertices with the name of an earlier vertex, in increasing order,
+     * which are left out of the name index */
+    size_t *duplicates;
+    size_t duplicate_count;
+    /* name index, see Pkg_GraphFindPackage */
+    Pkg_InternTable *names;
+    size_t *index;
+    size_t index_capacity;
+} Pkg_Graph;
+
+/* Initializes an empty Pkg_Graph, call before using a Pkg_Graph */
+Pkg_Graph *
+Pkg_InitGraph();
+
+/* Frees a Pkg_Graph, the packages it was built from are left alone */
+void
+Pkg_FreeGraph(Pkg_Graph *graph);
+
+/* Builds the graph of packages from the dependency kinds in the kinds mask
+ *
+ * Replaces whatever graph was built before, the packages must outlive the
+ * graph. Runs in time linear in the number of packages and dependencies,
+ * names are looked up by Pkg_InternId if all packages share an intern
+ * table, or else through a hash table. Returns 1 if a package name
+ * appears twice or the graph has a cycle, which are left in duplicates and
+ * cycle for the caller to report, see Pkg_PrintGraphErrors. Nothing is
+ * printed. Vertices which could be ordered still are in the latter case.
+ */
+int
+Pkg_BuildGraph(
+    Pkg_Graph *graph,
+    Pkg_Package **packages,
+    size_t package_count,
+    unsigned int kinds);
+
+/* Prints a line to file for each duplicate name and for the cycle which
+ * Pkg_BuildGraph found, nothing if it returned 0 */
+void
+Pkg_PrintGraphErrors(const Pkg_Graph *graph, FILE *file);
+
+/* Returns the vertex of the package called name, or PKG_GRAPH_NOT_FOUND */
+size_t
+Pkg_GraphFindPackage(const Pkg_Graph *graph, const char *name);
+
+/* Returns the vertices which directly depend on vertex as a type dependency
+ *
+ * The count of returned vertices is stored in count. Takes constant time,
+ * the result points into the graph and is empty for kinds which the graph
+ * was not built from.
+ */
+const size_t *
+Pkg_GraphGetDependents(
+    const Pkg_Graph *graph,
+    size_t vertex,
+    Pkg_DependencyType type,
+    size_t *count);
+
+/* Finds every vertex which depends on any of vertices, directly or not
+ *
+ * Only dependencies of the kinds in the kinds mask are followed. The found
+ * vertices, excluding the given ones, are stored in result in breadth first
+ * order, which must have room for package_count entries. Returns the number
+ * of found vertices. Takes time linear in the size of the graph, however
+ * many vertices are given, so a set of changed packages is best passed in a
+ * single call.
+ */
+size_t
+Pkg_GraphGetTransitiveDependents(
+    const Pkg_Graph *graph,
+    const size_t *vertices,
+    size_t vertex_count,
+    unsigned int kinds,
+    size_t *result);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__GRAPH_H_ */
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines a string interning table.
+ *
+ * Interning a string returns a canonical copy of it, equal strings are
+ * always interned to the same pointer, so interned strings can be compared
+ * by identity. Every interned string also gets a dense id, counting up from
+ * 0, for indexing arrays by string. The strings live as long as the table.
+ * A Pkg_InternTable may be used by several threads at once.
+ *
+ * Example:
+ *
+ *     Pkg_InternTable *table = Pkg_InitInternTable();
+ *     const char *a = Pkg_Intern(table, "roscpp");
+ *     const char *b = Pkg_Intern(table, "roscpp");
+ *     // a == b and Pkg_InternId(a) == Pkg_InternId(b)
+ *     Pkg_FreeInternTable(table);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__INTERN_H_
+#define PACKAGE_MANIFEST_PARSING__INTERN_H_
+
+#include <stddef.h>
+
+/* Opaque interning table, see Pkg_InitInternTable */
+typedef struct Pkg_InternTable Pkg_InternTable;
+
+/* Initializes a Pkg_InternTable, call before using a Pkg_InternTable */
+Pkg_InternTable *
+Pkg_InitInternTable();
+
+/* Frees a Pkg_InternTable and every string interned in it */
+void
+Pkg_FreeInternTable(Pkg_InternTable *table);
+
+/* Returns the interned copy of str, interning it first if needed */
+const char *
+Pkg_Intern(Pkg_InternTable *table, const char *str);
+
+/* Same as Pkg_Intern, for the first len bytes of str */
+const char *
+Pkg_InternN(Pkg_InternTable *table, const char *str, size_t len);
+
+/* Returns the interned copy of str, or NULL if it was never interned */
+const char *
+Pkg_InternLookup(Pkg_InternTable *table, const char *str);
+
+/* Returns the id of a string returned by this API
+ *
+ * Must only be called with interned strings, not with arbitrary ones.
+ */
+unsigned int
+Pkg_InternId(const char *interned);
+
+/* Returns the number of strings interned so far, which is one past the
+ * largest id handed out
+ */
+size_t
+Pkg_InternCount(Pkg_InternTable *table);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__INTERN_H_ */
@@ -28,8 +28,24 @@
  *     // Use the pkg some other way...
  *     // Free the Pkg_Package
  *     Pkg_FreePackage(pkg);
+ *
+ * The list structs, like Pkg_PersonList, can be chained by the caller out
+ * of entries from their Pkg_Init*List functions and freed with their
+ * Pkg_Free*List functions. The lists of a Pkg_Package are not built that
+ * way: they are arrays owned by the package, which may come from an arena
+ * or an intern table, and only Pkg_FreePackage releases them. Never pass
+ * them to a Pkg_Free*List function.
  */
 
+#ifndef PACKAGE_MANIFEST_PARSING__PKG_H_
+#define PACKAGE_MANIFEST_PARSING__PKG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <package_manifest_parsing/arena.h>
+#include <package_manifest_parsing/intern.h>
+
 /* Struct to capture a person for use in listing of maintainers and authors */
 typedef struct Pkg_PersonList
 {
@@ -44,8 +60,9 @@ Pkg_InitPersonList();
 
 /* Frees a Pkg_PersonList
  *
- * Freeing is done recursively by traveling down the next pointers.
+ * Freeing travels down the next pointers, freeing the rest of the list too.
  * If you only want to free this Person, unset and update next pointers first.
+ * Only for lists built by the caller, see the top of this file.
  */
 void
 Pkg_FreePersonList(Pkg_PersonList *person_list);
@@ -63,8 +80,9 @@ Pkg_InitLicenseList();
 
 /* Frees a Pkg_LicenseList
  *
- * Freeing is done recursively by traveling down the next pointers.
+ * Freeing travels down the next pointers, freeing the rest of the list too.
  * If you only want to free this License, unset and update next pointers first.
+ * Only for lists built by the caller, see the top of this file.
  */
 void
 Pkg_FreeLicenseList(Pkg_LicenseList *license_list);
@@ -92,8 +110,9 @@ Pkg_InitURLList();
 
 /* Frees a Pkg_URLList
  *
- * Freeing is done recursively by traveling down the next pointers.
+ * Freeing travels down the next pointers, freeing the rest of the list too.
  * If you only want to free this url, unset and update next pointers first.
+ * Only for lists built by the caller, see the top of this file.
  */
 void
 Pkg_FreeURLList(Pkg_URLList *url_list);
@@ -106,33 +125,175 @@ typedef struct Pkg_Version
     unsigned int patch;
 } Pkg_Version;
 
-/* Struct to capture a list of typeless dependencies from a package manifest */
+/* Packed form of a Pkg_Version, which orders like the version it packs
+ *
+ * Holds the major, minor and patch components in 21 bits each, from the
+ * most to the least significant, so comparing two versions is a single
+ * integer comparison.
+ */
+typedef uint64_t Pkg_VersionKey;
+
+#define PKG_VERSION_COMPONENT_BITS 21
+/* largest version component which can be parsed and packed */
+#define PKG_VERSION_COMPONENT_MAX ((1u << PKG_VERSION_COMPONENT_BITS) - 1)
+
+/* Parses a version of the form major.minor.patch
+ *
+ * Only decimal digits are accepted for the components, up to
+ * PKG_VERSION_COMPONENT_MAX each, with optional whitespace around the
+ * whole version. Signs, missing or extra components and trailing text are
+ * rejected. Returns 0 on success, else 1 and leaves version untouched.
+ */
+int
+Pkg_ParseVersion(const char *str, Pkg_Version *version);
+
+/* Packs a version, components above PKG_VERSION_COMPONENT_MAX saturate */
+Pkg_VersionKey
+Pkg_PackVersion(const Pkg_Version *version);
+
+/* Unpacks a version packed by Pkg_PackVersion */
+void
+Pkg_UnpackVersion(Pkg_VersionKey key, Pkg_Version *version);
+
+/* Compares two versions, returns <0, 0 or >0 like strcmp */
+int
+Pkg_CompareVersions(const Pkg_Version *a, const Pkg_Version *b);
+
+/* Enum to define the version constraints a dependency can carry
+ *
+ * Used as an index into Pkg_DependencyList's version_keys, the matching bit
+ * of its constraints mask is PKG_CONSTRAINT_BIT(constraint).
+ */
+typedef enum Pkg_VersionConstraint
+{
+    PKG_VERSION_LT,
+    PKG_VERSION_LTE,
+    PKG_VERSION_EQ,
+    PKG_VERSION_GT,
+    PKG_VERSION_GTE,
+    /* number of constraints, not a constraint itself */
+    PKG_VERSION_CONSTRAINT_COUNT
+} Pkg_VersionConstraint;
+
+#define PKG_CONSTRAINT_BIT(constraint) (1u << (constraint))
+
+/* Struct to capture a list of typeless dependencies from a package manifest
+ *
+ * The version constraints are stored inline and packed, only the entries of
+ * version_keys whose bit is set in constraints are meaningful.
+ */
 typedef struct Pkg_DependencyList
 {
     char *name;
-    Pkg_Version *version_lt;
-    Pkg_Version *version_lte;
-    Pkg_Version *version_eq;
-    Pkg_Version *version_gt;
-    Pkg_Version *version_gte;
     struct Pkg_DependencyList *next;
+    /* bitmask of PKG_CONSTRAINT_BIT's of the constraints which are set */
+    unsigned int constraints;
+    /* version_lt, version_lte, ... indexed by Pkg_VersionConstraint */
+    Pkg_VersionKey version_keys[PKG_VERSION_CONSTRAINT_COUNT];
 } Pkg_DependencyList;
 
+/* Gets a version constraint of a dependency
+ *
+ * Returns 1 and stores the version if the constraint is set, else 0.
+ */
+int
+Pkg_GetDependencyVersion(
+    const Pkg_DependencyList *dep,
+    Pkg_VersionConstraint constraint,
+    Pkg_Version *version);
+
+/* Returns 1 if version satisfies every version constraint of dep
+ *
+ * A dependency without constraints accepts every version.
+ */
+int
+Pkg_DependencyAccepts(
+    const Pkg_DependencyList *dep,
+    const Pkg_Version *version);
+
+/* Same as Pkg_DependencyAccepts, for a version packed by Pkg_PackVersion */
+int
+Pkg_DependencyAcceptsKey(const Pkg_DependencyList *dep, Pkg_VersionKey key);
+
+/* Returns the mask of PKG_CONSTRAINT_BIT's of the constraints of dep which
+ * the packed version key does not satisfy, 0 if it satisfies all of them
+ */
+unsigned int
+Pkg_DependencyFailedConstraints(
+    const Pkg_DependencyList *dep,
+    Pkg_VersionKey key);
+
 /* Initializes Pkg_DependencyList, call before using a Pkg_DependencyList */
 Pkg_DependencyList *
 Pkg_InitDependencyList();
 
 /* Frees a Pkg_DependencyList
  *
- * Freeing is done recursively by traveling down the next pointers.
+ * Freeing travels down the next pointers, freeing the rest of the list too.
  * If you only want to free this dep, unset and update next pointers first.
+ * Only for lists built by the caller, see the top of this file.
  */
 void
 Pkg_FreeDependencyList(Pkg_DependencyList *dep_list);
 
-/* Struct to capture the contents of a package manifest */
+/* Enum to define the kinds of dependencies a package can declare */
+typedef enum Pkg_DependencyType
+{
+    PKG_DEPEND_BUILDTOOL,
+    PKG_DEPEND_BUILD,
+    PKG_DEPEND_RUN,
+    PKG_DEPEND_TEST,
+    /* number of dependency types, not a type itself */
+    PKG_DEPEND_TYPE_COUNT
+} Pkg_DependencyType;
+
+/* Parts of a package manifest, to be or'ed into a mask
+ *
+ * A mask selects which parts Pkg_ParserSetFields has the parser extract,
+ * everything else is skipped without being copied or allocated.
+ */
+#define PKG_FIELD_NAME              (1u << 0)
+#define PKG_FIELD_VERSION           (1u << 1)
+#define PKG_FIELD_DESCRIPTION       (1u << 2)
+#define PKG_FIELD_MAINTAINERS       (1u << 3)
+#define PKG_FIELD_LICENSES          (1u << 4)
+#define PKG_FIELD_URLS              (1u << 5)
+#define PKG_FIELD_AUTHORS           (1u << 6)
+#define PKG_FIELD_BUILDTOOL_DEPENDS (1u << 7)
+#define PKG_FIELD_BUILD_DEPENDS     (1u << 8)
+#define PKG_FIELD_RUN_DEPENDS       (1u << 9)
+#define PKG_FIELD_TEST_DEPENDS      (1u << 10)
+#define PKG_FIELD_EXPORTS           (1u << 11)
+/* every dependency list */
+#define PKG_FIELD_DEPENDS \
+    (PKG_FIELD_BUILDTOOL_DEPENDS | PKG_FIELD_BUILD_DEPENDS | \
+     PKG_FIELD_RUN_DEPENDS | PKG_FIELD_TEST_DEPENDS)
+/* the whole manifest, the default */
+#define PKG_FIELD_ALL ((1u << 12) - 1)
+
+/* Struct to capture the contents of a package manifest
+ *
+ * Every list is stored as a contiguous array, with its length in the
+ * matching *_count member, so the entries can be indexed directly:
+ *
+ *     for (size_t i = 0; i < pkg->run_depend_count; ++i)
+ *     {
+ *         const char *name = pkg->run_depends[i].name;
+ *     }
+ *
+ * For compatibility the next pointers of the entries are still chained
+ * through each array, so the lists can also be walked as linked lists.
+ */
 typedef struct Pkg_Package
 {
+    /* arena everything below is allocated from, NULL if using malloc */
+    Pkg_Arena *arena;
+    /* table the package and dependency names are interned in, NULL if they
+     * are owned by the package, see Pkg_ParserSetInternTable */
+    Pkg_InternTable *names;
+    /* mask of PKG_FIELD_'s which were extracted, the members of the other
+     * fields are left empty, see Pkg_ParserSetFields */
+    unsigned int fields;
     /* package.xml format version */
     unsigned int package_format;
     /* filename of the package.xml this was created from */
@@ -147,36 +308,235 @@ typedef struct Pkg_Package
     char *description;
     /* package maintainers */
     Pkg_PersonList *maintainers;
+    size_t maintainer_count;
     /* package licenses */
     Pkg_LicenseList *licenses;
+    size_t license_count;
     /* package urls */
     Pkg_URLList *urls;
+    size_t url_count;
     /* package authors */
     Pkg_PersonList *authors;
+    size_t author_count;
     /* buildtool_depends */
     Pkg_DependencyList *buildtool_depends;
+    size_t buildtool_depend_count;
     /* build_depends */
     Pkg_DependencyList *build_depends;
+    size_t build_depend_count;
     /* run_depends */
     Pkg_DependencyList *run_depends;
+    size_t run_depend_count;
     /* test_depends */
     Pkg_DependencyList *test_depends;
-    /* Export Section */
+    size_t test_depend_count;
+    /* Export Section, the <export> tag as it appears in the manifest, see
+     * Pkg_ParseExports */
     char *exports;
+    /* byte range of the <export> tag within the manifest */
+    size_t exports_offset;
+    size_t exports_size;
+    /* fingerprint of the bytes of the manifest, 0 until it is parsed */
+    uint64_t content_hash;
+    /* fingerprint of the fields which were extracted, unaffected by
+     * whitespace, comments and the order of dependencies, and not covering
+     * the filename, so equal for manifests which only differ in formatting,
+     * 0 until it is parsed */
+    uint64_t semantic_hash;
 } Pkg_Package;
 
 /* Initializes a Pkg_Package struct, call before using a Pkg_Package */
 Pkg_Package *
 Pkg_InitPackage();
 
-/* Frees a Pkg_Package object, recursively freeing any contained structs */
+/* Initializes a Pkg_Package struct which is allocated from arena
+ *
+ * Everything parsed into the Pkg_Package is allocated from the arena as
+ * well, and is released all at once by Pkg_FreeArena.
+ */
+Pkg_Package *
+Pkg_InitPackageInArena(Pkg_Arena *arena);
+
+/* Frees a Pkg_Package object, recursively freeing any contained structs
+ *
+ * Does nothing for a Pkg_Package allocated from an arena.
+ */
 void
 Pkg_FreePackage(Pkg_Package *pkg);
 
+/* Returns the array of dependencies of the given type, storing its length
+ * in count
+ */
+const Pkg_DependencyList *
+Pkg_GetDependencies(
+    const Pkg_Package *pkg,
+    Pkg_DependencyType type,
+    size_t *count);
+
+/* Struct to capture an attribute of an export */
+typedef struct Pkg_ExportAttr
+{
+    char *name;
+    char *value;
+} Pkg_ExportAttr;
+
+/* Struct to capture a child of the <export> tag
+ *
+ * For instance <nodelet plugin="${prefix}/nodelets.xml"/> has the tag
+ * "nodelet" and a single attribute "plugin".
+ */
+typedef struct Pkg_Export
+{
+    char *tag;
+    /* text of all descendants, "" if there is none */
+    char *content;
+    Pkg_ExportAttr *attrs;
+    size_t attr_count;
+} Pkg_Export;
+
+/* Struct to capture the parsed <export> tag of a package */
+typedef struct Pkg_Exports
+{
+    Pkg_Export *entries;
+    size_t count;
+} Pkg_Exports;
+
+/* Initializes a Pkg_Exports struct, call before using a Pkg_Exports */
+Pkg_Exports *
+Pkg_InitExports();
+
+/* Frees a Pkg_Exports, including every Pkg_Export it contains */
+void
+Pkg_FreeExports(Pkg_Exports *exports);
+
+/* Parses the <export> tag of pkg into its children
+ *
+ * Parsing a manifest only keeps the text of the <export> tag, this turns it
+ * into tags and attributes on demand. Replaces the contents of exports,
+ * which is left empty if pkg has no <export> tag. Entities declared by the
+ * manifest's DOCTYPE are not known here. Returns 1 on error.
+ */
+int
+Pkg_ParseExports(const Pkg_Package *pkg, Pkg_Exports *exports);
+
+/* Returns the value of an attribute of entry, NULL if it has none such */
+const char *
+Pkg_ExportGetAttr(const Pkg_Export *entry, const char *name);
+
 /* Prints the contents of a Pkg_Package struct */
 void
 Pkg_PrintPackage(Pkg_Package *pkg);
 
-/* Parses a package manifest file and puts the result in a Pkg_Package */
+/* Parses a package manifest file and puts the result in a Pkg_Package
+ *
+ * This creates and frees a Pkg_Parser on every call, use a Pkg_Parser
+ * directly when parsing many manifests.
+ */
 int
 Pkg_ParsePackageManifest(const char *path, Pkg_Package *pkg);
+
+/* Parses a package manifest held in memory and puts the result in a pkg
+ *
+ * The len bytes at buf are read in place, name is used as the filename of
+ * the Pkg_Package and in error messages and may be NULL.
+ */
+int
+Pkg_ParsePackageManifestFromBuffer(
+    const char *buf,
+    size_t len,
+    const char *name,
+    Pkg_Package *pkg);
+
+/* Parses a package manifest file by mapping it into memory
+ *
+ * Same as Pkg_ParsePackageManifest, but the file is mmap'd and parsed in
+ * place rather than read through libxml2's input buffering.
+ */
+int
+Pkg_ParsePackageManifestMapped(const char *path, Pkg_Package *pkg);
+
+/* Opaque, reusable context for parsing package manifests
+ *
+ * A Pkg_Parser keeps libxml2's parser context and scratch buffers alive
+ * between calls, so parsing many manifests only pays for their setup once.
+ * libxml2 itself is initialized once per process and never torn down.
+ * A Pkg_Parser must only be used by one thread at a time, create one per
+ * thread in order to parse in parallel.
+ */
+typedef struct Pkg_Parser Pkg_Parser;
+
+/* Enum to define the ways a Pkg_Parser can read a manifest
+ *
+ * All backends produce identical Pkg_Package's.
+ */
+typedef enum Pkg_ParserBackend
+{
+    /* build a complete libxml2 tree, then walk it (default) */
+    PKG_BACKEND_DOM,
+    /* fill the Pkg_Package from libxml2's streaming reader, without a tree */
+    PKG_BACKEND_STREAM,
+    /* scan the manifest with a tokenizer made for package.xml, handing
+     * anything it does not handle, like a DOCTYPE, another encoding than
+     * UTF-8 or namespaces, to PKG_BACKEND_DOM, with the same results */
+    PKG_BACKEND_SCAN
+} Pkg_ParserBackend;
+
+/* Initializes a Pkg_Parser, call before using a Pkg_Parser */
+Pkg_Parser *
+Pkg_InitParser();
+
+/* Frees a Pkg_Parser */
+void
+Pkg_FreeParser(Pkg_Parser *parser);
+
+/* Selects how the parser reads manifests, see Pkg_ParserBackend */
+void
+Pkg_ParserSetBackend(Pkg_Parser *parser, Pkg_ParserBackend backend);
+
+/* Interns the package and dependency names of parsed manifests in table
+ *
+ * The names of packages parsed afterwards point into table, so equal names
+ * are the same pointer and Pkg_InternId gives their id. The names must not
+ * be modified, and table must outlive the packages. Passing NULL switches
+ * back to names owned by each package.
+ */
+void
+Pkg_ParserSetInternTable(Pkg_Parser *parser, Pkg_InternTable *table);
+
+/* Selects which parts of a manifest the parser extracts
+ *
+ * fields is a mask of PKG_FIELD_'s, PKG_FIELD_ALL by default. Elements for
+ * the other fields are skipped before their text or attributes are copied,
+ * and the matching members of the Pkg_Package stay empty. With the stream
+ * backend, a mask made up only of PKG_FIELD_NAME, PKG_FIELD_VERSION,
+ * PKG_FIELD_DESCRIPTION and PKG_FIELD_EXPORTS stops reading the manifest
+ * as soon as all of them were found, errors in the rest of it may then go
+ * unreported.
+ */
+void
+Pkg_ParserSetFields(Pkg_Parser *parser, unsigned int fields);
+
+/* Parses a package manifest file using parser and puts the result in pkg */
+int
+Pkg_ParserParsePackageManifest(
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg);
+
+/* Same as Pkg_ParsePackageManifestFromBuffer, but using parser */
+int
+Pkg_ParserParsePackageManifestFromBuffer(
+    Pkg_Parser *parser,
+    const char *buf,
+    size_t len,
+    const char *name,
+    Pkg_Package *pkg);
+
+/* Same as Pkg_ParsePackageManifestMapped, but using parser */
+int
+Pkg_ParserParsePackageManifestMapped(
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__PKG_H_ */
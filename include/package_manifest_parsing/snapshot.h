@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines snapshots, parsed workspaces saved to a file.
+ *
+ * A snapshot is a Pkg_Blob of the packages of a workspace, extended with
+ * the workspace's root, a name index and the dependency edges between its
+ * packages. Opening one maps the file read only and checks its header, so
+ * it takes the same time for any workspace size, and concurrent processes
+ * share its pages through the page cache. Nothing is parsed or copied.
+ *
+ * Example:
+ *
+ *     // once, after the workspace changed
+ *     Pkg_WriteSnapshot(ws, "/path/to/build/workspace.pkgdb");
+ *
+ *     // in every tool
+ *     Pkg_Snapshot *snapshot = Pkg_InitSnapshot();
+ *     if (0 == Pkg_OpenSnapshot(snapshot, "/path/to/build/workspace.pkgdb"))
+ *     {
+ *         size_t v = Pkg_SnapshotFindPackage(snapshot, "roscpp");
+ *         size_t count;
+ *         const uint32_t *deps = \
+ *             Pkg_SnapshotGetDependencies(snapshot, v, &count, NULL);
+ *     }
+ *     Pkg_FreeSnapshot(snapshot);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__SNAPSHOT_H_
+#define PACKAGE_MANIFEST_PARSING__SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <package_manifest_parsing/blob.h>
+#include <package_manifest_parsing/workspace.h>
+
+/* Returned by Pkg_SnapshotFindPackage for names which are not in it */
+#define PKG_SNAPSHOT_NOT_FOUND ((size_t)-1)
+
+/* Struct to read a snapshot in place, see Pkg_OpenSnapshot
+ *
+ * Vertex v is the package blob.packages[v]. The edges are laid out like
+ * those of a Pkg_Graph built from every kind of dependency: the packages v
+ * depends on are edges[edge_offsets[v]] up to, excluding,
+ * edges[edge_offsets[v + 1]], with the mask of PKG_DEPEND_BIT's of each in
+ * edge_kinds. Opening does not visit the edges, so a snapshot from an
+ * untrusted source should have its vertices checked against
+ * blob.package_count before they are used as indices.
+ */
+typedef struct Pkg_Snapshot
+{
+    /* the packages of the workspace, sorted like Pkg_Workspace's */
+    Pkg_Blob blob;
+    /* directory the workspace was crawled from */
+    const char *root;
+    const uint32_t *edge_offsets;
+    const uint32_t *edges;
+    const uint8_t *edge_kinds;
+    size_t edge_count;
+    /* open addressing table of vertices by name, see snapshot.c */
+    const uint32_t *index;
+    size_t index_capacity;
+    /* the mapped file */
+    void *map;
+    size_t map_size;
+} Pkg_Snapshot;
+
+/* Writes the packages of ws, with their name index and edges, to path
+ *
+ * The file is replaced atomically, so tools which have the previous
+ * snapshot open keep reading it undisturbed. Returns 0 on success.
+ */
+int
+Pkg_WriteSnapshot(const Pkg_Workspace *ws, const char *path);
+
+/* Initializes a Pkg_Snapshot, call before using a Pkg_Snapshot */
+Pkg_Snapshot *
+Pkg_InitSnapshot();
+
+/* Frees a Pkg_Snapshot, unmapping its file */
+void
+Pkg_FreeSnapshot(Pkg_Snapshot *snapshot);
+
+/* Maps the snapshot file at path into snapshot
+ *
+ * Replaces the snapshot open before, if any. Returns 1, after reporting on
+ * stderr, if the file cannot be mapped or is not a snapshot.
+ */
+int
+Pkg_OpenSnapshot(Pkg_Snapshot *snapshot, const char *path);
+
+/* Returns the vertex of the package called name, PKG_SNAPSHOT_NOT_FOUND if
+ * there is none
+ */
+size_t
+Pkg_SnapshotFindPackage(const Pkg_Snapshot *snapshot, const char *name);
+
+/* Returns the vertices vertex depends on, storing their number in count
+ * and, unless kinds is NULL, their kinds of dependency in kinds
+ */
+const uint32_t *
+Pkg_SnapshotGetDependencies(
+    const Pkg_Snapshot *snapshot,
+    size_t vertex,
+    size_t *count,
+    const uint8_t **kinds);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__SNAPSHOT_H_ */
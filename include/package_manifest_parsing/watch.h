@@ -0,0 +1,109 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Defines watching a workspace for changes to its manifests.
+ *
+ * A Pkg_Watcher parses a workspace once, like Pkg_ParseWorkspace, and then
+ * follows it through inotify: package.xml files and ignore markers which
+ * are written, created, moved or deleted, and directories which come and
+ * go. Each Pkg_WatcherPoll parses again only the manifests which were
+ * affected, updates the workspace and its dependency graph, and reports
+ * what changed in the form of a Pkg_WorkspaceDiff.
+ *
+ * Example:
+ *
+ *     Pkg_Workspace *ws = Pkg_InitWorkspace();
+ *     Pkg_Watcher *watcher = Pkg_InitWatcher();
+ *     if (Pkg_WatchWorkspace(watcher, "/path/to/src", 0, ws))
+ *     {
+ *         // Error handling
+ *     }
+ *     Pkg_WorkspaceDiff *diff = Pkg_InitWorkspaceDiff();
+ *     for (;;)
+ *     {
+ *         if (!Pkg_WatcherPoll(watcher, -1, diff)) continue;
+ *         for (size_t i = 0; i < diff->change_count; ++i)
+ *         {
+ *             // Handle diff->changes[i]
+ *         }
+ *     }
+ *     Pkg_FreeWorkspaceDiff(diff);
+ *     Pkg_FreeWatcher(watcher);
+ *     Pkg_FreeWorkspace(ws);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__WATCH_H_
+#define PACKAGE_MANIFEST_PARSING__WATCH_H_
+
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/workspace.h>
+
+/* Opaque workspace watcher, see Pkg_InitWatcher */
+typedef struct Pkg_Watcher Pkg_Watcher;
+
+/* Initializes a Pkg_Watcher, call before using a Pkg_Watcher */
+Pkg_Watcher *
+Pkg_InitWatcher();
+
+/* Stops watching and frees a Pkg_Watcher, the workspace is left alone */
+void
+Pkg_FreeWatcher(Pkg_Watcher *watcher);
+
+/* Parses root into ws like Pkg_ParseWorkspace and starts watching it
+ *
+ * ws must be freshly initialized, its settings are used for the manifests
+ * parsed later on as well, and it must outlive the watcher. Every directory
+ * the crawl visits is watched. Manifests which fail to parse, now or later,
+ * are reported on stderr and left out, failure_count only counts those of
+ * the first crawl. Returns 1, after reporting, if the workspace cannot be
+ * watched.
+ */
+int
+Pkg_WatchWorkspace(
+    Pkg_Watcher *watcher,
+    const char *root,
+    unsigned int nthreads,
+    Pkg_Workspace *ws);
+
+/* Waits up to timeout_ms, or forever if negative, for changes to the
+ * workspace and applies them
+ *
+ * A burst of events, like an editor saving a file, is collected as a whole.
+ * The manifests which were written, and those in directories which
+ * appeared or stopped being ignored, are parsed again. Packages which are
+ * gone are removed. The workspace's packages stay sorted, and the graph is
+ * built again if one of them changed, not when a manifest was only saved.
+ * Its cycle and duplicate names are left to the caller to report, see
+ * Pkg_PrintGraphErrors. Replaces the contents of diff with the
+ * packages which changed, which point into the workspace and at packages
+ * removed from it, kept until the next poll. Returns 1 if anything
+ * changed.
+ */
+int
+Pkg_WatcherPoll(Pkg_Watcher *watcher, int timeout_ms, Pkg_WorkspaceDiff *diff);
+
+/* Returns the inotify descriptor, which becomes readable when there is
+ * something to poll, for use in an event loop */
+int
+Pkg_WatcherGetFd(const Pkg_Watcher *watcher);
+
+/* Returns the dependency graph of the workspace, of every dependency kind,
+ * valid until the next poll */
+const Pkg_Graph *
+Pkg_WatcherGetGraph(const Pkg_Watcher *watcher);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__WATCH_H_ */
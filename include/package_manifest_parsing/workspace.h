@@ -0,0 +1,244 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines the Workspace related data structures and functions.
+ *
+ * A workspace is a directory tree containing any number of packages. The
+ * tree is crawled in parallel, descending stops at the first directory
+ * containing a package.xml, and directories containing a CATKIN_IGNORE or
+ * COLCON_IGNORE file are skipped along with everything below them.
+ *
+ * Example:
+ *
+ *     Pkg_Workspace *ws = Pkg_InitWorkspace();
+ *     int ret = Pkg_ParseWorkspace("/path/to/src", 0, ws);
+ *     if (ret)
+ *     {
+ *         // Error handling
+ *     }
+ *     for (size_t i = 0; i < ws->package_count; ++i)
+ *     {
+ *         Pkg_PrintPackage(ws->packages[i]);
+ *     }
+ *     // Free the Pkg_Workspace and all of its Pkg_Package's
+ *     Pkg_FreeWorkspace(ws);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__WORKSPACE_H_
+#define PACKAGE_MANIFEST_PARSING__WORKSPACE_H_
+
+#include <stddef.h>
+
+#include <package_manifest_parsing/cache.h>
+#include <package_manifest_parsing/pkg.h>
+
+/* Enum to define how the manifests of a workspace are read */
+typedef enum Pkg_ReadMethod
+{
+    /* batches of opens and reads go through io_uring, or through a pool of
+     * threads where the kernel does not allow io_uring */
+    PKG_READ_IO_URING,
+    /* a pool of threads reads them with blocking calls */
+    PKG_READ_THREADS
+} Pkg_ReadMethod;
+
+/* Struct to capture all of the packages found in a workspace */
+typedef struct Pkg_Workspace
+{
+    /* directory the workspace was crawled from */
+    char *root;
+    /* parsed packages, sorted by the filename of their package.xml */
+    Pkg_Package **packages;
+    /* number of entries in packages */
+    size_t package_count;
+    /* number of package.xml files which failed to parse */
+    size_t failure_count;
+    /* arenas the packages are allocated from, one per crawler thread */
+    Pkg_Arena **arenas;
+    /* number of entries in arenas */
+    size_t arena_count;
+    /* parser backend used for every manifest, set before parsing */
+    Pkg_ParserBackend backend;
+    /* PKG_FIELD_'s extracted from every manifest, set before parsing */
+    unsigned int fields;
+    /* table the package and dependency names of all packages are interned
+     * in, so they can be compared by pointer or by Pkg_InternId */
+    Pkg_InternTable *names;
+    /* cache to read unchanged manifests from and to add parsed ones to,
+     * NULL by default, not owned by the workspace, see Pkg_Cache */
+    Pkg_Cache *cache;
+    /* how manifests are read, PKG_READ_IO_URING by default */
+    Pkg_ReadMethod read_method;
+} Pkg_Workspace;
+
+/* Initializes a Pkg_Workspace struct, call before using a Pkg_Workspace */
+Pkg_Workspace *
+Pkg_InitWorkspace();
+
+/* Frees a Pkg_Workspace, including every Pkg_Package it contains
+ *
+ * Packages allocated from the workspace's arenas are released along with
+ * them, in a single pass over the arenas' blocks.
+ */
+void
+Pkg_FreeWorkspace(Pkg_Workspace *ws);
+
+/* Crawls root for package manifests and parses them into a Pkg_Workspace
+ *
+ * The crawl and the parsing are spread over nthreads threads, passing 0 uses
+ * one thread per online cpu. Manifests are read in the background as they
+ * are found, see Pkg_ReadMethod, and parsed as soon as they have been read.
+ * With a cache, only manifests which changed are read. Manifests which
+ * fail to parse are reported on stderr and counted in failure_count, the
+ * remaining packages are still returned. Returns 0 if every manifest was
+ * parsed successfully.
+ */
+int
+Pkg_ParseWorkspace(const char *root, unsigned int nthreads, Pkg_Workspace *ws);
+
+/* Struct to capture a dependency whose version constraints are not met */
+typedef struct Pkg_ConstraintViolation
+{
+    /* package declaring the dependency */
+    const Pkg_Package *package;
+    /* the dependency, and which of the package's lists it is in */
+    const Pkg_DependencyList *dependency;
+    Pkg_DependencyType type;
+    /* workspace package the dependency refers to */
+    const Pkg_Package *target;
+    /* mask of PKG_CONSTRAINT_BIT's which the target's version fails */
+    unsigned int failed;
+} Pkg_ConstraintViolation;
+
+/* Struct to capture the result of Pkg_CheckWorkspaceConstraints */
+typedef struct Pkg_ConstraintReport
+{
+    /* violations, in the order of the workspace's packages */
+    Pkg_ConstraintViolation *violations;
+    size_t violation_count;
+    /* number of dependencies with constraints on a workspace package */
+    size_t checked_count;
+    /* packages whose name an earlier package of the workspace has, in the
+     * order of the packages, dependencies on the name are only checked
+     * against the earlier one */
+    const Pkg_Package **duplicates;
+    size_t duplicate_count;
+} Pkg_ConstraintReport;
+
+/* Initializes a Pkg_ConstraintReport, call before using one */
+Pkg_ConstraintReport *
+Pkg_InitConstraintReport();
+
+/* Frees a Pkg_ConstraintReport */
+void
+Pkg_FreeConstraintReport(Pkg_ConstraintReport *report);
+
+/* Checks the version constraints of every dependency in the workspace
+ *
+ * Each dependency on a package of the workspace, of any kind, is checked
+ * against the version of that package. Dependencies on anything else,
+ * like system dependencies, have no version to check against and are
+ * skipped. The packages are split over nthreads threads, 0 uses one per
+ * online cpu. Replaces the contents of report, returns 1 if any
+ * constraint is violated.
+ */
+int
+Pkg_CheckWorkspaceConstraints(
+    const Pkg_Workspace *ws,
+    unsigned int nthreads,
+    Pkg_ConstraintReport *report);
+
+/* Ways a package can differ between two workspaces, to be or'ed into a
+ * mask */
+#define PKG_CHANGE_ADDED        (1u << 0)
+#define PKG_CHANGE_REMOVED      (1u << 1)
+/* the version differs, in either direction */
+#define PKG_CHANGE_VERSION      (1u << 2)
+/* a dependency list differs, see Pkg_DependencyChange */
+#define PKG_CHANGE_DEPENDENCIES (1u << 3)
+/* the semantic_hash differs while the version and the dependencies do
+ * not, so another field, like the description, changed */
+#define PKG_CHANGE_OTHER        (1u << 4)
+
+/* Struct to capture a dependency which only one side of a change declares
+ *
+ * A dependency whose constraints changed shows up twice, removed with the
+ * old constraints and added with the new ones.
+ */
+typedef struct Pkg_DependencyChange
+{
+    /* the dependency, of the new package if added, else of the old one */
+    const Pkg_DependencyList *dependency;
+    Pkg_DependencyType type;
+    /* 1 if only the new package declares it, 0 if only the old one */
+    int added;
+} Pkg_DependencyChange;
+
+/* Struct to capture a package which differs between two workspaces */
+typedef struct Pkg_PackageChange
+{
+    /* the package in the old workspace, NULL if it was added */
+    const Pkg_Package *old_package;
+    /* the package in the new workspace, NULL if it was removed */
+    const Pkg_Package *new_package;
+    /* mask of PKG_CHANGE_'s */
+    unsigned int changes;
+    /* dependency_changes of the diff from dependency_offset on */
+    size_t dependency_offset;
+    size_t dependency_count;
+} Pkg_PackageChange;
+
+/* Struct to capture the result of Pkg_DiffWorkspaces */
+typedef struct Pkg_WorkspaceDiff
+{
+    /* changes, in the order of the new workspace's packages, followed by
+     * the removed packages in the order of the old workspace's */
+    Pkg_PackageChange *changes;
+    size_t change_count;
+    /* the differing dependencies of every change, see Pkg_PackageChange */
+    Pkg_DependencyChange *dependency_changes;
+    size_t dependency_change_count;
+    /* number of packages in both workspaces which did not change */
+    size_t unchanged_count;
+} Pkg_WorkspaceDiff;
+
+/* Initializes a Pkg_WorkspaceDiff, call before using one */
+Pkg_WorkspaceDiff *
+Pkg_InitWorkspaceDiff();
+
+/* Frees a Pkg_WorkspaceDiff, the workspaces it refers to are left alone */
+void
+Pkg_FreeWorkspaceDiff(Pkg_WorkspaceDiff *diff);
+
+/* Lists the packages which were added, removed or changed between two
+ * parses of a workspace
+ *
+ * Packages are matched by name through a name index of old_ws, and a pair
+ * with equal semantic_hash's is unchanged without looking any further. A
+ * name used more than once is matched once on each side, its other
+ * packages count as removed or added. Nothing is printed.
+ * Only the other pairs have their versions and dependency lists compared,
+ * the latter as multisets. Packages without a semantic_hash are always
+ * compared. Replaces the contents of diff, which points into both
+ * workspaces, returns 1 if anything changed.
+ */
+int
+Pkg_DiffWorkspaces(
+    const Pkg_Workspace *old_ws,
+    const Pkg_Workspace *new_ws,
+    Pkg_WorkspaceDiff *diff);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__WORKSPACE_H_ */
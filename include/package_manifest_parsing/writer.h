@@ -0,0 +1,113 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Defines buffered output of packages, for humans or for other programs.
+ *
+ * A Pkg_Writer collects output in one large buffer, which is handed to its
+ * FILE * in big chunks, or kept in memory. Packages are written as the
+ * text of Pkg_PrintPackage, as JSON Lines with one object per package, or
+ * as tab separated values with one row per package.
+ *
+ * Example:
+ *
+ *     Pkg_Writer *writer = Pkg_InitFileWriter(stdout);
+ *     for (size_t i = 0; i < ws->package_count; ++i)
+ *     {
+ *         Pkg_WritePackage(writer, ws->packages[i], PKG_OUTPUT_JSON);
+ *     }
+ *     if (Pkg_WriterFlush(writer))
+ *     {
+ *         // Error handling
+ *     }
+ *     Pkg_FreeWriter(writer);
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__WRITER_H_
+#define PACKAGE_MANIFEST_PARSING__WRITER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+/* Enum to define the formats a package can be written in */
+typedef enum Pkg_OutputFormat
+{
+    /* human readable, as printed by Pkg_PrintPackage */
+    PKG_OUTPUT_TEXT,
+    /* a JSON object on a single line, strings which are not set are null */
+    PKG_OUTPUT_JSON,
+    /* a single line of the columns listed by Pkg_WriteTSVHeader, lists
+     * are comma separated, tabs, newlines and backslashes are escaped as
+     * \t, \n and \\ */
+    PKG_OUTPUT_TSV
+} Pkg_OutputFormat;
+
+/* Opaque buffered writer, see Pkg_InitFileWriter */
+typedef struct Pkg_Writer Pkg_Writer;
+
+/* Initializes a Pkg_Writer which writes to file whenever its buffer fills
+ *
+ * The file is not closed by Pkg_FreeWriter.
+ */
+Pkg_Writer *
+Pkg_InitFileWriter(FILE *file);
+
+/* Initializes a Pkg_Writer which keeps everything in memory, see
+ * Pkg_WriterGetData
+ */
+Pkg_Writer *
+Pkg_InitMemoryWriter();
+
+/* Flushes and frees a Pkg_Writer */
+void
+Pkg_FreeWriter(Pkg_Writer *writer);
+
+/* Hands the buffered output to the writer's file, and flushes the file
+ *
+ * Does nothing for a memory writer. Returns 1 if anything written so far
+ * could not be written to the file.
+ */
+int
+Pkg_WriterFlush(Pkg_Writer *writer);
+
+/* Returns the NUL terminated output of a memory writer, storing its size
+ * in size, or what is still buffered for a file writer
+ */
+const char *
+Pkg_WriterGetData(const Pkg_Writer *writer, size_t *size);
+
+/* Appends len bytes to the output */
+void
+Pkg_WriterAppend(Pkg_Writer *writer, const char *data, size_t len);
+
+/* Writes pkg in the given format */
+void
+Pkg_WritePackage(
+    Pkg_Writer *writer,
+    const Pkg_Package *pkg,
+    Pkg_OutputFormat format);
+
+/* Writes the line naming the columns of PKG_OUTPUT_TSV
+ *
+ * The columns are filename, name, version and the buildtool, build, run
+ * and test dependencies. A dependency is its name, followed by its version
+ * constraints as in "foo>=1.0.0<2.0.0".
+ */
+void
+Pkg_WriteTSVHeader(Pkg_Writer *writer);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__WRITER_H_ */
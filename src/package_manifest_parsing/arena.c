@@ -0,0 +1,126 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/arena.h>
+
+/* Alignment of every allocation, enough for any fundamental type */
+#define ARENA_ALIGNMENT 16
+/* Size of a regular block, a few dozen manifests fit into one */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+#define ARENA_ALIGN(size) \
+    (((size) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+/* Storage of a block starts right after its (aligned) header */
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(ArenaBlock))
+
+struct Pkg_Arena
+{
+    /* the block currently allocated from comes first */
+    ArenaBlock *blocks;
+};
+
+static inline ArenaBlock *
+newBlock(size_t size)
+{
+    ArenaBlock *block = (ArenaBlock *)malloc(ARENA_HEADER_SIZE + size);
+    assert(block);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/* Pkg_Arena Functions */
+Pkg_Arena *
+Pkg_InitArena()
+{
+    Pkg_Arena *arena = (Pkg_Arena *)malloc(sizeof(Pkg_Arena));
+    arena->blocks = NULL;
+    return arena;
+}
+
+void
+Pkg_FreeArena(Pkg_Arena *arena)
+{
+    ArenaBlock *block = arena->blocks;
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+void *
+Pkg_ArenaAlloc(Pkg_Arena *arena, size_t size)
+{
+    size = ARENA_ALIGN(size ? size : 1);
+    ArenaBlock *block = arena->blocks;
+    if (!block || block->used + size > block->size)
+    {
+        if (size > ARENA_BLOCK_SIZE / 4)
+        {
+            /* Large allocations get a block of their own, which is put
+             * behind the current block so its free space is not lost */
+            ArenaBlock *large = newBlock(size);
+            large->used = size;
+            if (block)
+            {
+                large->next = block->next;
+                block->next = large;
+            }
+            else
+            {
+                arena->blocks = large;
+            }
+            return (char *)large + ARENA_HEADER_SIZE;
+        }
+        block = newBlock(ARENA_BLOCK_SIZE);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    void *ptr = (char *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char *
+Pkg_ArenaStrndup(Pkg_Arena *arena, const char *str, size_t len)
+{
+    char *copy = (char *)Pkg_ArenaAlloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *
+Pkg_ArenaStrdup(Pkg_Arena *arena, const char *str)
+{
+    return Pkg_ArenaStrndup(arena, str, strlen(str));
+}
@@ -0,0 +1,721 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/blob.h>
+#include <package_manifest_parsing/pkg.h>
+
+#include "hash.h"
+#include "internal.h"
+
+/* A blob starts with a BlobHeader, followed by section_count BlobSection's
+ * describing where each array of the blob is, see BlobSectionId. Sections
+ * start on 8 byte boundaries, readers skip sections they do not know.
+ */
+#define BLOB_MAGIC "PKGBLOB"
+#define BLOB_MAGIC_SIZE 8
+#define BLOB_BYTE_ORDER 0x01020304u
+#define BLOB_ALIGN 8
+
+typedef struct BlobHeader
+{
+    char magic[BLOB_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;
+    uint32_t section_count;
+    uint32_t reserved;
+} BlobHeader;
+
+typedef struct BlobSection
+{
+    uint32_t id;
+    /* number of items, for the strings their total size */
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+} BlobSection;
+
+#define BLOB_SECTION_COUNT (SECTION_STRINGS - SECTION_PACKAGES + 1)
+
+/* State of Pkg_WriteBlob */
+typedef struct BlobWriter
+{
+    Staging packages;
+    Staging dependencies;
+    Staging persons;
+    Staging licenses;
+    Staging urls;
+    Buffer strings;
+    /* open addressing index of strings by content, PKG_BLOB_NULL if empty */
+    uint32_t *slots;
+    size_t slot_capacity;
+    size_t string_count;
+    /* set once something does not fit into 32 bits */
+    int overflow;
+} BlobWriter;
+
+static void
+growSlots(BlobWriter *writer)
+{
+    size_t capacity = writer->slot_capacity ? writer->slot_capacity * 2 : 1024;
+    uint32_t *slots = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    assert(slots);
+    for (size_t i = 0; i < capacity; ++i) slots[i] = PKG_BLOB_NULL;
+    for (size_t i = 0; i < writer->slot_capacity; ++i)
+    {
+        uint32_t offset = writer->slots[i];
+        if (PKG_BLOB_NULL == offset) continue;
+        const char *str = writer->strings.data + offset;
+        size_t index = (size_t)pkgHash(str, strlen(str)) & (capacity - 1);
+        while (PKG_BLOB_NULL != slots[index])
+        {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = offset;
+    }
+    if (writer->slots) free(writer->slots);
+    writer->slots = slots;
+    writer->slot_capacity = capacity;
+}
+
+/*
+ * Returns the offset of str in the string section, adding it if needed
+ */
+static uint32_t
+putString(BlobWriter *writer, const char *str)
+{
+    if (!str) return PKG_BLOB_NULL;
+    if (2 * (writer->string_count + 1) > writer->slot_capacity)
+    {
+        growSlots(writer);
+    }
+    size_t len = strlen(str);
+    size_t mask = writer->slot_capacity - 1;
+    size_t index = (size_t)pkgHash(str, len) & mask;
+    for (;;)
+    {
+        uint32_t offset = writer->slots[index];
+        if (PKG_BLOB_NULL == offset) break;
+        if (0 == strcmp(writer->strings.data + offset, str)) return offset;
+        index = (index + 1) & mask;
+    }
+    if (writer->strings.size + len + 1 >= PKG_BLOB_NULL)
+    {
+        writer->overflow = 1;
+        return PKG_BLOB_NULL;
+    }
+    uint32_t offset = (uint32_t)writer->strings.size;
+    /* Keep the terminator, the strings are stored back to back */
+    bufferAppend(&writer->strings, str, len + 1);
+    writer->slots[index] = offset;
+    writer->string_count++;
+    return offset;
+}
+
+static inline uint32_t
+checkedU32(BlobWriter *writer, size_t value)
+{
+    if (value >= PKG_BLOB_NULL) writer->overflow = 1;
+    return (uint32_t)value;
+}
+
+static void
+putPersons(BlobWriter *writer, const Pkg_PersonList *persons, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Pkg_BlobPerson *person = (Pkg_BlobPerson *)stagingAppend(
+            &writer->persons, sizeof(Pkg_BlobPerson));
+        person->name = putString(writer, persons[i].name);
+        person->email = putString(writer, persons[i].email);
+    }
+}
+
+static void
+putPackage(BlobWriter *writer, const Pkg_Package *pkg)
+{
+    Pkg_BlobPackage record;
+    memset(&record, 0, sizeof(record));
+    record.name = putString(writer, pkg->name);
+    record.filename = putString(writer, pkg->filename);
+    record.description = putString(writer, pkg->description);
+    record.exports = putString(writer, pkg->exports);
+    record.package_format = pkg->package_format;
+    record.fields = pkg->fields;
+    record.version = Pkg_PackVersion(&pkg->version);
+    record.abi_version = Pkg_PackVersion(&pkg->abi_version);
+    record.exports_offset = pkg->exports_offset;
+    record.exports_size = pkg->exports_size;
+    record.content_hash = pkg->content_hash;
+    record.semantic_hash = pkg->semantic_hash;
+
+    record.persons = checkedU32(writer, writer->persons.count);
+    record.maintainer_count = checkedU32(writer, pkg->maintainer_count);
+    record.author_count = checkedU32(writer, pkg->author_count);
+    putPersons(writer, pkg->maintainers, pkg->maintainer_count);
+    putPersons(writer, pkg->authors, pkg->author_count);
+
+    record.licenses = checkedU32(writer, writer->licenses.count);
+    record.license_count = checkedU32(writer, pkg->license_count);
+    for (size_t i = 0; i < pkg->license_count; ++i)
+    {
+        uint32_t *license = (uint32_t *)stagingAppend(
+            &writer->licenses, sizeof(uint32_t));
+        *license = putString(writer, pkg->licenses[i].license);
+    }
+
+    record.urls = checkedU32(writer, writer->urls.count);
+    record.url_count = checkedU32(writer, pkg->url_count);
+    for (size_t i = 0; i < pkg->url_count; ++i)
+    {
+        Pkg_BlobURL *url = (Pkg_BlobURL *)stagingAppend(
+            &writer->urls, sizeof(Pkg_BlobURL));
+        url->url = putString(writer, pkg->urls[i].url);
+        url->type = (uint32_t)pkg->urls[i].type;
+    }
+
+    record.dependencies = checkedU32(writer, writer->dependencies.count);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t count;
+        const Pkg_DependencyList *deps = Pkg_GetDependencies(
+            pkg, (Pkg_DependencyType)type, &count);
+        record.dependency_counts[type] = checkedU32(writer, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Pkg_BlobDependency *dep = (Pkg_BlobDependency *)stagingAppend(
+                &writer->dependencies, sizeof(Pkg_BlobDependency));
+            dep->name = putString(writer, deps[i].name);
+            dep->constraints = deps[i].constraints;
+            memcpy(dep->version_keys, deps[i].version_keys,
+                   sizeof(dep->version_keys));
+        }
+    }
+
+    memcpy(stagingAppend(&writer->packages, sizeof(Pkg_BlobPackage)),
+           &record, sizeof(record));
+}
+
+static inline size_t
+alignUp(size_t size)
+{
+    return (size + BLOB_ALIGN - 1) & ~(size_t)(BLOB_ALIGN - 1);
+}
+
+int
+pkgWriteBlob(
+    Pkg_Package *const *packages,
+    size_t count,
+    const BlobPart *extras,
+    size_t extra_count,
+    void **data,
+    size_t *size)
+{
+    BlobWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    bufferInit(&writer.strings, 4096);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        putPackage(&writer, packages[i]);
+    }
+
+    BlobPart parts[BLOB_SECTION_COUNT] = {
+        { SECTION_PACKAGES, writer.packages.items,
+          writer.packages.count, sizeof(Pkg_BlobPackage) },
+        { SECTION_DEPENDENCIES, writer.dependencies.items,
+          writer.dependencies.count, sizeof(Pkg_BlobDependency) },
+        { SECTION_PERSONS, writer.persons.items,
+          writer.persons.count, sizeof(Pkg_BlobPerson) },
+        { SECTION_LICENSES, writer.licenses.items,
+          writer.licenses.count, sizeof(uint32_t) },
+        { SECTION_URLS, writer.urls.items,
+          writer.urls.count, sizeof(Pkg_BlobURL) },
+        { SECTION_STRINGS, writer.strings.data, writer.strings.size, 1 }
+    };
+    size_t part_count = BLOB_SECTION_COUNT + extra_count;
+    BlobSection *sections = (BlobSection *)calloc(
+        part_count, sizeof(BlobSection));
+    assert(sections);
+    size_t offset = sizeof(BlobHeader) + part_count * sizeof(BlobSection);
+    for (size_t i = 0; i < part_count; ++i)
+    {
+        const BlobPart *part = i < BLOB_SECTION_COUNT ? \
+            &parts[i] : &extras[i - BLOB_SECTION_COUNT];
+        offset = alignUp(offset);
+        sections[i].id = part->id;
+        sections[i].count = checkedU32(&writer, part->count);
+        sections[i].offset = offset;
+        sections[i].size = part->count * part->item_size;
+        offset += sections[i].size;
+    }
+
+    int ret = 0;
+    if (writer.overflow)
+    {
+        fprintf(stderr, "Too many packages to fit into a blob\n");
+        ret = 1;
+    }
+    else
+    {
+        /* Zeroed, so that the padding between sections is deterministic */
+        unsigned char *blob = (unsigned char *)calloc(1, offset);
+        assert(blob);
+        BlobHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, BLOB_MAGIC, BLOB_MAGIC_SIZE);
+        header.version = PKG_BLOB_VERSION;
+        header.byte_order = BLOB_BYTE_ORDER;
+        header.size = offset;
+        header.section_count = (uint32_t)part_count;
+        memcpy(blob, &header, sizeof(header));
+        memcpy(blob + sizeof(header), sections,
+               part_count * sizeof(BlobSection));
+        for (size_t i = 0; i < part_count; ++i)
+        {
+            const BlobPart *part = i < BLOB_SECTION_COUNT ? \
+                &parts[i] : &extras[i - BLOB_SECTION_COUNT];
+            if (sections[i].size)
+            {
+                memcpy(blob + sections[i].offset, part->items,
+                       sections[i].size);
+            }
+        }
+        *data = blob;
+        *size = offset;
+    }
+
+    free(sections);
+    if (writer.packages.items) free(writer.packages.items);
+    if (writer.dependencies.items) free(writer.dependencies.items);
+    if (writer.persons.items) free(writer.persons.items);
+    if (writer.licenses.items) free(writer.licenses.items);
+    if (writer.urls.items) free(writer.urls.items);
+    if (writer.slots) free(writer.slots);
+    free(writer.strings.data);
+    return ret;
+}
+
+int
+Pkg_WriteBlob(
+    Pkg_Package *const *packages,
+    size_t count,
+    void **data,
+    size_t *size)
+{
+    return pkgWriteBlob(packages, count, NULL, 0, data, size);
+}
+
+/* Pkg_Blob Functions */
+static void
+clearBlob(Pkg_Blob *blob)
+{
+    memset(blob, 0, sizeof(Pkg_Blob));
+}
+
+Pkg_Blob *
+Pkg_InitBlob()
+{
+    Pkg_Blob *blob = (Pkg_Blob *)malloc(sizeof(Pkg_Blob));
+    assert(blob);
+    clearBlob(blob);
+    return blob;
+}
+
+void
+Pkg_FreeBlob(Pkg_Blob *blob)
+{
+    free(blob);
+}
+
+/*
+ * Points items at the section if it is in bounds and holds count items of
+ * item_size bytes, returns 1 otherwise
+ */
+static int
+openSection(
+    const Pkg_Blob *blob,
+    const BlobSection *section,
+    size_t item_size,
+    const void **items,
+    size_t *count)
+{
+    if (section->offset % BLOB_ALIGN ||
+        section->offset > blob->size ||
+        section->size > blob->size - section->offset ||
+        section->size != (uint64_t)section->count * item_size)
+    {
+        return 1;
+    }
+    *items = (const unsigned char *)blob->data + section->offset;
+    *count = section->count;
+    return 0;
+}
+
+int
+Pkg_OpenBlob(Pkg_Blob *blob, const void *data, size_t size)
+{
+    clearBlob(blob);
+    blob->data = data;
+    blob->size = size;
+
+    BlobHeader header;
+    int valid = size >= sizeof(header) && 0 == (uintptr_t)data % BLOB_ALIGN;
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        valid = 0 == memcmp(header.magic, BLOB_MAGIC, BLOB_MAGIC_SIZE) &&
+                PKG_BLOB_VERSION == header.version &&
+                BLOB_BYTE_ORDER == header.byte_order &&
+                header.size == size &&
+                header.section_count <= \
+                    (size - sizeof(header)) / sizeof(BlobSection);
+    }
+
+    const BlobSection *sections = (const BlobSection *)(
+        (const unsigned char *)data + sizeof(header));
+    for (uint32_t i = 0; valid && i < header.section_count; ++i)
+    {
+        const BlobSection *section = &sections[i];
+        const void **items = NULL;
+        size_t *count = NULL;
+        size_t item_size = 1;
+        switch (section->id)
+        {
+            case SECTION_PACKAGES:
+                items = (const void **)&blob->packages;
+                count = &blob->package_count;
+                item_size = sizeof(Pkg_BlobPackage);
+                break;
+            case SECTION_DEPENDENCIES:
+                items = (const void **)&blob->dependencies;
+                count = &blob->dependency_count;
+                item_size = sizeof(Pkg_BlobDependency);
+                break;
+            case SECTION_PERSONS:
+                items = (const void **)&blob->persons;
+                count = &blob->person_count;
+                item_size = sizeof(Pkg_BlobPerson);
+                break;
+            case SECTION_LICENSES:
+                items = (const void **)&blob->licenses;
+                count = &blob->license_count;
+                item_size = sizeof(uint32_t);
+                break;
+            case SECTION_URLS:
+                items = (const void **)&blob->urls;
+                count = &blob->url_count;
+                item_size = sizeof(Pkg_BlobURL);
+                break;
+            case SECTION_STRINGS:
+                items = (const void **)&blob->strings;
+                count = &blob->strings_size;
+                break;
+            default:
+                /* Written by a newer version, not needed to read this one */
+                continue;
+        }
+        valid = 0 == openSection(blob, section, item_size, items, count);
+    }
+
+    /* Strings are read up to their terminator, the last one must have one */
+    valid = valid && (0 == blob->strings_size ||
+                      '\0' == blob->strings[blob->strings_size - 1]);
+    if (!valid)
+    {
+        clearBlob(blob);
+        fprintf(stderr, "Invalid package blob\n");
+        return 1;
+    }
+    return 0;
+}
+
+int
+pkgBlobFindSection(
+    const Pkg_Blob *blob,
+    BlobSectionId id,
+    size_t item_size,
+    const void **items,
+    size_t *count)
+{
+    *items = NULL;
+    *count = 0;
+    if (!blob->data) return 1;
+    BlobHeader header;
+    memcpy(&header, blob->data, sizeof(header));
+    const BlobSection *sections = (const BlobSection *)(
+        (const unsigned char *)blob->data + sizeof(header));
+    for (uint32_t i = 0; i < header.section_count; ++i)
+    {
+        if ((uint32_t)id == sections[i].id)
+        {
+            return openSection(blob, &sections[i], item_size, items, count);
+        }
+    }
+    return 1;
+}
+
+const char *
+Pkg_BlobGetString(const Pkg_Blob *blob, uint32_t offset)
+{
+    if (offset >= blob->strings_size) return NULL;
+    return blob->strings + offset;
+}
+
+/*
+ * Returns the range [first, first + count) of an array of size items, NULL
+ * if it is empty or out of bounds
+ */
+static inline const void *
+getRange(
+    const void *items,
+    size_t size,
+    size_t item_size,
+    size_t first,
+    size_t count)
+{
+    if (!count || first > size || count > size - first) return NULL;
+    return (const unsigned char *)items + first * item_size;
+}
+
+const Pkg_BlobDependency *
+Pkg_BlobGetDependencies(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    Pkg_DependencyType type,
+    size_t *count)
+{
+    size_t first = pkg->dependencies;
+    for (int i = 0; i < (int)type; ++i)
+    {
+        first += pkg->dependency_counts[i];
+    }
+    *count = pkg->dependency_counts[type];
+    const void *deps = getRange(blob->dependencies, blob->dependency_count,
+                                sizeof(Pkg_BlobDependency), first, *count);
+    if (!deps) *count = 0;
+    return (const Pkg_BlobDependency *)deps;
+}
+
+const Pkg_BlobPerson *
+Pkg_BlobGetMaintainers(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count)
+{
+    *count = pkg->maintainer_count;
+    const void *persons = getRange(blob->persons, blob->person_count,
+                                   sizeof(Pkg_BlobPerson),
+                                   pkg->persons, *count);
+    if (!persons) *count = 0;
+    return (const Pkg_BlobPerson *)persons;
+}
+
+const Pkg_BlobPerson *
+Pkg_BlobGetAuthors(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count)
+{
+    /* The authors follow the maintainers */
+    size_t first = (size_t)pkg->persons + pkg->maintainer_count;
+    *count = pkg->author_count;
+    const void *persons = getRange(blob->persons, blob->person_count,
+                                   sizeof(Pkg_BlobPerson), first, *count);
+    if (!persons) *count = 0;
+    return (const Pkg_BlobPerson *)persons;
+}
+
+const uint32_t *
+Pkg_BlobGetLicenses(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count)
+{
+    *count = pkg->license_count;
+    const void *licenses = getRange(blob->licenses, blob->license_count,
+                                    sizeof(uint32_t),
+                                    pkg->licenses, *count);
+    if (!licenses) *count = 0;
+    return (const uint32_t *)licenses;
+}
+
+const Pkg_BlobURL *
+Pkg_BlobGetURLs(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPackage *pkg,
+    size_t *count)
+{
+    *count = pkg->url_count;
+    const void *urls = getRange(blob->urls, blob->url_count,
+                                sizeof(Pkg_BlobURL), pkg->urls, *count);
+    if (!urls) *count = 0;
+    return (const Pkg_BlobURL *)urls;
+}
+
+/*
+ * Copies a string of the blob into pkg, interning names if pkg does, sets
+ * *error if the offset is invalid
+ */
+static char *
+loadString(
+    const Pkg_Blob *blob,
+    uint32_t offset,
+    Pkg_Package *pkg,
+    int is_name,
+    int *error)
+{
+    const char *str = Pkg_BlobGetString(blob, offset);
+    if (!str)
+    {
+        if (PKG_BLOB_NULL != offset) *error = 1;
+        return NULL;
+    }
+    if (is_name && pkg->names) return (char *)Pkg_Intern(pkg->names, str);
+    char *copy = pkgStrdup(pkg, str);
+    assert(copy);
+    return copy;
+}
+
+static Pkg_PersonList *
+loadPersons(
+    const Pkg_Blob *blob,
+    const Pkg_BlobPerson *persons,
+    size_t count,
+    Pkg_Package *pkg,
+    int *error)
+{
+    if (!count) return NULL;
+    Pkg_PersonList *list = (Pkg_PersonList *)pkgAlloc(
+        pkg, count * sizeof(Pkg_PersonList));
+    for (size_t i = 0; i < count; ++i)
+    {
+        initPersonList(&list[i]);
+        list[i].name = loadString(blob, persons[i].name, pkg, 0, error);
+        list[i].email = loadString(blob, persons[i].email, pkg, 0, error);
+    }
+    chainList(list, count, sizeof(Pkg_PersonList),
+              offsetof(Pkg_PersonList, next));
+    return list;
+}
+
+int
+Pkg_BlobLoadPackage(const Pkg_Blob *blob, size_t index, Pkg_Package *pkg)
+{
+    if (index >= blob->package_count) return 1;
+    const Pkg_BlobPackage *record = &blob->packages[index];
+    int error = 0;
+
+    pkg->fields = record->fields;
+    pkg->package_format = record->package_format;
+    pkg->filename = loadString(blob, record->filename, pkg, 0, &error);
+    pkg->name = loadString(blob, record->name, pkg, 1, &error);
+    Pkg_UnpackVersion(record->version, &pkg->version);
+    Pkg_UnpackVersion(record->abi_version, &pkg->abi_version);
+    pkg->description = loadString(blob, record->description, pkg, 0, &error);
+
+    size_t count;
+    const Pkg_BlobPerson *persons = \
+        Pkg_BlobGetMaintainers(blob, record, &count);
+    error |= count != record->maintainer_count;
+    pkg->maintainers = loadPersons(blob, persons, count, pkg, &error);
+    pkg->maintainer_count = count;
+    persons = Pkg_BlobGetAuthors(blob, record, &count);
+    error |= count != record->author_count;
+    pkg->authors = loadPersons(blob, persons, count, pkg, &error);
+    pkg->author_count = count;
+
+    const uint32_t *licenses = Pkg_BlobGetLicenses(blob, record, &count);
+    error |= count != record->license_count;
+    if (count)
+    {
+        pkg->licenses = (Pkg_LicenseList *)pkgAlloc(
+            pkg, count * sizeof(Pkg_LicenseList));
+        for (size_t i = 0; i < count; ++i)
+        {
+            initLicenseList(&pkg->licenses[i]);
+            pkg->licenses[i].license = loadString(
+                blob, licenses[i], pkg, 0, &error);
+        }
+        chainList(pkg->licenses, count, sizeof(Pkg_LicenseList),
+                  offsetof(Pkg_LicenseList, next));
+    }
+    pkg->license_count = count;
+
+    const Pkg_BlobURL *urls = Pkg_BlobGetURLs(blob, record, &count);
+    error |= count != record->url_count;
+    if (count)
+    {
+        pkg->urls = (Pkg_URLList *)pkgAlloc(pkg, count * sizeof(Pkg_URLList));
+        for (size_t i = 0; i < count; ++i)
+        {
+            initURLList(&pkg->urls[i]);
+            pkg->urls[i].url = loadString(blob, urls[i].url, pkg, 0, &error);
+            pkg->urls[i].type = (Pkg_URLType)urls[i].type;
+        }
+        chainList(pkg->urls, count, sizeof(Pkg_URLList),
+                  offsetof(Pkg_URLList, next));
+    }
+    pkg->url_count = count;
+
+    Pkg_DependencyList **lists[PKG_DEPEND_TYPE_COUNT] = {
+        &pkg->buildtool_depends,
+        &pkg->build_depends,
+        &pkg->run_depends,
+        &pkg->test_depends
+    };
+    size_t *counts[PKG_DEPEND_TYPE_COUNT] = {
+        &pkg->buildtool_depend_count,
+        &pkg->build_depend_count,
+        &pkg->run_depend_count,
+        &pkg->test_depend_count
+    };
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        const Pkg_BlobDependency *deps = Pkg_BlobGetDependencies(
+            blob, record, (Pkg_DependencyType)type, &count);
+        error |= count != record->dependency_counts[type];
+        *counts[type] = count;
+        if (!count) continue;
+        Pkg_DependencyList *list = (Pkg_DependencyList *)pkgAlloc(
+            pkg, count * sizeof(Pkg_DependencyList));
+        for (size_t i = 0; i < count; ++i)
+        {
+            initDependencyList(&list[i]);
+            list[i].name = loadString(blob, deps[i].name, pkg, 1, &error);
+            list[i].constraints = deps[i].constraints;
+            memcpy(list[i].version_keys, deps[i].version_keys,
+                   sizeof(list[i].version_keys));
+        }
+        chainList(list, count, sizeof(Pkg_DependencyList),
+                  offsetof(Pkg_DependencyList, next));
+        *lists[type] = list;
+    }
+
+    pkg->exports = loadString(blob, record->exports, pkg, 0, &error);
+    pkg->exports_offset = (size_t)record->exports_offset;
+    pkg->exports_size = (size_t)record->exports_size;
+    pkg->content_hash = record->content_hash;
+    pkg->semantic_hash = record->semantic_hash;
+    return error;
+}
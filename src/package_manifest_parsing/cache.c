@@ -0,0 +1,823 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/cache.h>
+#include <package_manifest_parsing/pkg.h>
+
+#include "hash.h"
+#include "internal.h"
+
+/* Cache files start with the magic, the version and a byte order mark,
+ * followed by the number of entries and the entries themselves:
+ *
+ *     u32 path length, path, i64 mtime seconds, i64 mtime nanoseconds,
+ *     u64 size, u64 content hash, u32 record size, record
+ *
+ * Records hold the package, see encodePackage. Integers are in host byte
+ * order, a cache file is not meant to be moved between machines.
+ */
+#define CACHE_MAGIC "PKGCACHE"
+#define CACHE_MAGIC_SIZE 8
+#define CACHE_VERSION 5
+#define CACHE_BYTE_ORDER 0x01020304u
+
+/* Marks a NULL string in a record */
+#define CACHE_NULL_STRING 0xffffffffu
+
+/* An encoded package, see encodePackage
+ *
+ * Records never change once made. Lookups decode them outside the lock, so
+ * each holds a reference, as does the entry, and the last one frees it.
+ */
+typedef struct CacheRecord
+{
+    size_t refs;
+    size_t size;
+    unsigned char data[];
+} CacheRecord;
+
+typedef struct CacheEntry
+{
+    char *path;
+    /* stat of the manifest when it was parsed */
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+    /* pkgFastHash of the manifest's contents, its content_hash */
+    uint64_t hash;
+    /* the encoded package */
+    CacheRecord *record;
+    /* set once the entry was looked up or added, only those are saved */
+    int used;
+} CacheEntry;
+
+struct Pkg_Cache
+{
+    /* guards everything below */
+    pthread_mutex_t lock;
+    CacheEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    /* open addressing index of entries by path, SIZE_MAX if empty */
+    size_t *slots;
+    size_t slot_capacity;
+    int verify_content;
+    size_t hits;
+    size_t misses;
+};
+
+/*
+ * Returns a record holding a copy of data, with the reference of its entry
+ */
+static CacheRecord *
+newRecord(const void *data, size_t size)
+{
+    CacheRecord *record = (CacheRecord *)malloc(sizeof(CacheRecord) + size);
+    assert(record);
+    record->refs = 1;
+    record->size = size;
+    memcpy(record->data, data, size);
+    return record;
+}
+
+/*
+ * Drops a reference to record, must be called with the lock held
+ */
+static void
+releaseRecord(CacheRecord *record)
+{
+    if (record && 0 == --record->refs) free(record);
+}
+
+/* Pkg_Cache Functions */
+Pkg_Cache *
+Pkg_InitCache()
+{
+    Pkg_Cache *cache = (Pkg_Cache *)malloc(sizeof(Pkg_Cache));
+    assert(cache);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->entries = NULL;
+    cache->entry_count = 0;
+    cache->entry_capacity = 0;
+    cache->slots = NULL;
+    cache->slot_capacity = 0;
+    cache->verify_content = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    return cache;
+}
+
+static void
+clearEntries(Pkg_Cache *cache)
+{
+    for (size_t i = 0; i < cache->entry_count; ++i)
+    {
+        free(cache->entries[i].path);
+        releaseRecord(cache->entries[i].record);
+    }
+    cache->entry_count = 0;
+    for (size_t i = 0; i < cache->slot_capacity; ++i)
+    {
+        cache->slots[i] = SIZE_MAX;
+    }
+}
+
+void
+Pkg_FreeCache(Pkg_Cache *cache)
+{
+    clearEntries(cache);
+    if (cache->entries) free(cache->entries);
+    if (cache->slots) free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+void
+Pkg_CacheSetVerifyContent(Pkg_Cache *cache, int verify)
+{
+    cache->verify_content = verify;
+}
+
+void
+Pkg_CacheGetStats(Pkg_Cache *cache, size_t *hits, size_t *misses)
+{
+    pthread_mutex_lock(&cache->lock);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Returns the slot of path in the index, which is empty if not cached
+ */
+static size_t *
+findSlot(Pkg_Cache *cache, const char *path)
+{
+    size_t mask = cache->slot_capacity - 1;
+    size_t index = (size_t)pkgHash(path, strlen(path)) & mask;
+    for (;;)
+    {
+        size_t *slot = &cache->slots[index];
+        if (SIZE_MAX == *slot) return slot;
+        if (0 == strcmp(cache->entries[*slot].path, path)) return slot;
+        index = (index + 1) & mask;
+    }
+}
+
+static CacheEntry *
+findEntry(Pkg_Cache *cache, const char *path)
+{
+    if (!cache->slot_capacity) return NULL;
+    size_t entry = *findSlot(cache, path);
+    return SIZE_MAX == entry ? NULL : &cache->entries[entry];
+}
+
+/*
+ * Adds an entry for path, or returns the existing one, to be filled in
+ */
+static CacheEntry *
+addEntry(Pkg_Cache *cache, const char *path)
+{
+    CacheEntry *existing = findEntry(cache, path);
+    if (existing)
+    {
+        releaseRecord(existing->record);
+        existing->record = NULL;
+        return existing;
+    }
+
+    /* Keep the index at most half full */
+    if (2 * (cache->entry_count + 1) > cache->slot_capacity)
+    {
+        if (cache->slots) free(cache->slots);
+        cache->slot_capacity = cache->slot_capacity ? \
+            cache->slot_capacity * 2 : 256;
+        cache->slots = (size_t *)malloc(cache->slot_capacity * sizeof(size_t));
+        assert(cache->slots);
+        for (size_t i = 0; i < cache->slot_capacity; ++i)
+        {
+            cache->slots[i] = SIZE_MAX;
+        }
+        for (size_t i = 0; i < cache->entry_count; ++i)
+        {
+            *findSlot(cache, cache->entries[i].path) = i;
+        }
+    }
+    if (cache->entry_count == cache->entry_capacity)
+    {
+        cache->entry_capacity = cache->entry_capacity ? \
+            cache->entry_capacity * 2 : 256;
+        cache->entries = (CacheEntry *)realloc(
+            cache->entries, cache->entry_capacity * sizeof(CacheEntry));
+        assert(cache->entries);
+    }
+    CacheEntry *entry = &cache->entries[cache->entry_count];
+    *findSlot(cache, path) = cache->entry_count++;
+    entry->path = strdup(path);
+    assert(entry->path);
+    entry->record = NULL;
+    entry->used = 0;
+    return entry;
+}
+
+static inline void
+putU32(Buffer *buffer, uint32_t value)
+{
+    bufferAppend(buffer, (const char *)&value, sizeof(value));
+}
+
+static inline void
+putU64(Buffer *buffer, uint64_t value)
+{
+    bufferAppend(buffer, (const char *)&value, sizeof(value));
+}
+
+static inline void
+putString(Buffer *buffer, const char *str)
+{
+    if (!str)
+    {
+        putU32(buffer, CACHE_NULL_STRING);
+        return;
+    }
+    size_t len = strlen(str);
+    putU32(buffer, (uint32_t)len);
+    bufferAppend(buffer, str, len);
+}
+
+static void
+putPersons(Buffer *buffer, const Pkg_PersonList *persons, size_t count)
+{
+    putU32(buffer, (uint32_t)count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        putString(buffer, persons[i].name);
+        putString(buffer, persons[i].email);
+    }
+}
+
+static void
+putDependencies(Buffer *buffer, const Pkg_DependencyList *deps, size_t count)
+{
+    putU32(buffer, (uint32_t)count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        putString(buffer, deps[i].name);
+        putU32(buffer, deps[i].constraints);
+        for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+        {
+            if (!(deps[i].constraints & PKG_CONSTRAINT_BIT(c))) continue;
+            putU64(buffer, deps[i].version_keys[c]);
+        }
+    }
+}
+
+static inline void
+putVersion(Buffer *buffer, const Pkg_Version *version)
+{
+    putU32(buffer, version->major);
+    putU32(buffer, version->minor);
+    putU32(buffer, version->patch);
+}
+
+/*
+ * Appends the record of pkg, everything but its filename which is the key
+ */
+static void
+encodePackage(Buffer *buffer, const Pkg_Package *pkg)
+{
+    putU32(buffer, pkg->fields);
+    putU32(buffer, pkg->package_format);
+    putString(buffer, pkg->name);
+    putVersion(buffer, &pkg->version);
+    putVersion(buffer, &pkg->abi_version);
+    putString(buffer, pkg->description);
+    putPersons(buffer, pkg->maintainers, pkg->maintainer_count);
+    putU32(buffer, (uint32_t)pkg->license_count);
+    for (size_t i = 0; i < pkg->license_count; ++i)
+    {
+        putString(buffer, pkg->licenses[i].license);
+    }
+    putU32(buffer, (uint32_t)pkg->url_count);
+    for (size_t i = 0; i < pkg->url_count; ++i)
+    {
+        putString(buffer, pkg->urls[i].url);
+        putU32(buffer, (uint32_t)pkg->urls[i].type);
+    }
+    putPersons(buffer, pkg->authors, pkg->author_count);
+    putDependencies(buffer, pkg->buildtool_depends,
+                    pkg->buildtool_depend_count);
+    putDependencies(buffer, pkg->build_depends, pkg->build_depend_count);
+    putDependencies(buffer, pkg->run_depends, pkg->run_depend_count);
+    putDependencies(buffer, pkg->test_depends, pkg->test_depend_count);
+    putString(buffer, pkg->exports);
+    putU64(buffer, pkg->exports_offset);
+    putU64(buffer, pkg->exports_size);
+    putU64(buffer, pkg->content_hash);
+    putU64(buffer, pkg->semantic_hash);
+}
+
+/* Bounds checked cursor over a record or cache file */
+typedef struct Reader
+{
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    /* set once a read ran past the end, every later read returns zeros */
+    int error;
+} Reader;
+
+static inline const unsigned char *
+getBytes(Reader *reader, size_t len)
+{
+    if (reader->error || len > reader->size - reader->pos)
+    {
+        reader->error = 1;
+        return NULL;
+    }
+    const unsigned char *bytes = reader->data + reader->pos;
+    reader->pos += len;
+    return bytes;
+}
+
+static inline uint32_t
+getU32(Reader *reader)
+{
+    uint32_t value = 0;
+    const unsigned char *bytes = getBytes(reader, sizeof(value));
+    if (bytes) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static inline uint64_t
+getU64(Reader *reader)
+{
+    uint64_t value = 0;
+    const unsigned char *bytes = getBytes(reader, sizeof(value));
+    if (bytes) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/*
+ * Reads a string into memory owned by pkg, interned if name is set and the
+ * package interns its names
+ */
+static char *
+getString(Reader *reader, Pkg_Package *pkg, int name)
+{
+    uint32_t len = getU32(reader);
+    if (CACHE_NULL_STRING == len) return NULL;
+    const char *str = (const char *)getBytes(reader, len);
+    if (!str) return NULL;
+    if (name && pkg->names) return (char *)Pkg_InternN(pkg->names, str, len);
+    return pkgStrndup(pkg, str, len);
+}
+
+/*
+ * Reads a list length and allocates the list, every entry needs at least
+ * min_size bytes of the record which bounds the allocation
+ */
+static void *
+getList(
+    Reader *reader,
+    Pkg_Package *pkg,
+    size_t item_size,
+    size_t min_size,
+    size_t *count)
+{
+    *count = 0;
+    uint32_t len = getU32(reader);
+    if (!len || reader->error) return NULL;
+    if (len > (reader->size - reader->pos) / min_size)
+    {
+        reader->error = 1;
+        return NULL;
+    }
+    *count = len;
+    return pkgAlloc(pkg, len * item_size);
+}
+
+static Pkg_PersonList *
+getPersons(Reader *reader, Pkg_Package *pkg, size_t *count)
+{
+    Pkg_PersonList *persons = (Pkg_PersonList *)getList(
+        reader, pkg, sizeof(Pkg_PersonList), 8, count);
+    for (size_t i = 0; i < *count; ++i)
+    {
+        initPersonList(&persons[i]);
+        persons[i].name = getString(reader, pkg, 0);
+        persons[i].email = getString(reader, pkg, 0);
+    }
+    chainList(persons, *count, sizeof(Pkg_PersonList),
+              offsetof(Pkg_PersonList, next));
+    return persons;
+}
+
+static Pkg_DependencyList *
+getDependencies(Reader *reader, Pkg_Package *pkg, size_t *count)
+{
+    Pkg_DependencyList *deps = (Pkg_DependencyList *)getList(
+        reader, pkg, sizeof(Pkg_DependencyList), 8, count);
+    for (size_t i = 0; i < *count; ++i)
+    {
+        initDependencyList(&deps[i]);
+        deps[i].name = getString(reader, pkg, 1);
+        deps[i].constraints = getU32(reader);
+        for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+        {
+            if (!(deps[i].constraints & PKG_CONSTRAINT_BIT(c))) continue;
+            deps[i].version_keys[c] = getU64(reader);
+        }
+    }
+    chainList(deps, *count, sizeof(Pkg_DependencyList),
+              offsetof(Pkg_DependencyList, next));
+    return deps;
+}
+
+static inline void
+getVersion(Reader *reader, Pkg_Version *version)
+{
+    version->major = getU32(reader);
+    version->minor = getU32(reader);
+    version->patch = getU32(reader);
+}
+
+/*
+ * Fills pkg from a record, returns 1 if the record is corrupt
+ */
+static int
+decodePackage(Reader *reader, Pkg_Package *pkg)
+{
+    pkg->fields = getU32(reader);
+    pkg->package_format = getU32(reader);
+    pkg->name = getString(reader, pkg, 1);
+    getVersion(reader, &pkg->version);
+    getVersion(reader, &pkg->abi_version);
+    pkg->description = getString(reader, pkg, 0);
+    pkg->maintainers = getPersons(reader, pkg, &pkg->maintainer_count);
+    pkg->licenses = (Pkg_LicenseList *)getList(
+        reader, pkg, sizeof(Pkg_LicenseList), 4, &pkg->license_count);
+    for (size_t i = 0; i < pkg->license_count; ++i)
+    {
+        initLicenseList(&pkg->licenses[i]);
+        pkg->licenses[i].license = getString(reader, pkg, 0);
+    }
+    chainList(pkg->licenses, pkg->license_count, sizeof(Pkg_LicenseList),
+              offsetof(Pkg_LicenseList, next));
+    pkg->urls = (Pkg_URLList *)getList(
+        reader, pkg, sizeof(Pkg_URLList), 8, &pkg->url_count);
+    for (size_t i = 0; i < pkg->url_count; ++i)
+    {
+        initURLList(&pkg->urls[i]);
+        pkg->urls[i].url = getString(reader, pkg, 0);
+        pkg->urls[i].type = (Pkg_URLType)getU32(reader);
+    }
+    chainList(pkg->urls, pkg->url_count, sizeof(Pkg_URLList),
+              offsetof(Pkg_URLList, next));
+    pkg->authors = getPersons(reader, pkg, &pkg->author_count);
+    pkg->buildtool_depends = getDependencies(
+        reader, pkg, &pkg->buildtool_depend_count);
+    pkg->build_depends = getDependencies(
+        reader, pkg, &pkg->build_depend_count);
+    pkg->run_depends = getDependencies(reader, pkg, &pkg->run_depend_count);
+    pkg->test_depends = getDependencies(
+        reader, pkg, &pkg->test_depend_count);
+    pkg->exports = getString(reader, pkg, 0);
+    pkg->exports_offset = (size_t)getU64(reader);
+    pkg->exports_size = (size_t)getU64(reader);
+    pkg->content_hash = getU64(reader);
+    pkg->semantic_hash = getU64(reader);
+    return reader->error || reader->pos != reader->size;
+}
+
+static inline int
+statMatches(const CacheEntry *entry, const struct stat *st)
+{
+    return entry->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           entry->mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           entry->size == (uint64_t)st->st_size;
+}
+
+/*
+ * Returns the PKG_FIELD_'s a record holds, they are its first member
+ */
+static inline unsigned int
+recordFields(const CacheEntry *entry)
+{
+    if (entry->record->size < 4) return 0;
+    uint32_t fields;
+    memcpy(&fields, entry->record->data, 4);
+    return fields;
+}
+
+/*
+ * Returns a reference to the record of path if it matches st and, unless
+ * hash is NULL, the content hash, and holds every field asked for, must be
+ * called with the lock held
+ */
+static CacheRecord *
+findRecordLocked(
+    Pkg_Cache *cache,
+    const char *path,
+    const struct stat *st,
+    const uint64_t *hash,
+    unsigned int fields)
+{
+    CacheEntry *entry = findEntry(cache, path);
+    if (!entry || !entry->record || !statMatches(entry, st)) return NULL;
+    if (hash && entry->hash != *hash) return NULL;
+    if (fields & ~recordFields(entry)) return NULL;
+    entry->record->refs++;
+    return entry->record;
+}
+
+/*
+ * Fills pkg from the cached record of path, see findRecordLocked
+ *
+ * Only finding the record takes the lock, it is decoded outside of it, so
+ * threads which hit the cache do not wait for each other's decoding.
+ */
+static int
+lookup(
+    Pkg_Cache *cache,
+    const char *path,
+    const struct stat *st,
+    const uint64_t *hash,
+    unsigned int fields,
+    Pkg_Package *pkg)
+{
+    pthread_mutex_lock(&cache->lock);
+    CacheRecord *record = findRecordLocked(cache, path, st, hash, fields);
+    pthread_mutex_unlock(&cache->lock);
+    if (!record) return 0;
+
+    Pkg_InternTable *cache_names = pkg->names;
+    Reader reader;
+    reader.data = record->data;
+    reader.size = record->size;
+    reader.pos = 0;
+    reader.error = 0;
+    pkg->filename = pkgStrdup(pkg, path);
+    assert(pkg->filename);
+    int hit = !decodePackage(&reader, pkg);
+    if (!hit)
+    {
+        /* Only possible for a corrupt cache file, parse the manifest again */
+        pkgResetPackage(pkg);
+        pkg->names = cache_names;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (hit)
+    {
+        /* Unless the entry got a new record meanwhile */
+        CacheEntry *entry = findEntry(cache, path);
+        if (entry && entry->record == record) entry->used = 1;
+        cache->hits++;
+    }
+    releaseRecord(record);
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+int
+pkgCacheLookup(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    const struct stat *st,
+    Pkg_Package *pkg)
+{
+    pkg->names = parser->names;
+    if (cache->verify_content) return 0;
+    return lookup(cache, path, st, NULL, parser->fields, pkg);
+}
+
+int
+pkgCacheIsFresh(
+    Pkg_Cache *cache,
+    const char *path,
+    const struct stat *st,
+    unsigned int fields)
+{
+    if (cache->verify_content) return 0;
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = findEntry(cache, path);
+    int fresh = entry && entry->record && statMatches(entry, st) &&
+                0 == (fields & ~recordFields(entry));
+    pthread_mutex_unlock(&cache->lock);
+    return fresh;
+}
+
+int
+pkgCacheParseBuffer(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    const struct stat *st,
+    const char *data,
+    size_t size,
+    Pkg_Package *pkg)
+{
+    pkg->names = parser->names;
+
+    if (cache->verify_content)
+    {
+        /* A miss keeps the content_hash parsing computes, so the contents
+         * are only hashed up front for this lookup */
+        uint64_t hash = pkgFastHash(data, size);
+        if (lookup(cache, path, st, &hash, parser->fields, pkg)) return 0;
+    }
+
+    int ret = Pkg_ParserParsePackageManifestFromBuffer(
+        parser, data, size, path, pkg);
+
+    CacheRecord *record = NULL;
+    if (!ret)
+    {
+        Buffer buffer;
+        bufferInit(&buffer, 1024);
+        encodePackage(&buffer, pkg);
+        record = newRecord(buffer.data, buffer.size);
+        free(buffer.data);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->misses++;
+    if (!ret)
+    {
+        CacheEntry *entry = addEntry(cache, path);
+        entry->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+        entry->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+        entry->size = (uint64_t)st->st_size;
+        entry->hash = pkg->content_hash;
+        entry->record = record;
+        entry->used = 1;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+int
+Pkg_CacheParsePackageManifest(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    /* Assert a path */
+    assert(path);
+
+    pkg->names = parser->names;
+
+    struct stat st;
+    if (0 != stat(path, &st))
+    {
+        /* Let the parser report the error */
+        return Pkg_ParserParsePackageManifest(parser, path, pkg);
+    }
+    if (pkgCacheLookup(cache, parser, path, &st, pkg)) return 0;
+
+    /* Read the manifest once, it is hashed and parsed from memory */
+    size_t size;
+    char *data = pkgReadFile(path, &st, &size);
+    if (!data)
+    {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        return 1;
+    }
+    int ret = pkgCacheParseBuffer(cache, parser, path, &st, data, size, pkg);
+    free(data);
+    return ret;
+}
+
+int
+Pkg_LoadCache(Pkg_Cache *cache, const char *path)
+{
+    struct stat st;
+    size_t size;
+    char *data = pkgReadFile(path, &st, &size);
+    if (!data)
+    {
+        if (ENOENT == errno) return 0;
+        fprintf(stderr, "Failed to read cache file %s\n", path);
+        return 1;
+    }
+
+    Reader reader;
+    reader.data = (const unsigned char *)data;
+    reader.size = size;
+    reader.pos = 0;
+    reader.error = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    clearEntries(cache);
+    const unsigned char *magic = getBytes(&reader, CACHE_MAGIC_SIZE);
+    int valid = magic && 0 == memcmp(magic, CACHE_MAGIC, CACHE_MAGIC_SIZE);
+    valid = valid && CACHE_VERSION == getU32(&reader);
+    valid = valid && CACHE_BYTE_ORDER == getU32(&reader);
+    uint64_t count = valid ? getU64(&reader) : 0;
+    for (uint64_t i = 0; valid && i < count; ++i)
+    {
+        uint32_t path_len = getU32(&reader);
+        const char *entry_path = (const char *)getBytes(&reader, path_len);
+        int64_t mtime_sec = (int64_t)getU64(&reader);
+        int64_t mtime_nsec = (int64_t)getU64(&reader);
+        uint64_t entry_size = getU64(&reader);
+        uint64_t hash = getU64(&reader);
+        uint32_t record_size = getU32(&reader);
+        const unsigned char *record = getBytes(&reader, record_size);
+        if (reader.error) break;
+
+        char *key = strndup(entry_path, path_len);
+        assert(key);
+        CacheEntry *entry = addEntry(cache, key);
+        free(key);
+        entry->mtime_sec = mtime_sec;
+        entry->mtime_nsec = mtime_nsec;
+        entry->size = entry_size;
+        entry->hash = hash;
+        entry->record = newRecord(record, record_size);
+    }
+    valid = valid && !reader.error && reader.pos == reader.size;
+    if (!valid)
+    {
+        clearEntries(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(data);
+
+    if (!valid)
+    {
+        fprintf(stderr, "Ignoring invalid cache file %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+int
+Pkg_SaveCache(Pkg_Cache *cache, const char *path)
+{
+    Buffer buffer;
+    bufferInit(&buffer, 64 * 1024);
+    bufferAppend(&buffer, CACHE_MAGIC, CACHE_MAGIC_SIZE);
+    putU32(&buffer, CACHE_VERSION);
+    putU32(&buffer, CACHE_BYTE_ORDER);
+
+    pthread_mutex_lock(&cache->lock);
+    uint64_t count = 0;
+    for (size_t i = 0; i < cache->entry_count; ++i)
+    {
+        if (cache->entries[i].used && cache->entries[i].record) count++;
+    }
+    putU64(&buffer, count);
+    for (size_t i = 0; i < cache->entry_count; ++i)
+    {
+        const CacheEntry *entry = &cache->entries[i];
+        if (!entry->used || !entry->record) continue;
+        size_t path_len = strlen(entry->path);
+        putU32(&buffer, (uint32_t)path_len);
+        bufferAppend(&buffer, entry->path, path_len);
+        putU64(&buffer, (uint64_t)entry->mtime_sec);
+        putU64(&buffer, (uint64_t)entry->mtime_nsec);
+        putU64(&buffer, entry->size);
+        putU64(&buffer, entry->hash);
+        putU32(&buffer, (uint32_t)entry->record->size);
+        bufferAppend(&buffer, (const char *)entry->record->data,
+                     entry->record->size);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    int ret = pkgWriteFile(path, buffer.data, buffer.size);
+    if (ret)
+    {
+        fprintf(stderr, "Failed to write cache file %s\n", path);
+    }
+    free(buffer.data);
+    return ret;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/workspace.h>
+
+/* Shared, read only state of a check */
+typedef struct Check
+{
+    /* graph without edges, only used for its name index */
+    const Pkg_Graph *graph;
+    /* packed version of every package */
+    const Pkg_VersionKey *keys;
+} Check;
+
+/* Per thread state of a check, covering packages [begin, end) */
+typedef struct Checker
+{
+    pthread_t thread;
+    int started;
+    const Check *check;
+    size_t begin;
+    size_t end;
+    Pkg_ConstraintViolation *violations;
+    size_t violation_count;
+    size_t violation_capacity;
+    size_t checked_count;
+} Checker;
+
+static void
+addViolation(Checker *checker, const Pkg_ConstraintViolation *violation)
+{
+    if (checker->violation_count == checker->violation_capacity)
+    {
+        checker->violation_capacity = checker->violation_capacity ? \
+            checker->violation_capacity * 2 : 16;
+        checker->violations = (Pkg_ConstraintViolation *)realloc(
+            checker->violations,
+            checker->violation_capacity * sizeof(Pkg_ConstraintViolation));
+        assert(checker->violations);
+    }
+    checker->violations[checker->violation_count++] = *violation;
+}
+
+static void *
+checkPackages(void *arg)
+{
+    Checker *checker = (Checker *)arg;
+    const Pkg_Graph *graph = checker->check->graph;
+    for (size_t v = checker->begin; v < checker->end; ++v)
+    {
+        const Pkg_Package *pkg = graph->packages[v];
+        for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+        {
+            size_t count;
+            const Pkg_DependencyList *deps = Pkg_GetDependencies(
+                pkg, (Pkg_DependencyType)type, &count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!deps[i].constraints || !deps[i].name) continue;
+                size_t u = Pkg_GraphFindPackage(graph, deps[i].name);
+                if (PKG_GRAPH_NOT_FOUND == u) continue;
+                checker->checked_count++;
+                unsigned int failed = Pkg_DependencyFailedConstraints(
+                    &deps[i], checker->check->keys[u]);
+                if (!failed) continue;
+                Pkg_ConstraintViolation violation;
+                violation.package = pkg;
+                violation.dependency = &deps[i];
+                violation.type = (Pkg_DependencyType)type;
+                violation.target = graph->packages[u];
+                violation.failed = failed;
+                addViolation(checker, &violation);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Pkg_ConstraintReport Functions */
+Pkg_ConstraintReport *
+Pkg_InitConstraintReport()
+{
+    Pkg_ConstraintReport *report = \
+        (Pkg_ConstraintReport *)malloc(sizeof(Pkg_ConstraintReport));
+    assert(report);
+    report->violations = NULL;
+    report->violation_count = 0;
+    report->checked_count = 0;
+    report->duplicates = NULL;
+    report->duplicate_count = 0;
+    return report;
+}
+
+void
+Pkg_FreeConstraintReport(Pkg_ConstraintReport *report)
+{
+    if (report->violations) free(report->violations);
+    if (report->duplicates) free(report->duplicates);
+    free(report);
+}
+
+int
+Pkg_CheckWorkspaceConstraints(
+    const Pkg_Workspace *ws,
+    unsigned int nthreads,
+    Pkg_ConstraintReport *report)
+{
+    if (report->violations) free(report->violations);
+    report->violations = NULL;
+    report->violation_count = 0;
+    report->checked_count = 0;
+    if (report->duplicates) free(report->duplicates);
+    report->duplicates = NULL;
+    report->duplicate_count = 0;
+
+    size_t count = ws->package_count;
+    Pkg_Graph *graph = Pkg_InitGraph();
+    /* Without edges the only error is a duplicate name */
+    if (Pkg_BuildGraph(graph, ws->packages, count, 0) &&
+        graph->duplicate_count)
+    {
+        report->duplicates = (const Pkg_Package **)malloc(
+            graph->duplicate_count * sizeof(const Pkg_Package *));
+        assert(report->duplicates);
+        for (size_t i = 0; i < graph->duplicate_count; ++i)
+        {
+            report->duplicates[i] = ws->packages[graph->duplicates[i]];
+        }
+        report->duplicate_count = graph->duplicate_count;
+    }
+    Pkg_VersionKey *keys = (Pkg_VersionKey *)malloc(
+        (count ? count : 1) * sizeof(Pkg_VersionKey));
+    assert(keys);
+    for (size_t v = 0; v < count; ++v)
+    {
+        keys[v] = Pkg_PackVersion(&ws->packages[v]->version);
+    }
+    Check check;
+    check.graph = graph;
+    check.keys = keys;
+
+    if (0 == nthreads)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    if (nthreads > count) nthreads = count ? (unsigned int)count : 1;
+
+    Checker *checkers = (Checker *)calloc(nthreads, sizeof(Checker));
+    assert(checkers);
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        checkers[i].check = &check;
+        checkers[i].begin = count * i / nthreads;
+        checkers[i].end = count * (i + 1) / nthreads;
+    }
+    /* The calling thread takes the first share itself */
+    for (unsigned int i = 1; i < nthreads; ++i)
+    {
+        checkers[i].started = 0 == pthread_create(
+            &checkers[i].thread, NULL, checkPackages, &checkers[i]);
+        if (!checkers[i].started) checkPackages(&checkers[i]);
+    }
+    checkPackages(&checkers[0]);
+
+    /* Concatenate in thread order, which is the order of the packages */
+    size_t violation_count = 0;
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        if (checkers[i].started) pthread_join(checkers[i].thread, NULL);
+        violation_count += checkers[i].violation_count;
+        report->checked_count += checkers[i].checked_count;
+    }
+    if (violation_count)
+    {
+        report->violations = (Pkg_ConstraintViolation *)malloc(
+            violation_count * sizeof(Pkg_ConstraintViolation));
+        assert(report->violations);
+    }
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        if (checkers[i].violation_count)
+        {
+            memcpy(report->violations + report->violation_count,
+                   checkers[i].violations,
+                   checkers[i].violation_count *
+                       sizeof(Pkg_ConstraintViolation));
+            report->violation_count += checkers[i].violation_count;
+        }
+        if (checkers[i].violations) free(checkers[i].violations);
+    }
+
+    free(checkers);
+    free(keys);
+    Pkg_FreeGraph(graph);
+    return report->violation_count ? 1 : 0;
+}
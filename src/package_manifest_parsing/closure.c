@@ -0,0 +1,224 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/closure.h>
+#include <package_manifest_parsing/graph.h>
+
+/* Bitsets are padded to whole cache lines, which keeps every closure
+ * aligned and lets the compiler vectorize the word loops without tails */
+#define BITSET_ALIGNMENT 64
+#define BITSET_WORD_MULTIPLE (BITSET_ALIGNMENT / sizeof(uint64_t))
+
+static inline uint64_t *
+allocWords(size_t words)
+{
+    size_t size = words * sizeof(uint64_t);
+    if (!size) size = BITSET_ALIGNMENT;
+    uint64_t *bits = (uint64_t *)aligned_alloc(BITSET_ALIGNMENT, size);
+    assert(bits);
+    memset(bits, 0, size);
+    return bits;
+}
+
+/*
+ * set |= other, over whole bitsets
+ */
+static inline void
+orWords(
+    uint64_t *restrict set,
+    const uint64_t *restrict other,
+    size_t words)
+{
+    for (size_t i = 0; i < words; ++i)
+    {
+        set[i] |= other[i];
+    }
+}
+
+/* Pkg_Closure Functions */
+Pkg_Closure *
+Pkg_InitClosure()
+{
+    Pkg_Closure *closure = (Pkg_Closure *)calloc(1, sizeof(Pkg_Closure));
+    assert(closure);
+    return closure;
+}
+
+void
+Pkg_FreeClosure(Pkg_Closure *closure)
+{
+    if (closure->bits) free(closure->bits);
+    free(closure);
+}
+
+/*
+ * Adds the closure and the vertex of every dependency of v to v's closure,
+ * returns 1 if that changed it
+ */
+static inline int
+mergeDependencies(Pkg_Closure *closure, size_t v, int track_changes)
+{
+    const Pkg_Graph *graph = closure->graph;
+    size_t words = closure->words;
+    uint64_t *row = closure->bits + v * words;
+    int changed = 0;
+    for (size_t e = graph->dependency_offsets[v];
+         e < graph->dependency_offsets[v + 1]; ++e)
+    {
+        if (!(graph->dependency_kinds[e] & closure->kinds)) continue;
+        size_t u = graph->dependencies[e];
+        const uint64_t *dep_row = closure->bits + u * words;
+        if (track_changes)
+        {
+            for (size_t i = 0; i < words; ++i)
+            {
+                uint64_t merged = row[i] | dep_row[i];
+                changed |= merged != row[i];
+                row[i] = merged;
+            }
+        }
+        else if (u != v)
+        {
+            orWords(row, dep_row, words);
+        }
+        uint64_t bit = (uint64_t)1 << (u % 64);
+        changed |= !(row[u / 64] & bit);
+        row[u / 64] |= bit;
+    }
+    return changed;
+}
+
+void
+Pkg_BuildClosure(
+    Pkg_Closure *closure,
+    const Pkg_Graph *graph,
+    unsigned int kinds)
+{
+    if (closure->bits) free(closure->bits);
+    size_t count = graph->package_count;
+    closure->graph = graph;
+    closure->kinds = kinds;
+    closure->words = (count + 63) / 64;
+    closure->words = (closure->words + BITSET_WORD_MULTIPLE - 1) / \
+        BITSET_WORD_MULTIPLE * BITSET_WORD_MULTIPLE;
+    closure->bits = allocWords(count * closure->words);
+
+    /* Dependencies come first in the order, so their closures are final
+     * by the time they are merged */
+    for (size_t i = 0; i < graph->ordered_count; ++i)
+    {
+        mergeDependencies(closure, graph->order[i], 0);
+    }
+
+    /* Vertices on or behind a cycle are not in the order, iterate those
+     * until nothing changes, which takes as many rounds as the longest
+     * dependency chain between them */
+    if (graph->ordered_count == count) return;
+    unsigned char *ordered = (unsigned char *)calloc(count, 1);
+    assert(ordered);
+    for (size_t i = 0; i < graph->ordered_count; ++i)
+    {
+        ordered[graph->order[i]] = 1;
+    }
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (size_t v = 0; v < count; ++v)
+        {
+            if (!ordered[v]) changed |= mergeDependencies(closure, v, 1);
+        }
+    }
+    free(ordered);
+}
+
+const uint64_t *
+Pkg_ClosureGet(const Pkg_Closure *closure, size_t vertex)
+{
+    assert(vertex < closure->graph->package_count);
+    return closure->bits + vertex * closure->words;
+}
+
+int
+Pkg_ClosureDependsOn(
+    const Pkg_Closure *closure,
+    size_t vertex,
+    size_t dependency)
+{
+    return Pkg_BitsetContains(Pkg_ClosureGet(closure, vertex), dependency);
+}
+
+uint64_t *
+Pkg_InitBitset(const Pkg_Closure *closure)
+{
+    return allocWords(closure->words);
+}
+
+void
+Pkg_FreeBitset(uint64_t *set)
+{
+    free(set);
+}
+
+void
+Pkg_BitsetAdd(uint64_t *set, size_t vertex)
+{
+    set[vertex / 64] |= (uint64_t)1 << (vertex % 64);
+}
+
+int
+Pkg_BitsetContains(const uint64_t *set, size_t vertex)
+{
+    return (set[vertex / 64] >> (vertex % 64)) & 1;
+}
+
+void
+Pkg_BitsetUnion(
+    const Pkg_Closure *closure,
+    uint64_t *set,
+    const uint64_t *other)
+{
+    if (set == other) return;
+    orWords(set, other, closure->words);
+}
+
+void
+Pkg_BitsetIntersect(
+    const Pkg_Closure *closure,
+    uint64_t *set,
+    const uint64_t *other)
+{
+    for (size_t i = 0; i < closure->words; ++i)
+    {
+        set[i] &= other[i];
+    }
+}
+
+size_t
+Pkg_BitsetCount(const Pkg_Closure *closure, const uint64_t *set)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < closure->words; ++i)
+    {
+        count += (size_t)__builtin_popcountll(set[i]);
+    }
+    return count;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/workspace.h>
+
+#include "internal.h"
+
+/* State of a diff being built */
+typedef struct Differ
+{
+    Pkg_WorkspaceDiff *diff;
+    size_t change_capacity;
+    size_t dependency_capacity;
+    /* which entries of the two dependency lists being compared have a
+     * match, the old ones followed by the new ones */
+    unsigned char *matched;
+    size_t matched_capacity;
+} Differ;
+
+static Pkg_PackageChange *
+addChange(
+    Differ *differ,
+    const Pkg_Package *old_package,
+    const Pkg_Package *new_package,
+    unsigned int changes)
+{
+    Pkg_WorkspaceDiff *diff = differ->diff;
+    if (diff->change_count == differ->change_capacity)
+    {
+        differ->change_capacity = differ->change_capacity ? \
+            differ->change_capacity * 2 : 16;
+        diff->changes = (Pkg_PackageChange *)realloc(
+            diff->changes,
+            differ->change_capacity * sizeof(Pkg_PackageChange));
+        assert(diff->changes);
+    }
+    Pkg_PackageChange *change = &diff->changes[diff->change_count++];
+    change->old_package = old_package;
+    change->new_package = new_package;
+    change->changes = changes;
+    change->dependency_offset = diff->dependency_change_count;
+    change->dependency_count = 0;
+    return change;
+}
+
+static void
+addDependencyChange(
+    Differ *differ,
+    const Pkg_DependencyList *dependency,
+    Pkg_DependencyType type,
+    int added)
+{
+    Pkg_WorkspaceDiff *diff = differ->diff;
+    if (diff->dependency_change_count == differ->dependency_capacity)
+    {
+        differ->dependency_capacity = differ->dependency_capacity ? \
+            differ->dependency_capacity * 2 : 16;
+        diff->dependency_changes = (Pkg_DependencyChange *)realloc(
+            diff->dependency_changes,
+            differ->dependency_capacity * sizeof(Pkg_DependencyChange));
+        assert(diff->dependency_changes);
+    }
+    Pkg_DependencyChange *change = \
+        &diff->dependency_changes[diff->dependency_change_count++];
+    change->dependency = dependency;
+    change->type = type;
+    change->added = added;
+}
+
+/*
+ * Returns 1 if a and b have the same name and constraints, names which are
+ * interned in one table are compared by pointer
+ */
+static int
+sameDependency(
+    const Pkg_DependencyList *a,
+    const Pkg_DependencyList *b,
+    int interned)
+{
+    if (a->constraints != b->constraints) return 0;
+    for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+    {
+        if ((a->constraints & PKG_CONSTRAINT_BIT(c)) &&
+            a->version_keys[c] != b->version_keys[c])
+        {
+            return 0;
+        }
+    }
+    if (interned || !a->name || !b->name) return a->name == b->name;
+    return 0 == strcmp(a->name, b->name);
+}
+
+/*
+ * Records the dependencies of type which only one of the packages
+ * declares, returns 1 if there are any
+ */
+static int
+diffDependencies(
+    Differ *differ,
+    const Pkg_Package *old_package,
+    const Pkg_Package *new_package,
+    Pkg_DependencyType type)
+{
+    size_t old_count;
+    size_t new_count;
+    const Pkg_DependencyList *old_deps = \
+        Pkg_GetDependencies(old_package, type, &old_count);
+    const Pkg_DependencyList *new_deps = \
+        Pkg_GetDependencies(new_package, type, &new_count);
+    int interned = old_package->names &&
+                   old_package->names == new_package->names;
+
+    /* Lists mostly change at their end, if at all */
+    size_t prefix = 0;
+    while (prefix < old_count && prefix < new_count &&
+           sameDependency(&old_deps[prefix], &new_deps[prefix], interned))
+    {
+        ++prefix;
+    }
+    if (prefix == old_count && prefix == new_count) return 0;
+
+    /* The rest is matched pairwise, each entry at most once */
+    old_deps += prefix;
+    new_deps += prefix;
+    old_count -= prefix;
+    new_count -= prefix;
+    if (old_count + new_count > differ->matched_capacity)
+    {
+        differ->matched_capacity = old_count + new_count;
+        differ->matched = (unsigned char *)realloc(
+            differ->matched, differ->matched_capacity);
+        assert(differ->matched);
+    }
+    unsigned char *old_matched = differ->matched;
+    unsigned char *new_matched = differ->matched + old_count;
+    memset(differ->matched, 0, old_count + new_count);
+    for (size_t j = 0; j < new_count; ++j)
+    {
+        for (size_t i = 0; i < old_count; ++i)
+        {
+            if (!old_matched[i] &&
+                sameDependency(&old_deps[i], &new_deps[j], interned))
+            {
+                old_matched[i] = 1;
+                new_matched[j] = 1;
+                break;
+            }
+        }
+    }
+
+    int changed = 0;
+    for (size_t i = 0; i < old_count; ++i)
+    {
+        if (old_matched[i]) continue;
+        addDependencyChange(differ, &old_deps[i], type, 0);
+        changed = 1;
+    }
+    for (size_t j = 0; j < new_count; ++j)
+    {
+        if (new_matched[j]) continue;
+        addDependencyChange(differ, &new_deps[j], type, 1);
+        changed = 1;
+    }
+    return changed;
+}
+
+/*
+ * Compares a package which is in both workspaces and records how it
+ * changed, if it did
+ */
+static void
+diffPackage(
+    Differ *differ,
+    const Pkg_Package *old_package,
+    const Pkg_Package *new_package)
+{
+    uint64_t hash = old_package->semantic_hash;
+    if (hash && hash == new_package->semantic_hash)
+    {
+        differ->diff->unchanged_count++;
+        return;
+    }
+
+    size_t offset = differ->diff->dependency_change_count;
+    unsigned int changes = 0;
+    if (Pkg_CompareVersions(&old_package->version, &new_package->version))
+    {
+        changes |= PKG_CHANGE_VERSION;
+    }
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        if (diffDependencies(differ, old_package, new_package,
+                             (Pkg_DependencyType)type))
+        {
+            changes |= PKG_CHANGE_DEPENDENCIES;
+        }
+    }
+    if (!changes && hash && new_package->semantic_hash)
+    {
+        changes = PKG_CHANGE_OTHER;
+    }
+    if (!changes)
+    {
+        differ->diff->unchanged_count++;
+        return;
+    }
+    Pkg_PackageChange *change = \
+        addChange(differ, old_package, new_package, changes);
+    change->dependency_offset = offset;
+    change->dependency_count = differ->diff->dependency_change_count - offset;
+}
+
+/* Pkg_WorkspaceDiff Functions */
+Pkg_WorkspaceDiff *
+Pkg_InitWorkspaceDiff()
+{
+    Pkg_WorkspaceDiff *diff = \
+        (Pkg_WorkspaceDiff *)malloc(sizeof(Pkg_WorkspaceDiff));
+    assert(diff);
+    diff->changes = NULL;
+    diff->change_count = 0;
+    diff->dependency_changes = NULL;
+    diff->dependency_change_count = 0;
+    diff->unchanged_count = 0;
+    return diff;
+}
+
+void
+Pkg_FreeWorkspaceDiff(Pkg_WorkspaceDiff *diff)
+{
+    if (diff->changes) free(diff->changes);
+    if (diff->dependency_changes) free(diff->dependency_changes);
+    free(diff);
+}
+
+int
+Pkg_DiffWorkspaces(
+    const Pkg_Workspace *old_ws,
+    const Pkg_Workspace *new_ws,
+    Pkg_WorkspaceDiff *diff)
+{
+    return pkgDiffPackages(old_ws->packages, old_ws->package_count,
+                           new_ws->packages, new_ws->package_count, diff);
+}
+
+int
+pkgDiffPackages(
+    Pkg_Package **old_packages,
+    size_t old_count,
+    Pkg_Package **new_packages,
+    size_t new_count,
+    Pkg_WorkspaceDiff *diff)
+{
+    if (diff->changes) free(diff->changes);
+    if (diff->dependency_changes) free(diff->dependency_changes);
+    diff->changes = NULL;
+    diff->change_count = 0;
+    diff->dependency_changes = NULL;
+    diff->dependency_change_count = 0;
+    diff->unchanged_count = 0;
+
+    Differ differ;
+    differ.diff = diff;
+    differ.change_capacity = 0;
+    differ.dependency_capacity = 0;
+    differ.matched = NULL;
+    differ.matched_capacity = 0;
+
+    /* A graph without edges, only used for its name index, a name used
+     * twice is indexed for its first package, the others count as removed */
+    Pkg_Graph *graph = Pkg_InitGraph();
+    Pkg_BuildGraph(graph, old_packages, old_count, 0);
+    unsigned char *seen = (unsigned char *)calloc(
+        old_count ? old_count : 1, 1);
+    assert(seen);
+
+    for (size_t i = 0; i < new_count; ++i)
+    {
+        const Pkg_Package *pkg = new_packages[i];
+        size_t v = pkg->name ? \
+            Pkg_GraphFindPackage(graph, pkg->name) : PKG_GRAPH_NOT_FOUND;
+        /* A name used twice is matched once, the other uses are new */
+        if (PKG_GRAPH_NOT_FOUND == v || seen[v])
+        {
+            addChange(&differ, NULL, pkg, PKG_CHANGE_ADDED);
+            continue;
+        }
+        seen[v] = 1;
+        diffPackage(&differ, old_packages[v], pkg);
+    }
+    for (size_t v = 0; v < old_count; ++v)
+    {
+        if (seen[v]) continue;
+        addChange(&differ, old_packages[v], NULL, PKG_CHANGE_REMOVED);
+    }
+
+    if (differ.matched) free(differ.matched);
+    free(seen);
+    Pkg_FreeGraph(graph);
+    return diff->change_count ? 1 : 0;
+}
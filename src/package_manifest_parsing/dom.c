@@ -0,0 +1,251 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The tree building parse backend, PKG_BACKEND_DOM */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#if !defined(LIBXML_TREE_ENABLED)
+# error LibXML2 not compiled with tree support
+#endif
+
+#include "internal.h"
+
+/*
+ * Returns the next xml element type node as a xmlNode* or NULL if none
+ */
+static inline xmlNode *
+getNextElementNode(xmlNode *node)
+{
+    xmlNode *element;
+
+    for (element = node->next; element; element = element->next)
+    {
+        if (XML_ELEMENT_NODE == element->type)
+        {
+            return element;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Appends the text of all descendants of node to the parser's text buffer
+ */
+static void
+gatherText(Pkg_Parser *parser, xmlNode *node)
+{
+    for (xmlNode *child = node->children; child; child = child->next)
+    {
+        switch (child->type)
+        {
+            case XML_TEXT_NODE:
+            case XML_CDATA_SECTION_NODE:
+            {
+                const char *content = (char *)child->content;
+                bufferAppend(&parser->text, content, strlen(content));
+                break;
+            }
+            case XML_ELEMENT_NODE:
+                gatherText(parser, child);
+                break;
+            case XML_ENTITY_REF_NODE:
+            {
+                /* Rare enough to let libxml2 resolve it */
+                xmlChar *content = xmlNodeGetContent(child);
+                if (content)
+                {
+                    bufferAppend(&parser->text,
+                                 (char *)content,
+                                 strlen((char *)content));
+                    xmlFree(content);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+/*
+ * Gathers the attributes of interest of node into the parser
+ */
+static void
+gatherAttrs(Pkg_Parser *parser, xmlNode *node)
+{
+    for (xmlAttr *attr = node->properties; attr; attr = attr->next)
+    {
+        xmlChar *value = xmlNodeListGetString(node->doc, attr->children, 1);
+        if (value)
+        {
+            collectAttr(parser, (char *)attr->name, (char *)value);
+            xmlFree(value);
+        }
+    }
+}
+
+/*
+ * Fills in pkg from a child element of the <package> tag
+ */
+static int
+handleNode(
+    Pkg_Parser *parser,
+    xmlNode *node,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    Element element;
+    element.tag_name = (char *)node->name;
+    element.tag = pkgLookupTag(element.tag_name);
+
+    /* Nothing to copy out of an element whose field was not requested */
+    if (!wantElement(parser, element.tag)) return 0;
+
+    bufferReset(&parser->text);
+    resetAttrs(parser);
+    /* The <export> tag is taken from the input as is, see sliceExport */
+    if (TAG_EXPORT != element.tag)
+    {
+        gatherText(parser, node);
+        gatherAttrs(parser, node);
+    }
+    element.text = parser->text.data;
+    resolveAttrs(parser, &element);
+
+    return pkgHandleElement(parser, pkg, &element, path);
+}
+
+static int
+parseDocument(
+    Pkg_Parser *parser,
+    xmlDoc *doc,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    xmlNode *root_element = NULL;
+
+    /* Get the root element */
+    root_element = xmlDocGetRootElement(doc);
+
+    /* Search for the <package> tag */
+    xmlNode *pkg_node;
+
+    for (pkg_node = root_element; pkg_node; pkg_node = pkg_node->next)
+    {
+        if (XML_ELEMENT_NODE == pkg_node->type)
+        {
+            if (0 == strncmp("package", (char *)pkg_node->name, 7))
+            {
+                break;
+            }
+            /* Otherwise it is an unknown tag */
+            fprintf(stderr,
+                    "Unknown tag '<%s>' in %s\n",
+                    (char *)pkg_node->name,
+                    path);
+            return 1;
+        }
+    }
+
+    /* If <package> not found, error */
+    if (!pkg_node)
+    {
+        fprintf(stderr, "Failed to find <package> tag in %s\n", path);
+        return 1;
+    }
+
+    /* Assert that there is only one <package> tag */
+    int package_found = 0;
+    for (xmlNode *node = root_element; node; node = node->next)
+    {
+        if (XML_ELEMENT_NODE == node->type)
+        {
+            if (package_found)
+            {
+                /* Otherwise it is an unknown tag */
+                fprintf(
+                    stderr,
+                    "Found toplevel tag '<%s>' in %s, "
+                    "but only one toplevel <package> tag is allowed\n",
+                    (char *)node->name,
+                    path);
+                return 1;
+            }
+            if (0 == strncmp("package", (char *)node->name, 7))
+            {
+                package_found = 1;
+            }
+        }
+    }
+
+    /* Look for format attribute of <package> tag */
+    xmlChar *package_format = xmlGetProp(pkg_node, (xmlChar *)"format");
+    int ret = pkgHandlePackageFormat(pkg, (char *)package_format, path);
+    if (package_format) xmlFree(package_format);
+    if (ret) return ret;
+
+    /* Iterate over all of the tags inside of the <package> tag */
+    xmlNode *curr = pkg_node->children;
+    if (curr && XML_ELEMENT_NODE != curr->type)
+    {
+        curr = getNextElementNode(curr);
+    }
+    for (; curr; curr = getNextElementNode(curr))
+    {
+        if (handleNode(parser, curr, path, pkg)) return 1;
+    }
+
+    return 0;
+}
+
+int
+pkgParseDom(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg)
+{
+    const char *path = input->name;
+
+    /* Try to read in the xml given, this resets the context */
+    xmlDoc *doc;
+    if (input->buffer)
+    {
+        /* libxml2 reads static memory in place, without copying it */
+        doc = xmlCtxtReadMemory(parser->ctxt,
+                                input->buffer, (int)input->size,
+                                path, NULL, 0);
+    }
+    else
+    {
+        doc = xmlCtxtReadFile(parser->ctxt, path, NULL, 0);
+    }
+
+    /* If the file cannot be opened, error */
+    if (doc == NULL) {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        return 1;
+    }
+
+    int ret = parseDocument(parser, doc, path, pkg);
+
+    /* Cleanup */
+    xmlFreeDoc(doc);
+
+    return ret;
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Locating the <export> tag in the raw manifest, and parsing it on demand
+ *
+ * The backends only note that a manifest has an <export> tag. Its bytes are
+ * then sliced out of the input as they are, rather than serialized again
+ * from libxml2's nodes, and only parsed if Pkg_ParseExports is called.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+#include "internal.h"
+
+/*
+ * Returns the position right after the first occurrence of token at or
+ * after p, NULL if there is none before end
+ */
+static const char *
+skipPast(const char *p, const char *end, const char *token)
+{
+    size_t len = strlen(token);
+    while ((size_t)(end - p) >= len)
+    {
+        const char *found = (const char *)memchr(p, token[0], end - p);
+        if (!found || (size_t)(end - found) < len) return NULL;
+        if (0 == memcmp(found, token, len)) return found + len;
+        p = found + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the position right after the '>' closing the tag or declaration
+ * starting at p, skipping quoted values and bracketed internal subsets
+ */
+static const char *
+skipTag(const char *p, const char *end)
+{
+    int brackets = 0;
+    char quote = 0;
+    for (; p < end; ++p)
+    {
+        char c = *p;
+        if (quote)
+        {
+            if (c == quote) quote = 0;
+        } else
+        if ('"' == c || '\'' == c)
+        {
+            quote = c;
+        } else
+        if ('[' == c)
+        {
+            brackets++;
+        } else
+        if (']' == c)
+        {
+            brackets--;
+        } else
+        if ('>' == c && brackets <= 0)
+        {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static inline int
+isNameEnd(char c)
+{
+    return ' ' == c || '\t' == c || '\n' == c || '\r' == c ||
+           '/' == c || '>' == c;
+}
+
+int
+pkgFindExport(const char *data, size_t size, size_t *offset, size_t *len)
+{
+    const char *p = data;
+    const char *end = data + size;
+    /* number of open elements, <package> is the only one at depth 0 */
+    int depth = 0;
+    const char *begin = NULL;
+    int found = 0;
+
+    while (p < end)
+    {
+        p = (const char *)memchr(p, '<', end - p);
+        if (!p) break;
+        const char *tag = p;
+        size_t left = (size_t)(end - p);
+        if (left >= 4 && 0 == memcmp(p, "<!--", 4))
+        {
+            p = skipPast(p + 4, end, "-->");
+        } else
+        if (left >= 9 && 0 == memcmp(p, "<![CDATA[", 9))
+        {
+            p = skipPast(p + 9, end, "]]>");
+        } else
+        if (left >= 2 && '?' == p[1])
+        {
+            p = skipPast(p + 2, end, "?>");
+        } else
+        if (left >= 2 && '!' == p[1])
+        {
+            p = skipTag(p + 2, end);
+        } else
+        if (left >= 2 && '/' == p[1])
+        {
+            p = skipTag(p + 2, end);
+            if (!p) break;
+            depth--;
+            if (begin && 1 == depth)
+            {
+                *offset = (size_t)(begin - data);
+                *len = (size_t)(p - begin);
+                found = 1;
+                begin = NULL;
+            }
+        }
+        else
+        {
+            const char *name = p + 1;
+            p = skipTag(name, end);
+            if (!p) break;
+            int empty = '/' == p[-2];
+            if (1 == depth && (size_t)(p - name) > 6 &&
+                0 == memcmp(name, "export", 6) && isNameEnd(name[6]))
+            {
+                if (empty)
+                {
+                    *offset = (size_t)(tag - data);
+                    *len = (size_t)(p - tag);
+                    found = 1;
+                }
+                else
+                {
+                    begin = tag;
+                }
+            }
+            if (!empty) depth++;
+        }
+        if (!p) break;
+    }
+    return found;
+}
+
+/* Pkg_Exports Functions */
+Pkg_Exports *
+Pkg_InitExports()
+{
+    Pkg_Exports *exports = (Pkg_Exports *)malloc(sizeof(Pkg_Exports));
+    assert(exports);
+    exports->entries = NULL;
+    exports->count = 0;
+    return exports;
+}
+
+static void
+clearExports(Pkg_Exports *exports)
+{
+    for (size_t i = 0; i < exports->count; ++i)
+    {
+        Pkg_Export *entry = &exports->entries[i];
+        for (size_t j = 0; j < entry->attr_count; ++j)
+        {
+            free(entry->attrs[j].name);
+            free(entry->attrs[j].value);
+        }
+        free(entry->attrs);
+        free(entry->tag);
+        free(entry->content);
+    }
+    free(exports->entries);
+    exports->entries = NULL;
+    exports->count = 0;
+}
+
+void
+Pkg_FreeExports(Pkg_Exports *exports)
+{
+    clearExports(exports);
+    free(exports);
+}
+
+/*
+ * Returns a malloc'd copy of an xmlChar string, or of "" for NULL
+ */
+static char *
+takeString(xmlChar *str)
+{
+    char *copy = strdup(str ? (char *)str : "");
+    assert(copy);
+    if (str) xmlFree(str);
+    return copy;
+}
+
+static void
+fillExport(Pkg_Export *entry, xmlNode *node)
+{
+    entry->tag = takeString(xmlStrdup(node->name));
+    entry->content = takeString(xmlNodeGetContent(node));
+    entry->attr_count = 0;
+    for (xmlAttr *attr = node->properties; attr; attr = attr->next)
+    {
+        entry->attr_count++;
+    }
+    entry->attrs = NULL;
+    if (entry->attr_count)
+    {
+        entry->attrs = (Pkg_ExportAttr *)malloc(
+            entry->attr_count * sizeof(Pkg_ExportAttr));
+        assert(entry->attrs);
+    }
+    size_t i = 0;
+    for (xmlAttr *attr = node->properties; attr; attr = attr->next, ++i)
+    {
+        entry->attrs[i].name = takeString(xmlStrdup(attr->name));
+        entry->attrs[i].value = takeString(
+            xmlNodeListGetString(node->doc, attr->children, 1));
+    }
+}
+
+int
+Pkg_ParseExports(const Pkg_Package *pkg, Pkg_Exports *exports)
+{
+    clearExports(exports);
+    if (!pkg->exports) return 0;
+
+    pkgInitLibXML();
+    const char *path = pkg->filename ? pkg->filename : "<buffer>";
+    xmlDoc *doc = xmlReadMemory(pkg->exports, (int)strlen(pkg->exports),
+                                path, NULL, XML_PARSE_NONET);
+    if (!doc)
+    {
+        fprintf(stderr, "Failed to parse <export> of %s\n", path);
+        return 1;
+    }
+
+    xmlNode *root = xmlDocGetRootElement(doc);
+    size_t capacity = 0;
+    for (xmlNode *node = root ? root->children : NULL; node;
+         node = node->next)
+    {
+        if (XML_ELEMENT_NODE != node->type) continue;
+        if (exports->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 4;
+            exports->entries = (Pkg_Export *)realloc(
+                exports->entries, capacity * sizeof(Pkg_Export));
+            assert(exports->entries);
+        }
+        fillExport(&exports->entries[exports->count++], node);
+    }
+
+    xmlFreeDoc(doc);
+    return 0;
+}
+
+const char *
+Pkg_ExportGetAttr(const Pkg_Export *entry, const char *name)
+{
+    for (size_t i = 0; i < entry->attr_count; ++i)
+    {
+        if (0 == strcmp(entry->attrs[i].name, name))
+        {
+            return entry->attrs[i].value;
+        }
+    }
+    return NULL;
+}
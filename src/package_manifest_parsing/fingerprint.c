@@ -0,0 +1,235 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The semantic hash of a package, see semantic_hash of Pkg_Package
+ *
+ * The members are written to a canonical byte string, in their order, which
+ * is then hashed once with pkgFastHash. Strings are normalized on the way:
+ * runs of whitespace become a single space, and leading and trailing
+ * whitespace is dropped. The raw <export> tag additionally loses its
+ * comments and the whitespace next to its tags, so reindenting it changes
+ * nothing. A dependency list is written as the sum of the hashes of its
+ * entries, which makes it a multiset, the other lists are written in order.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+#include "internal.h"
+
+/* Written for a string which is not set, it never occurs in UTF-8 */
+#define NULL_STRING '\xff'
+
+/* Classes of the bytes normalize has to look at, the rest is copied */
+#define BREAK_SPACE 1
+#define BREAK_MARKUP 2
+
+static const unsigned char BREAKS[256] = {
+    ['\0'] = BREAK_SPACE, [' '] = BREAK_SPACE, ['\t'] = BREAK_SPACE,
+    ['\n'] = BREAK_SPACE, ['\r'] = BREAK_SPACE, ['<'] = BREAK_MARKUP
+};
+
+/* Eight copies of a byte */
+#define BYTES(c) (0x0101010101010101ULL * (unsigned char)(c))
+
+/*
+ * Returns nonzero if a byte of word is below '!', which covers the
+ * terminator and whitespace, or with markup is '<'
+ */
+static inline uint64_t
+hasBreak(uint64_t word, int markup)
+{
+    uint64_t found = (word - BYTES('!')) & ~word & BYTES(0x80);
+    if (markup)
+    {
+        uint64_t lt = word ^ BYTES('<');
+        found |= (lt - BYTES(1)) & ~lt & BYTES(0x80);
+    }
+    return found;
+}
+
+/*
+ * Copies the len bytes of the NUL terminated str to out with whitespace
+ * normalized, returns the length of the copy, which is never longer
+ *
+ * Markup also loses its comments, and the whitespace before or after a
+ * tag's angle brackets and before "/>". Runs of plain text are copied a
+ * word at a time.
+ */
+static size_t
+normalize(char *out, const char *str, size_t len, int markup)
+{
+    const unsigned char *p = (const unsigned char *)str;
+    const unsigned char *const end = p + len;
+    const int breaks = markup ? BREAK_SPACE | BREAK_MARKUP : BREAK_SPACE;
+    char *const start = out;
+    for (;;)
+    {
+        uint64_t word;
+        while (end - p >= 8)
+        {
+            memcpy(&word, p, 8);
+            if (hasBreak(word, markup)) break;
+            memcpy(out, &word, 8);
+            out += 8;
+            p += 8;
+        }
+        while (!(BREAKS[*p] & breaks)) *out++ = (char)*p++;
+
+        int space = 0;
+        for (;;)
+        {
+            if (' ' == *p || '\t' == *p || '\n' == *p || '\r' == *p)
+            {
+                space = 1;
+                ++p;
+            } else
+            if (markup && 0 == strncmp((const char *)p, "<!--", 4))
+            {
+                const char *close = strstr((const char *)p + 4, "-->");
+                if (!close) return (size_t)(out - start);
+                p = (const unsigned char *)close + 3;
+            }
+            else
+            {
+                break;
+            }
+        }
+        const unsigned char c = *p;
+        if (!c) break;
+        if (space && out != start)
+        {
+            int tag = markup &&
+                      ('<' == c || '>' == c || '>' == out[-1] ||
+                       ('/' == c && '>' == p[1]));
+            if (!tag) *out++ = ' ';
+        }
+        *out++ = (char)*p++;
+    }
+    return (size_t)(out - start);
+}
+
+/*
+ * Makes room for len more bytes and a terminator, returns where they go
+ */
+static inline char *
+reserve(Buffer *out, size_t len)
+{
+    if (out->size + len + 1 > out->capacity)
+    {
+        while (out->size + len + 1 > out->capacity) out->capacity *= 2;
+        out->data = (char *)realloc(out->data, out->capacity);
+        assert(out->data);
+    }
+    return out->data + out->size;
+}
+
+static inline void
+putInt(Buffer *out, uint64_t value)
+{
+    memcpy(reserve(out, sizeof(value)), &value, sizeof(value));
+    out->size += sizeof(value);
+}
+
+/*
+ * Writes a normalized string, with its terminator
+ */
+static void
+putString(Buffer *out, const char *str, int markup)
+{
+    if (!str)
+    {
+        *reserve(out, 1) = NULL_STRING;
+        out->size += 1;
+        return;
+    }
+    size_t len = strlen(str);
+    char *dest = reserve(out, len + 1);
+    size_t size = normalize(dest, str, len, markup);
+    dest[size] = '\0';
+    out->size += size + 1;
+}
+
+static void
+putPersons(Buffer *out, const Pkg_PersonList *persons, size_t count)
+{
+    putInt(out, count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        putString(out, persons[i].name, 0);
+        putString(out, persons[i].email, 0);
+    }
+}
+
+static void
+putDependencies(Buffer *out, const Pkg_DependencyList *deps, size_t count)
+{
+    size_t start = out->size;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        putString(out, deps[i].name, 0);
+        putInt(out, deps[i].constraints);
+        for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+        {
+            if (deps[i].constraints & PKG_CONSTRAINT_BIT(c))
+            {
+                putInt(out, deps[i].version_keys[c]);
+            }
+        }
+        sum += pkgFastHash(out->data + start, out->size - start);
+        out->size = start;
+    }
+    putInt(out, count);
+    putInt(out, sum);
+}
+
+uint64_t
+pkgSemanticHash(const Pkg_Package *pkg, Buffer *scratch)
+{
+    bufferReset(scratch);
+    putInt(scratch, pkg->fields);
+    putInt(scratch, pkg->package_format);
+    putString(scratch, pkg->name, 0);
+    putInt(scratch, Pkg_PackVersion(&pkg->version));
+    putInt(scratch, Pkg_PackVersion(&pkg->abi_version));
+    putString(scratch, pkg->description, 0);
+    putPersons(scratch, pkg->maintainers, pkg->maintainer_count);
+    putInt(scratch, pkg->license_count);
+    for (size_t i = 0; i < pkg->license_count; ++i)
+    {
+        putString(scratch, pkg->licenses[i].license, 0);
+    }
+    putInt(scratch, pkg->url_count);
+    for (size_t i = 0; i < pkg->url_count; ++i)
+    {
+        putString(scratch, pkg->urls[i].url, 0);
+        putInt(scratch, (uint64_t)pkg->urls[i].type);
+    }
+    putPersons(scratch, pkg->authors, pkg->author_count);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t count;
+        const Pkg_DependencyList *deps = \
+            Pkg_GetDependencies(pkg, (Pkg_DependencyType)type, &count);
+        putDependencies(scratch, deps, count);
+    }
+    putString(scratch, pkg->exports, 1);
+    uint64_t hash = pkgFastHash(scratch->data, scratch->size);
+    bufferReset(scratch);
+    return hash;
+}
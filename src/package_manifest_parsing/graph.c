@@ -0,0 +1,524 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/intern.h>
+
+#include "hash.h"
+
+/* Pkg_Graph Functions */
+Pkg_Graph *
+Pkg_InitGraph()
+{
+    Pkg_Graph *graph = (Pkg_Graph *)calloc(1, sizeof(Pkg_Graph));
+    assert(graph);
+    return graph;
+}
+
+/*
+ * Frees everything the graph owns and leaves it empty
+ */
+static void
+resetGraph(Pkg_Graph *graph)
+{
+    if (graph->packages) free(graph->packages);
+    if (graph->dependency_offsets) free(graph->dependency_offsets);
+    if (graph->dependencies) free(graph->dependencies);
+    if (graph->dependency_kinds) free(graph->dependency_kinds);
+    if (graph->dependent_offsets) free(graph->dependent_offsets);
+    if (graph->dependents) free(graph->dependents);
+    if (graph->dependent_kinds) free(graph->dependent_kinds);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        if (graph->kind_dependent_offsets[type])
+        {
+            free(graph->kind_dependent_offsets[type]);
+        }
+        if (graph->kind_dependents[type]) free(graph->kind_dependents[type]);
+    }
+    if (graph->order) free(graph->order);
+    if (graph->level_offsets) free(graph->level_offsets);
+    if (graph->cycle) free(graph->cycle);
+    if (graph->duplicates) free(graph->duplicates);
+    if (graph->index) free(graph->index);
+    memset(graph, 0, sizeof(Pkg_Graph));
+}
+
+void
+Pkg_FreeGraph(Pkg_Graph *graph)
+{
+    resetGraph(graph);
+    free(graph);
+}
+
+static inline size_t
+hashIndexSlot(const Pkg_Graph *graph, const char *name)
+{
+    size_t mask = graph->index_capacity - 1;
+    size_t slot = (size_t)pkgHash(name, strlen(name)) & mask;
+    for (;;)
+    {
+        size_t vertex = graph->index[slot];
+        if (PKG_GRAPH_NOT_FOUND == vertex ||
+            0 == strcmp(graph->packages[vertex]->name, name))
+        {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/*
+ * Returns the index entry for name, which must be interned in graph->names
+ * if the graph has them
+ */
+static inline size_t *
+indexEntry(const Pkg_Graph *graph, const char *name)
+{
+    if (graph->names)
+    {
+        unsigned int id = Pkg_InternId(name);
+        return id < graph->index_capacity ? &graph->index[id] : NULL;
+    }
+    return &graph->index[hashIndexSlot(graph, name)];
+}
+
+static inline size_t
+findVertex(const Pkg_Graph *graph, const char *name)
+{
+    size_t *entry = indexEntry(graph, name);
+    return entry ? *entry : PKG_GRAPH_NOT_FOUND;
+}
+
+size_t
+Pkg_GraphFindPackage(const Pkg_Graph *graph, const char *name)
+{
+    if (!graph->index_capacity) return PKG_GRAPH_NOT_FOUND;
+    if (graph->names)
+    {
+        name = Pkg_InternLookup(graph->names, name);
+        if (!name) return PKG_GRAPH_NOT_FOUND;
+    }
+    return findVertex(graph, name);
+}
+
+/*
+ * Indexes the vertices by name, returns 1 if a name is used twice
+ */
+static int
+buildIndex(Pkg_Graph *graph)
+{
+    /* Interned names are indexed by id, without hashing them */
+    graph->names = graph->package_count ? graph->packages[0]->names : NULL;
+    for (size_t v = 1; graph->names && v < graph->package_count; ++v)
+    {
+        if (graph->packages[v]->names != graph->names) graph->names = NULL;
+    }
+    if (graph->names)
+    {
+        graph->index_capacity = Pkg_InternCount(graph->names);
+    }
+    else
+    {
+        graph->index_capacity = 16;
+        while (graph->index_capacity < 2 * graph->package_count)
+        {
+            graph->index_capacity *= 2;
+        }
+    }
+    graph->index = (size_t *)malloc(
+        (graph->index_capacity ? graph->index_capacity : 1) * sizeof(size_t));
+    assert(graph->index);
+    for (size_t i = 0; i < graph->index_capacity; ++i)
+    {
+        graph->index[i] = PKG_GRAPH_NOT_FOUND;
+    }
+
+    size_t duplicate_capacity = 0;
+    for (size_t v = 0; v < graph->package_count; ++v)
+    {
+        const Pkg_Package *pkg = graph->packages[v];
+        if (!pkg->name) continue;
+        size_t *entry = indexEntry(graph, pkg->name);
+        assert(entry);
+        if (PKG_GRAPH_NOT_FOUND != *entry)
+        {
+            if (graph->duplicate_count == duplicate_capacity)
+            {
+                duplicate_capacity = \
+                    duplicate_capacity ? 2 * duplicate_capacity : 4;
+                graph->duplicates = (size_t *)realloc(
+                    graph->duplicates, duplicate_capacity * sizeof(size_t));
+                assert(graph->duplicates);
+            }
+            graph->duplicates[graph->duplicate_count++] = v;
+            continue;
+        }
+        *entry = v;
+    }
+    return graph->duplicate_count != 0;
+}
+
+/*
+ * Collects the distinct dependencies of every vertex
+ */
+static void
+buildEdges(Pkg_Graph *graph)
+{
+    size_t count = graph->package_count;
+    size_t capacity = count ? count * 4 : 1;
+    graph->dependency_offsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+    graph->dependencies = (size_t *)malloc(capacity * sizeof(size_t));
+    graph->dependency_kinds = (unsigned char *)malloc(capacity);
+    assert(graph->dependency_offsets);
+    assert(graph->dependencies && graph->dependency_kinds);
+
+    /* last[u] is the edge to u of the current vertex, if it has one */
+    size_t *last = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    assert(last);
+    for (size_t u = 0; u < count; ++u)
+    {
+        last[u] = PKG_GRAPH_NOT_FOUND;
+    }
+
+    size_t edge_count = 0;
+    for (size_t v = 0; v < count; ++v)
+    {
+        graph->dependency_offsets[v] = edge_count;
+        for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+        {
+            if (!(graph->kinds & PKG_DEPEND_BIT(type))) continue;
+            size_t dep_count;
+            const Pkg_DependencyList *deps = Pkg_GetDependencies(
+                graph->packages[v], (Pkg_DependencyType)type, &dep_count);
+            for (size_t i = 0; i < dep_count; ++i)
+            {
+                if (!deps[i].name) continue;
+                size_t u = findVertex(graph, deps[i].name);
+                if (PKG_GRAPH_NOT_FOUND == u) continue;
+                size_t edge = last[u];
+                if (PKG_GRAPH_NOT_FOUND != edge &&
+                    edge >= graph->dependency_offsets[v])
+                {
+                    graph->dependency_kinds[edge] |= PKG_DEPEND_BIT(type);
+                    continue;
+                }
+                if (edge_count == capacity)
+                {
+                    capacity *= 2;
+                    graph->dependencies = (size_t *)realloc(
+                        graph->dependencies, capacity * sizeof(size_t));
+                    graph->dependency_kinds = (unsigned char *)realloc(
+                        graph->dependency_kinds, capacity);
+                    assert(graph->dependencies && graph->dependency_kinds);
+                }
+                last[u] = edge_count;
+                graph->dependencies[edge_count] = u;
+                graph->dependency_kinds[edge_count] = \
+                    (unsigned char)PKG_DEPEND_BIT(type);
+                edge_count++;
+            }
+        }
+    }
+    graph->dependency_offsets[count] = edge_count;
+    free(last);
+}
+
+/*
+ * Builds the reverse of the edges of the given kinds, for every kind if
+ * type is PKG_DEPEND_TYPE_COUNT, storing the dependents' kinds if wanted
+ */
+static void
+reverseEdges(
+    const Pkg_Graph *graph,
+    int type,
+    size_t **offsets_out,
+    size_t **dependents_out,
+    unsigned char **kinds_out)
+{
+    size_t count = graph->package_count;
+    unsigned int mask = PKG_DEPEND_TYPE_COUNT == type ? \
+        PKG_DEPEND_ALL : PKG_DEPEND_BIT(type);
+    size_t *offsets = (size_t *)calloc(count + 1, sizeof(size_t));
+    assert(offsets);
+    for (size_t e = 0; e < graph->dependency_offsets[count]; ++e)
+    {
+        if (graph->dependency_kinds[e] & mask)
+        {
+            offsets[graph->dependencies[e] + 1]++;
+        }
+    }
+    for (size_t v = 0; v < count; ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+
+    size_t edge_count = offsets[count];
+    size_t *dependents = (size_t *)malloc(
+        (edge_count ? edge_count : 1) * sizeof(size_t));
+    unsigned char *kinds = NULL;
+    if (kinds_out)
+    {
+        kinds = (unsigned char *)malloc(edge_count ? edge_count : 1);
+        assert(kinds);
+    }
+    size_t *fill = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    assert(dependents && fill);
+    memcpy(fill, offsets, count * sizeof(size_t));
+    /* Walking the vertices in order keeps each list sorted */
+    for (size_t v = 0; v < count; ++v)
+    {
+        for (size_t e = graph->dependency_offsets[v];
+             e < graph->dependency_offsets[v + 1]; ++e)
+        {
+            if (!(graph->dependency_kinds[e] & mask)) continue;
+            size_t slot = fill[graph->dependencies[e]]++;
+            dependents[slot] = v;
+            if (kinds) kinds[slot] = graph->dependency_kinds[e];
+        }
+    }
+    free(fill);
+
+    *offsets_out = offsets;
+    *dependents_out = dependents;
+    if (kinds_out) *kinds_out = kinds;
+}
+
+static void
+buildDependents(Pkg_Graph *graph)
+{
+    reverseEdges(graph, PKG_DEPEND_TYPE_COUNT,
+                 &graph->dependent_offsets,
+                 &graph->dependents,
+                 &graph->dependent_kinds);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        reverseEdges(graph, type,
+                     &graph->kind_dependent_offsets[type],
+                     &graph->kind_dependents[type],
+                     NULL);
+    }
+}
+
+const size_t *
+Pkg_GraphGetDependents(
+    const Pkg_Graph *graph,
+    size_t vertex,
+    Pkg_DependencyType type,
+    size_t *count)
+{
+    assert(vertex < graph->package_count);
+    assert(type < PKG_DEPEND_TYPE_COUNT);
+    const size_t *offsets = graph->kind_dependent_offsets[type];
+    *count = offsets[vertex + 1] - offsets[vertex];
+    return graph->kind_dependents[type] + offsets[vertex];
+}
+
+size_t
+Pkg_GraphGetTransitiveDependents(
+    const Pkg_Graph *graph,
+    const size_t *vertices,
+    size_t vertex_count,
+    unsigned int kinds,
+    size_t *result)
+{
+    size_t count = graph->package_count;
+    unsigned char *seen = (unsigned char *)calloc(count ? count : 1, 1);
+    assert(seen);
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        assert(vertices[i] < count);
+        seen[vertices[i]] = 1;
+    }
+
+    /* Breadth first, result doubles as the queue, the given vertices are
+     * expanded first without being part of it */
+    size_t found = 0;
+    for (size_t i = 0; i < vertex_count + found; ++i)
+    {
+        size_t u = i < vertex_count ? vertices[i] : result[i - vertex_count];
+        for (size_t d = graph->dependent_offsets[u];
+             d < graph->dependent_offsets[u + 1]; ++d)
+        {
+            size_t v = graph->dependents[d];
+            if (seen[v] || !(graph->dependent_kinds[d] & kinds)) continue;
+            seen[v] = 1;
+            result[found++] = v;
+        }
+    }
+    free(seen);
+    return found;
+}
+
+/*
+ * Finds a cycle among the vertices Kahn's algorithm could not order
+ *
+ * Every such vertex has a dependency which is not ordered either, so
+ * following those from any of them must eventually revisit a vertex.
+ */
+static void
+findCycle(Pkg_Graph *graph, const size_t *remaining)
+{
+    size_t count = graph->package_count;
+    /* position of each vertex on the walk, or not found */
+    size_t *position = (size_t *)malloc(count * sizeof(size_t));
+    size_t *walk = (size_t *)malloc(count * sizeof(size_t));
+    assert(position && walk);
+    for (size_t v = 0; v < count; ++v)
+    {
+        position[v] = PKG_GRAPH_NOT_FOUND;
+    }
+
+    size_t v = 0;
+    while (!remaining[v]) v++;
+    size_t length = 0;
+    while (PKG_GRAPH_NOT_FOUND == position[v])
+    {
+        position[v] = length;
+        walk[length++] = v;
+        for (size_t e = graph->dependency_offsets[v];
+             e < graph->dependency_offsets[v + 1]; ++e)
+        {
+            if (remaining[graph->dependencies[e]])
+            {
+                v = graph->dependencies[e];
+                break;
+            }
+        }
+    }
+
+    graph->cycle_length = length - position[v];
+    graph->cycle = (size_t *)malloc(graph->cycle_length * sizeof(size_t));
+    assert(graph->cycle);
+    memcpy(graph->cycle, walk + position[v],
+           graph->cycle_length * sizeof(size_t));
+    free(position);
+    free(walk);
+}
+
+/*
+ * Orders the vertices into levels with Kahn's algorithm, returns 1 if some
+ * vertices could not be ordered because of a cycle
+ */
+static int
+buildLevels(Pkg_Graph *graph)
+{
+    size_t count = graph->package_count;
+    const size_t *dependent_offsets = graph->dependent_offsets;
+    const size_t *dependents = graph->dependents;
+    /* number of dependencies of each vertex which are not ordered yet */
+    size_t *remaining = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    assert(remaining);
+    for (size_t v = 0; v < count; ++v)
+    {
+        remaining[v] = \
+            graph->dependency_offsets[v + 1] - graph->dependency_offsets[v];
+    }
+
+    graph->order = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    graph->level_offsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+    assert(graph->order && graph->level_offsets);
+    size_t ordered = 0;
+    for (size_t v = 0; v < count; ++v)
+    {
+        if (!remaining[v]) graph->order[ordered++] = v;
+    }
+    /* Each level releases the vertices whose last dependency it holds */
+    size_t level_start = 0;
+    graph->level_count = 0;
+    while (level_start < ordered)
+    {
+        size_t level_end = ordered;
+        graph->level_offsets[graph->level_count++] = level_start;
+        for (size_t i = level_start; i < level_end; ++i)
+        {
+            size_t u = graph->order[i];
+            for (size_t d = dependent_offsets[u];
+                 d < dependent_offsets[u + 1]; ++d)
+            {
+                size_t v = dependents[d];
+                if (0 == --remaining[v]) graph->order[ordered++] = v;
+            }
+        }
+        level_start = level_end;
+    }
+    graph->level_offsets[graph->level_count] = ordered;
+    graph->ordered_count = ordered;
+
+    int ret = 0;
+    if (ordered < count)
+    {
+        findCycle(graph, remaining);
+        ret = 1;
+    }
+
+    free(remaining);
+    return ret;
+}
+
+void
+Pkg_PrintGraphErrors(const Pkg_Graph *graph, FILE *file)
+{
+    for (size_t i = 0; i < graph->duplicate_count; ++i)
+    {
+        const Pkg_Package *pkg = graph->packages[graph->duplicates[i]];
+        fprintf(file, "Package name '%s' is used by both %s and %s\n",
+                pkg->name,
+                graph->packages[findVertex(graph, pkg->name)]->filename,
+                pkg->filename);
+    }
+    if (!graph->cycle_length) return;
+    fprintf(file, "Dependency cycle:");
+    for (size_t i = 0; i <= graph->cycle_length; ++i)
+    {
+        const Pkg_Package *pkg = \
+            graph->packages[graph->cycle[i % graph->cycle_length]];
+        fprintf(file, "%s %s", i ? " ->" : "",
+                pkg->name ? pkg->name : pkg->filename);
+    }
+    fprintf(file, "\n");
+}
+
+int
+Pkg_BuildGraph(
+    Pkg_Graph *graph,
+    Pkg_Package **packages,
+    size_t package_count,
+    unsigned int kinds)
+{
+    resetGraph(graph);
+    graph->package_count = package_count;
+    graph->kinds = kinds & PKG_DEPEND_ALL;
+    graph->packages = (Pkg_Package **)malloc(
+        (package_count ? package_count : 1) * sizeof(Pkg_Package *));
+    assert(graph->packages);
+    if (package_count)
+    {
+        memcpy(graph->packages, packages,
+               package_count * sizeof(Pkg_Package *));
+    }
+
+    int ret = buildIndex(graph);
+    buildEdges(graph);
+    buildDependents(graph);
+    if (buildLevels(graph)) ret = 1;
+    return ret;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Non cryptographic hashing shared by the pkg library, not public API */
+
+#ifndef PACKAGE_MANIFEST_PARSING__HASH_H_
+#define PACKAGE_MANIFEST_PARSING__HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PKG_HASH_SEED 14695981039346656037ULL
+
+/*
+ * Continues a 64 bit FNV-1a hash of a byte sequence with len more bytes
+ */
+static inline uint64_t
+pkgHashUpdate(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Returns the 64 bit FNV-1a hash of len bytes
+ */
+static inline uint64_t
+pkgHash(const void *data, size_t len)
+{
+    return pkgHashUpdate(PKG_HASH_SEED, data, len);
+}
+
+/* Primes of XXH64, see pkgFastHash */
+#define PKG_XXH_PRIME1 11400714785074694791ULL
+#define PKG_XXH_PRIME2 14029467366897019727ULL
+#define PKG_XXH_PRIME3 1609587929392839161ULL
+#define PKG_XXH_PRIME4 9650029242287828579ULL
+#define PKG_XXH_PRIME5 2870177450012600261ULL
+
+static inline uint64_t
+pkgRotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+pkgXXHRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PKG_XXH_PRIME2;
+    return pkgRotl64(acc, 31) * PKG_XXH_PRIME1;
+}
+
+static inline uint64_t
+pkgXXHMerge(uint64_t acc, uint64_t value)
+{
+    acc ^= pkgXXHRound(0, value);
+    return acc * PKG_XXH_PRIME1 + PKG_XXH_PRIME4;
+}
+
+/*
+ * Mixes every bit of hash into every other, the last step of XXH64
+ */
+static inline uint64_t
+pkgXXHAvalanche(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= PKG_XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= PKG_XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/*
+ * Returns the 64 bit XXH64 hash of len bytes, with seed 0
+ *
+ * Reads eight bytes at a time, so unlike pkgHash it costs little more for
+ * a whole manifest than for a name. Words are read in host byte order, the
+ * values only match the reference implementation on little endian hosts.
+ */
+static inline uint64_t
+pkgFastHash(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    uint64_t word;
+    uint64_t hash;
+    if (len >= 32)
+    {
+        uint64_t v1 = PKG_XXH_PRIME1 + PKG_XXH_PRIME2;
+        uint64_t v2 = PKG_XXH_PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -PKG_XXH_PRIME1;
+        do
+        {
+            memcpy(&word, p, 8);
+            v1 = pkgXXHRound(v1, word);
+            memcpy(&word, p + 8, 8);
+            v2 = pkgXXHRound(v2, word);
+            memcpy(&word, p + 16, 8);
+            v3 = pkgXXHRound(v3, word);
+            memcpy(&word, p + 24, 8);
+            v4 = pkgXXHRound(v4, word);
+            p += 32;
+        } while (end - p >= 32);
+        hash = pkgRotl64(v1, 1) + pkgRotl64(v2, 7) +
+               pkgRotl64(v3, 12) + pkgRotl64(v4, 18);
+        hash = pkgXXHMerge(hash, v1);
+        hash = pkgXXHMerge(hash, v2);
+        hash = pkgXXHMerge(hash, v3);
+        hash = pkgXXHMerge(hash, v4);
+    }
+    else
+    {
+        hash = PKG_XXH_PRIME5;
+    }
+    hash += (uint64_t)len;
+
+    while (end - p >= 8)
+    {
+        memcpy(&word, p, 8);
+        hash ^= pkgXXHRound(0, word);
+        hash = pkgRotl64(hash, 27) * PKG_XXH_PRIME1 + PKG_XXH_PRIME4;
+        p += 8;
+    }
+    if (end - p >= 4)
+    {
+        uint32_t half;
+        memcpy(&half, p, 4);
+        hash ^= (uint64_t)half * PKG_XXH_PRIME1;
+        hash = pkgRotl64(hash, 23) * PKG_XXH_PRIME2 + PKG_XXH_PRIME3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        hash ^= (uint64_t)*p++ * PKG_XXH_PRIME5;
+        hash = pkgRotl64(hash, 11) * PKG_XXH_PRIME1;
+    }
+
+    return pkgXXHAvalanche(hash);
+}
+
+#endif  /* PACKAGE_MANIFEST_PARSING__HASH_H_ */
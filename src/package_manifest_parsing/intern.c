@@ -0,0 +1,207 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/arena.h>
+#include <package_manifest_parsing/intern.h>
+
+#include "hash.h"
+
+/* Number of independently locked shards, a power of two */
+#define INTERN_SHARD_COUNT 64
+#define INTERN_SHARD_BITS 6
+
+/* An interned string, the API hands out pointers to str */
+typedef struct Interned
+{
+    /* upper half of the string's hash, to skip most strcmp's */
+    uint32_t hash;
+    uint32_t id;
+    char str[];
+} Interned;
+
+/* Open addressing hash table of interned strings */
+typedef struct InternShard
+{
+    pthread_mutex_t lock;
+    /* capacity slots, a power of two, NULL if empty */
+    Interned **slots;
+    size_t capacity;
+    size_t count;
+    /* arena the strings of this shard are stored in */
+    Pkg_Arena *arena;
+} InternShard;
+
+struct Pkg_InternTable
+{
+    InternShard shards[INTERN_SHARD_COUNT];
+    atomic_uint next_id;
+};
+
+/* Pkg_InternTable Functions */
+Pkg_InternTable *
+Pkg_InitInternTable()
+{
+    Pkg_InternTable *table = \
+        (Pkg_InternTable *)malloc(sizeof(Pkg_InternTable));
+    assert(table);
+    for (int i = 0; i < INTERN_SHARD_COUNT; ++i)
+    {
+        InternShard *shard = &table->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->slots = NULL;
+        shard->capacity = 0;
+        shard->count = 0;
+        shard->arena = Pkg_InitArena();
+    }
+    atomic_init(&table->next_id, 0);
+    return table;
+}
+
+void
+Pkg_FreeInternTable(Pkg_InternTable *table)
+{
+    for (int i = 0; i < INTERN_SHARD_COUNT; ++i)
+    {
+        InternShard *shard = &table->shards[i];
+        pthread_mutex_destroy(&shard->lock);
+        if (shard->slots) free(shard->slots);
+        Pkg_FreeArena(shard->arena);
+    }
+    free(table);
+}
+
+/*
+ * Returns the slot str belongs in, which is either empty or holds str
+ */
+static inline Interned **
+findSlot(
+    InternShard *shard,
+    uint64_t hash,
+    const char *str,
+    size_t len)
+{
+    size_t mask = shard->capacity - 1;
+    size_t index = (size_t)(hash >> INTERN_SHARD_BITS) & mask;
+    uint32_t tag = (uint32_t)(hash >> 32);
+    for (;;)
+    {
+        Interned *entry = shard->slots[index];
+        if (!entry) return &shard->slots[index];
+        if (entry->hash == tag &&
+            0 == strncmp(entry->str, str, len) &&
+            '\0' == entry->str[len])
+        {
+            return &shard->slots[index];
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void
+growShard(InternShard *shard)
+{
+    Interned **old_slots = shard->slots;
+    size_t old_capacity = shard->capacity;
+    shard->capacity = old_capacity ? old_capacity * 2 : 64;
+    shard->slots = (Interned **)calloc(shard->capacity, sizeof(Interned *));
+    assert(shard->slots);
+    size_t mask = shard->capacity - 1;
+    for (size_t i = 0; i < old_capacity; ++i)
+    {
+        Interned *entry = old_slots[i];
+        if (!entry) continue;
+        uint64_t hash = pkgHash(entry->str, strlen(entry->str));
+        size_t index = (size_t)(hash >> INTERN_SHARD_BITS) & mask;
+        while (shard->slots[index]) index = (index + 1) & mask;
+        shard->slots[index] = entry;
+    }
+    if (old_slots) free(old_slots);
+}
+
+const char *
+Pkg_InternN(Pkg_InternTable *table, const char *str, size_t len)
+{
+    uint64_t hash = pkgHash(str, len);
+    InternShard *shard = &table->shards[hash & (INTERN_SHARD_COUNT - 1)];
+
+    pthread_mutex_lock(&shard->lock);
+    /* Keep the load factor below 3/4 */
+    if (4 * (shard->count + 1) > 3 * shard->capacity)
+    {
+        growShard(shard);
+    }
+    Interned **slot = findSlot(shard, hash, str, len);
+    if (!*slot)
+    {
+        Interned *entry = (Interned *)Pkg_ArenaAlloc(
+            shard->arena, offsetof(Interned, str) + len + 1);
+        entry->hash = (uint32_t)(hash >> 32);
+        entry->id = atomic_fetch_add(&table->next_id, 1);
+        memcpy(entry->str, str, len);
+        entry->str[len] = '\0';
+        *slot = entry;
+        shard->count++;
+    }
+    const char *result = (*slot)->str;
+    pthread_mutex_unlock(&shard->lock);
+    return result;
+}
+
+const char *
+Pkg_Intern(Pkg_InternTable *table, const char *str)
+{
+    return Pkg_InternN(table, str, strlen(str));
+}
+
+const char *
+Pkg_InternLookup(Pkg_InternTable *table, const char *str)
+{
+    size_t len = strlen(str);
+    uint64_t hash = pkgHash(str, len);
+    InternShard *shard = &table->shards[hash & (INTERN_SHARD_COUNT - 1)];
+
+    const char *result = NULL;
+    pthread_mutex_lock(&shard->lock);
+    if (shard->capacity)
+    {
+        Interned *entry = *findSlot(shard, hash, str, len);
+        if (entry) result = entry->str;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return result;
+}
+
+unsigned int
+Pkg_InternId(const char *interned)
+{
+    const Interned *entry = \
+        (const Interned *)(interned - offsetof(Interned, str));
+    return entry->id;
+}
+
+size_t
+Pkg_InternCount(Pkg_InternTable *table)
+{
+    return atomic_load(&table->next_id);
+}
@@ -0,0 +1,621 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Declarations shared between the translation units of the pkg library.
+ *
+ * Nothing in here is part of the public API.
+ */
+
+#ifndef PACKAGE_MANIFEST_PARSING__INTERNAL_H_
+#define PACKAGE_MANIFEST_PARSING__INTERNAL_H_
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+
+#include <package_manifest_parsing/arena.h>
+#include <package_manifest_parsing/blob.h>
+#include <package_manifest_parsing/cache.h>
+#include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/workspace.h>
+
+/* Growable, NUL terminated scratch buffer */
+typedef struct Buffer
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static inline void
+bufferInit(Buffer *buffer, size_t capacity)
+{
+    buffer->data = (char *)malloc(capacity);
+    assert(buffer->data);
+    buffer->data[0] = '\0';
+    buffer->size = 0;
+    buffer->capacity = capacity;
+}
+
+static inline void
+bufferReset(Buffer *buffer)
+{
+    buffer->size = 0;
+    buffer->data[0] = '\0';
+}
+
+static inline void
+bufferAppend(Buffer *buffer, const char *str, size_t len)
+{
+    if (buffer->size + len + 1 > buffer->capacity)
+    {
+        while (buffer->size + len + 1 > buffer->capacity)
+        {
+            buffer->capacity *= 2;
+        }
+        buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+        assert(buffer->data);
+    }
+    memcpy(buffer->data + buffer->size, str, len);
+    buffer->size += len;
+    buffer->data[buffer->size] = '\0';
+}
+
+/* Growable array the lists of a package are collected in while parsing */
+typedef struct Staging
+{
+    char *items;
+    size_t count;
+    size_t capacity;
+} Staging;
+
+/*
+ * Appends an uninitialized item of item_size bytes and returns it
+ */
+static inline void *
+stagingAppend(Staging *staging, size_t item_size)
+{
+    if (staging->count == staging->capacity)
+    {
+        staging->capacity = staging->capacity ? staging->capacity * 2 : 16;
+        staging->items = (char *)realloc(staging->items,
+                                         staging->capacity * item_size);
+        assert(staging->items);
+    }
+    return staging->items + item_size * staging->count++;
+}
+
+/* The lists of a Pkg_Package, in the order of its members */
+typedef enum StagedList
+{
+    LIST_MAINTAINERS,
+    LIST_LICENSES,
+    LIST_URLS,
+    LIST_AUTHORS,
+    LIST_BUILDTOOL_DEPENDS,
+    LIST_BUILD_DEPENDS,
+    LIST_RUN_DEPENDS,
+    LIST_TEST_DEPENDS,
+    LIST_COUNT
+} StagedList;
+
+/* Tags which may appear as children of the <package> tag
+ *
+ * Covers package format 1 to 3. Tags which Pkg_Package has no place for yet
+ * are recognized, and then reported as "Unknown tag" like any other tag, so
+ * their dependencies are not lost silently.
+ */
+typedef enum ElementTag
+{
+    TAG_NAME,
+    TAG_VERSION,
+    TAG_DESCRIPTION,
+    TAG_MAINTAINER,
+    TAG_LICENSE,
+    TAG_URL,
+    TAG_AUTHOR,
+    TAG_BUILDTOOL_DEPEND,
+    TAG_BUILD_DEPEND,
+    TAG_RUN_DEPEND,
+    TAG_TEST_DEPEND,
+    TAG_EXPORT,
+    TAG_TEXT,
+    /* format 2 and 3 */
+    TAG_DEPEND,
+    TAG_BUILD_EXPORT_DEPEND,
+    TAG_BUILDTOOL_EXPORT_DEPEND,
+    TAG_EXEC_DEPEND,
+    TAG_DOC_DEPEND,
+    TAG_CONFLICT,
+    TAG_REPLACE,
+    TAG_GROUP_DEPEND,
+    TAG_MEMBER_OF_GROUP,
+    TAG_UNKNOWN
+} ElementTag;
+
+/* Identifies a tag by its name, TAG_UNKNOWN if it is not one of the above */
+ElementTag
+pkgLookupTag(const char *name);
+
+/* PKG_FIELD_ filled in by each tag, 0 for tags which fill in nothing */
+extern const unsigned int pkg_element_tag_fields[TAG_UNKNOWN];
+
+/* Fields which are filled in by at most one element */
+#define SINGLE_FIELDS \
+    (PKG_FIELD_NAME | PKG_FIELD_VERSION | PKG_FIELD_DESCRIPTION | \
+     PKG_FIELD_EXPORTS)
+
+/* Attributes of interest on the children of the <package> tag */
+typedef enum ElementAttr
+{
+    ATTR_EMAIL,
+    ATTR_TYPE,
+    ATTR_VERSION_LT,
+    ATTR_VERSION_LTE,
+    ATTR_VERSION_EQ,
+    ATTR_VERSION_GT,
+    ATTR_VERSION_GTE,
+    ATTR_COUNT
+} ElementAttr;
+
+extern const char *pkg_element_attr_names[ATTR_COUNT];
+
+/* A child element of the <package> tag, as extracted by a backend */
+typedef struct Element
+{
+    const char *tag_name;
+    ElementTag tag;
+    /* concatenated text of all descendants */
+    const char *text;
+    /* values of the attributes of interest, NULL if not present */
+    const char *attrs[ATTR_COUNT];
+} Element;
+
+/* Where a backend reads a manifest from */
+typedef struct Input
+{
+    /* name of the manifest, used in messages and as the document URL */
+    const char *name;
+    /* contents of the manifest, NULL to read the file called name */
+    const char *buffer;
+    size_t size;
+} Input;
+
+/* Reusable parsing context, see Pkg_InitParser */
+struct Pkg_Parser
+{
+    Pkg_ParserBackend backend;
+    /* libxml2 parser context, reset and reused for every manifest */
+    xmlParserCtxtPtr ctxt;
+    /* libxml2 streaming reader, created on first use and then reused */
+    xmlTextReaderPtr reader;
+    /* text of the current element */
+    Buffer text;
+    /* attribute values of the current element, see collectAttr */
+    Buffer attrs;
+    size_t attr_offsets[ATTR_COUNT];
+    /* lists of the package being parsed, moved into it once done */
+    Staging lists[LIST_COUNT];
+    /* children of <package> found by the scan backend, see scan.c */
+    Staging elements;
+    /* table names are interned in, NULL to copy them into each package */
+    Pkg_InternTable *names;
+    /* PKG_FIELD_'s to extract, and those found so far in this manifest */
+    unsigned int fields;
+    unsigned int seen_fields;
+};
+
+/*
+ * Whether a backend has to extract an element before pkgHandleElement
+ *
+ * Tags of later formats and unknown ones are always extracted, so that they
+ * are still reported.
+ */
+static inline int
+wantElement(const Pkg_Parser *parser, ElementTag tag)
+{
+    if (tag >= TAG_DEPEND) return 1;
+    return 0 != (parser->fields & pkg_element_tag_fields[tag]);
+}
+
+/*
+ * Whether every requested field is known and the rest of the manifest can
+ * be skipped, only possible if no list was requested
+ */
+static inline int
+allFieldsSeen(const Pkg_Parser *parser)
+{
+    return 0 == (parser->fields & ~SINGLE_FIELDS) &&
+           0 == (parser->fields & ~parser->seen_fields);
+}
+
+/*
+ * Forgets the attribute values collected for the previous element
+ */
+static inline void
+resetAttrs(Pkg_Parser *parser)
+{
+    bufferReset(&parser->attrs);
+    for (int i = 0; i < ATTR_COUNT; ++i)
+    {
+        parser->attr_offsets[i] = (size_t)-1;
+    }
+}
+
+/*
+ * Stores the value of an attribute if it is one of interest
+ */
+static inline void
+collectAttr(Pkg_Parser *parser, const char *name, const char *value)
+{
+    for (int i = 0; i < ATTR_COUNT; ++i)
+    {
+        if (0 == strcmp(pkg_element_attr_names[i], name))
+        {
+            parser->attr_offsets[i] = parser->attrs.size;
+            /* Keep the terminator, the values are stored back to back */
+            bufferAppend(&parser->attrs, value, strlen(value) + 1);
+            return;
+        }
+    }
+}
+
+/*
+ * Points the element's attrs at the values collected so far
+ */
+static inline void
+resolveAttrs(Pkg_Parser *parser, Element *element)
+{
+    for (int i = 0; i < ATTR_COUNT; ++i)
+    {
+        size_t offset = parser->attr_offsets[i];
+        element->attrs[i] = \
+            offset == (size_t)-1 ? NULL : parser->attrs.data + offset;
+    }
+}
+
+/*
+ * Allocates memory owned by pkg, from its arena if it has one
+ */
+static inline void *
+pkgAlloc(Pkg_Package *pkg, size_t size)
+{
+    if (pkg->arena) return Pkg_ArenaAlloc(pkg->arena, size);
+    void *ptr = malloc(size);
+    assert(ptr);
+    return ptr;
+}
+
+static inline char *
+pkgStrndup(Pkg_Package *pkg, const char *str, size_t len)
+{
+    if (pkg->arena) return Pkg_ArenaStrndup(pkg->arena, str, len);
+    return strndup(str, len);
+}
+
+static inline char *
+pkgStrdup(Pkg_Package *pkg, const char *str)
+{
+    if (pkg->arena) return Pkg_ArenaStrdup(pkg->arena, str);
+    return strdup(str);
+}
+
+/*
+ * Returns the malloc'd path of name within dir
+ */
+static inline char *
+pkgJoinPath(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = (char *)malloc(dir_len + name_len + 2);
+    assert(path);
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+static inline Pkg_PersonList *
+initPersonList(Pkg_PersonList *person_list)
+{
+    person_list->email = NULL;
+    person_list->name = NULL;
+    person_list->next = NULL;
+    return person_list;
+}
+
+static inline Pkg_LicenseList *
+initLicenseList(Pkg_LicenseList *license_list)
+{
+    license_list->license = NULL;
+    license_list->next = NULL;
+    return license_list;
+}
+
+static inline Pkg_URLList *
+initURLList(Pkg_URLList *url_list)
+{
+    url_list->url = NULL;
+    url_list->type = PKG_URL_NOT_SET;
+    url_list->next = NULL;
+    return url_list;
+}
+
+static inline Pkg_DependencyList *
+initDependencyList(Pkg_DependencyList *dep_list)
+{
+    dep_list->name = NULL;
+    dep_list->next = NULL;
+    dep_list->constraints = 0;
+    memset(dep_list->version_keys, 0, sizeof(dep_list->version_keys));
+    return dep_list;
+}
+
+/* Initializes libxml2 once per process */
+void
+pkgInitLibXML();
+
+/* Reads a whole file into a malloc'd, NUL terminated buffer, st receives
+ * its stat, returns NULL with errno set on failure */
+char *
+pkgReadFile(const char *path, struct stat *st, size_t *size);
+
+/* Replaces the file at path with size bytes of data, atomically, returns 0
+ * on success */
+int
+pkgWriteFile(const char *path, const void *data, size_t size);
+
+/* Finds the byte range of the last <export> child of the root element of
+ * a well formed document, returns 0 if there is none */
+int
+pkgFindExport(const char *data, size_t size, size_t *offset, size_t *len);
+
+/*
+ * Chains the next pointers of a list through its array
+ */
+static inline void
+chainList(void *items, size_t count, size_t item_size, size_t next_offset)
+{
+    char *bytes = (char *)items;
+    for (size_t i = 0; i < count; ++i)
+    {
+        char *next = NULL;
+        if (i + 1 < count) next = bytes + (i + 1) * item_size;
+        memcpy(bytes + i * item_size + next_offset, &next, sizeof(next));
+    }
+}
+
+/* Sections of a blob, ids are never reused once released */
+typedef enum BlobSectionId
+{
+    SECTION_PACKAGES = 1,
+    SECTION_DEPENDENCIES,
+    SECTION_PERSONS,
+    SECTION_LICENSES,
+    SECTION_URLS,
+    SECTION_STRINGS,
+    /* only in workspace snapshots */
+    SECTION_ROOT,
+    SECTION_INDEX,
+    SECTION_EDGE_OFFSETS,
+    SECTION_EDGES,
+    SECTION_EDGE_KINDS
+} BlobSectionId;
+
+/* An array of count items to store as a section of a blob */
+typedef struct BlobPart
+{
+    BlobSectionId id;
+    const void *items;
+    size_t count;
+    size_t item_size;
+} BlobPart;
+
+/* Same as Pkg_WriteBlob, but also stores the extra sections given */
+int
+pkgWriteBlob(
+    Pkg_Package *const *packages,
+    size_t count,
+    const BlobPart *extras,
+    size_t extra_count,
+    void **data,
+    size_t *size);
+
+/* Points items at the section id of an open blob, holding count items of
+ * item_size bytes, returns 1 if it is missing or malformed */
+int
+pkgBlobFindSection(
+    const Pkg_Blob *blob,
+    BlobSectionId id,
+    size_t item_size,
+    const void **items,
+    size_t *count);
+
+/* Frees what pkg owns and initializes it again, keeping its arena */
+void
+pkgResetPackage(Pkg_Package *pkg);
+
+/* Validates the format attribute of the <package> tag, which may be NULL */
+int
+pkgHandlePackageFormat(Pkg_Package *pkg, const char *format, const char *path);
+
+/* Fills in the part of pkg described by a child element of <package> */
+int
+pkgHandleElement(
+    Pkg_Parser *parser,
+    Pkg_Package *pkg,
+    const Element *element,
+    const char *path);
+
+/* Parses a manifest by building a libxml2 tree */
+int
+pkgParseDom(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg);
+
+/* Parses a manifest with libxml2's streaming reader */
+int
+pkgParseStream(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg);
+
+/* Parses a manifest held in memory with the built-in scanner, falling back
+ * to pkgParseDom */
+int
+pkgParseScan(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg);
+
+/* Returns the semantic_hash of a parsed pkg, normalizing its strings in
+ * scratch, see fingerprint.c */
+uint64_t
+pkgSemanticHash(const Pkg_Package *pkg, Buffer *scratch);
+
+/* Fills pkg from the cache if the entry of path matches st, never for a
+ * cache verifying content, returns 1 on a hit */
+int
+pkgCacheLookup(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    const struct stat *st,
+    Pkg_Package *pkg);
+
+/* Whether pkgCacheLookup would hit for the manifest at path with stat st,
+ * without filling a package, never for a cache verifying content */
+int
+pkgCacheIsFresh(
+    Pkg_Cache *cache,
+    const char *path,
+    const struct stat *st,
+    unsigned int fields);
+
+/* Same as Pkg_CacheParsePackageManifest, for a manifest which was already
+ * read into data, with st as its stat */
+int
+pkgCacheParseBuffer(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    const struct stat *st,
+    const char *data,
+    size_t size,
+    Pkg_Package *pkg);
+
+/* A file read by a Loader */
+typedef struct LoadedFile
+{
+    char *path;
+    /* NUL terminated contents, NULL if the file could not be read */
+    char *data;
+    size_t size;
+    struct stat st;
+    /* 1 if the loader's cache holds the file as of st, it was not read */
+    int fresh;
+    struct LoadedFile *next;
+} LoadedFile;
+
+/* Reads batches of files in the background, see loader.c */
+typedef struct Loader Loader;
+
+/* Starts a Loader, reading through io_uring unless use_threads is set or
+ * the kernel refuses, returns NULL if it has no thread to read with
+ *
+ * With a cache, files are stat'd first and those it holds, with the given
+ * PKG_FIELD_'s, are returned fresh instead of being read, see
+ * pkgCacheIsFresh.
+ */
+Loader *
+pkgStartLoader(int use_threads, Pkg_Cache *cache, unsigned int fields);
+
+/* Queues the files at count paths to be read, the loader takes over the
+ * paths but not the array */
+void
+pkgLoaderSubmit(Loader *loader, char **paths, size_t count);
+
+/* Tells the loader nothing more will be submitted */
+void
+pkgLoaderClose(Loader *loader);
+
+/* Returns the next file which was read, in no particular order
+ *
+ * Without wait, returns NULL if none is ready yet. With wait, blocks until
+ * one is and returns NULL once the loader is closed and every file
+ * submitted was returned.
+ */
+LoadedFile *
+pkgLoaderNext(Loader *loader, int wait);
+
+/* Frees a LoadedFile along with its path and data */
+void
+pkgFreeLoadedFile(LoadedFile *file);
+
+/* Waits for the threads of a closed loader and frees it */
+void
+pkgStopLoader(Loader *loader);
+
+/* Inotify watches on the directories of a workspace, see watch.c */
+typedef struct Watches Watches;
+
+/* Watches dir, or updates its watch, may be called from several threads */
+void
+pkgWatchDirectory(Watches *watches, const char *dir);
+
+/* Same as Pkg_ParseWorkspace, also watching every directory crawled if
+ * watches is set */
+int
+pkgParseWorkspace(
+    const char *root,
+    unsigned int nthreads,
+    Pkg_Workspace *ws,
+    Watches *watches);
+
+/* Returns 1 if name marks its directory as ignored */
+int
+pkgIsIgnoreMarker(const char *name);
+
+/* Returns 1 if the crawler stops at dir, as it has a manifest or an ignore
+ * marker */
+int
+pkgStopsCrawl(const char *dir);
+
+/* Lists dir the way the crawler sees it, returns 0 or the errno of opening
+ * it
+ *
+ * Sets has_manifest if dir is a package, subdirs receives the malloc'd
+ * paths of the directories to crawl next, none below a package or an
+ * ignored directory.
+ */
+int
+pkgListDirectory(
+    const char *dir,
+    int *has_manifest,
+    char ***subdirs,
+    size_t *subdir_count);
+
+/* Orders pointers to packages by filename, for qsort */
+int
+pkgComparePackages(const void *lhs, const void *rhs);
+
+/* Same as Pkg_DiffWorkspaces, for two arrays of packages */
+int
+pkgDiffPackages(
+    Pkg_Package **old_packages,
+    size_t old_count,
+    Pkg_Package **new_packages,
+    size_t new_count,
+    Pkg_WorkspaceDiff *diff);
+
+#endif  /* PACKAGE_MANIFEST_PARSING__INTERNAL_H_ */
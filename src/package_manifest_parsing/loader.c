@@ -0,0 +1,702 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Batched reading of the manifests of a workspace
+ *
+ * The crawler submits manifests as it finds them and takes back their
+ * contents as soon as they are read, so parsing overlaps with the reads
+ * still outstanding. A single thread keeps up to LOADER_DEPTH opens and
+ * reads in flight through io_uring, entering the kernel once per batch of
+ * completions instead of for every open, stat, read and close. Where the
+ * kernel has no io_uring, or a seccomp policy forbids it, LOADER_THREADS
+ * threads read with blocking calls instead. Define PKG_NO_IO_URING to build
+ * the thread pool only.
+ *
+ * With a cache, the loader stats each manifest first and returns those the
+ * cache holds as fresh, without reading them, so a warm crawl never stops
+ * for a stat.
+ *
+ * A file which cannot be read is returned without data, its reader then
+ * tries again on its own, and reports the error.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(PKG_NO_IO_URING) && defined(__linux__)
+# include <sys/syscall.h>
+# if defined(__NR_io_uring_setup) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>
+#   define LOADER_IO_URING 1
+#  endif
+# endif
+#endif
+
+#include "internal.h"
+
+/* Most files read at once through io_uring */
+#define LOADER_DEPTH 64
+/* Threads reading without io_uring */
+#define LOADER_THREADS 16
+/* Largest file read through io_uring, larger ones are left to the thread
+ * taking them, which reads them in pieces as big as read(2) allows */
+#define LOADER_MAX_SIZE (1 << 30)
+
+#ifdef LOADER_IO_URING
+/* The rings shared with the kernel, see io_uring_setup(2) */
+typedef struct Ring
+{
+    int fd;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+    /* entries queued since the kernel was last entered */
+    unsigned int queued;
+} Ring;
+
+/* A file being read through the ring */
+typedef struct Slot
+{
+    /* NULL while the slot is free */
+    char *path;
+    /* -1 while the file is being opened */
+    int fd;
+    char *data;
+    size_t size;
+    size_t capacity;
+    struct stat st;
+} Slot;
+#endif
+
+struct Loader
+{
+    /* guards everything below */
+    pthread_mutex_t lock;
+    /* signaled when a path is submitted or the loader is closed */
+    pthread_cond_t submitted;
+    /* signaled when a file is read, or the last one was returned */
+    pthread_cond_t loaded;
+    /* paths waiting to be read, those before next_path are taken */
+    Staging paths;
+    size_t next_path;
+    /* files read and not returned yet, oldest first */
+    LoadedFile *head;
+    LoadedFile *tail;
+    /* files submitted and not returned yet */
+    size_t outstanding;
+    int closed;
+    /* cache fresh files are looked up in, NULL to read every file */
+    Pkg_Cache *cache;
+    unsigned int fields;
+    pthread_t threads[LOADER_THREADS];
+    unsigned int thread_count;
+#ifdef LOADER_IO_URING
+    Ring ring;
+#endif
+};
+
+/*
+ * Takes the oldest path waiting to be read, with wait blocks until there is
+ * one, returns NULL if there is none and, with wait, the loader is closed
+ */
+static char *
+takePath(Loader *loader, int wait)
+{
+    char *path = NULL;
+    pthread_mutex_lock(&loader->lock);
+    while (wait && loader->next_path == loader->paths.count &&
+           !loader->closed)
+    {
+        pthread_cond_wait(&loader->submitted, &loader->lock);
+    }
+    if (loader->next_path < loader->paths.count)
+    {
+        path = ((char **)loader->paths.items)[loader->next_path++];
+        if (loader->next_path == loader->paths.count)
+        {
+            loader->next_path = 0;
+            loader->paths.count = 0;
+        }
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return path;
+}
+
+/* Files handed over to pkgLoaderNext at once */
+typedef struct Batch
+{
+    LoadedFile *head;
+    LoadedFile *tail;
+    size_t count;
+} Batch;
+
+/*
+ * Adds a file to batch, data is NULL if it could not be read or if it is
+ * fresh
+ */
+static void
+addFile(
+    Batch *batch,
+    char *path,
+    char *data,
+    size_t size,
+    const struct stat *st,
+    int fresh)
+{
+    LoadedFile *file = (LoadedFile *)malloc(sizeof(LoadedFile));
+    assert(file);
+    file->path = path;
+    file->data = data;
+    file->size = data ? size : 0;
+    file->fresh = fresh;
+    if (data || fresh)
+    {
+        file->st = *st;
+    }
+    else
+    {
+        memset(&file->st, 0, sizeof(struct stat));
+    }
+    file->next = NULL;
+    if (batch->tail)
+    {
+        batch->tail->next = file;
+    }
+    else
+    {
+        batch->head = file;
+    }
+    batch->tail = file;
+    batch->count++;
+}
+
+/*
+ * Hands the files of batch over to pkgLoaderNext and empties it, returns 1
+ * if there were any
+ */
+static int
+deliver(Loader *loader, Batch *batch)
+{
+    if (!batch->head) return 0;
+    pthread_mutex_lock(&loader->lock);
+    if (loader->tail)
+    {
+        loader->tail->next = batch->head;
+    }
+    else
+    {
+        loader->head = batch->head;
+    }
+    loader->tail = batch->tail;
+    if (1 == batch->count)
+    {
+        pthread_cond_signal(&loader->loaded);
+    }
+    else
+    {
+        pthread_cond_broadcast(&loader->loaded);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    batch->head = NULL;
+    batch->tail = NULL;
+    batch->count = 0;
+    return 1;
+}
+
+/*
+ * Stats the file at path and adds it to batch if the loader's cache holds
+ * it, returns 1 if it did
+ */
+static int
+addFresh(Loader *loader, Batch *batch, char *path)
+{
+    struct stat st;
+    if (!loader->cache || 0 != stat(path, &st) ||
+        !pkgCacheIsFresh(loader->cache, path, &st, loader->fields))
+    {
+        return 0;
+    }
+    addFile(batch, path, NULL, 0, &st, 1);
+    return 1;
+}
+
+static void *
+readerMain(void *arg)
+{
+    Loader *loader = (Loader *)arg;
+    Batch batch = {NULL, NULL, 0};
+    char *path;
+    while ((path = takePath(loader, 1)))
+    {
+        if (!addFresh(loader, &batch, path))
+        {
+            struct stat st;
+            size_t size;
+            char *data = pkgReadFile(path, &st, &size);
+            addFile(&batch, path, data, size, &st, 0);
+        }
+        deliver(loader, &batch);
+    }
+    return NULL;
+}
+
+#ifdef LOADER_IO_URING
+static void
+freeRing(Ring *ring)
+{
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+    {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map) munmap(ring->sq_map, ring->sq_map_size);
+    if (-1 != ring->fd) close(ring->fd);
+    memset(ring, 0, sizeof(Ring));
+    ring->fd = -1;
+}
+
+static inline void *
+mapRing(int fd, size_t size, off_t offset)
+{
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, offset);
+    return MAP_FAILED == map ? NULL : map;
+}
+
+/*
+ * Sets up a ring with room for entries submissions, returns 1 if the kernel
+ * does not allow io_uring or lacks the operations used
+ */
+static int
+setupRing(Ring *ring, unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        ring->fd = -1;
+        return 1;
+    }
+    /* IORING_OP_OPENAT and IORING_OP_READ came along with this feature, in
+     * Linux 5.6 */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        freeRing(ring);
+        return 1;
+    }
+
+    ring->sq_map_size = \
+        params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_map_size = \
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_map_size > ring->sq_map_size)
+        {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+    ring->sq_map = mapRing(ring->fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+    if (ring->sq_map && (params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring->cq_map = ring->sq_map;
+    } else
+    if (ring->sq_map)
+    {
+        ring->cq_map = mapRing(ring->fd, ring->cq_map_size,
+                               IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (ring->cq_map)
+    {
+        ring->sqes = (struct io_uring_sqe *)mapRing(
+            ring->fd, ring->sqes_size, IORING_OFF_SQES);
+    }
+    if (!ring->sqes)
+    {
+        freeRing(ring);
+        return 1;
+    }
+
+    char *sq = (char *)ring->sq_map;
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    char *cq = (char *)ring->cq_map;
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->queued = 0;
+    return 0;
+}
+
+/*
+ * Queues a cleared submission for slot, there is always room since every
+ * slot has at most one operation in flight
+ */
+static struct io_uring_sqe *
+queueEntry(Ring *ring, Slot *slot)
+{
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = (uint64_t)(uintptr_t)slot;
+    ring->sq_array[index] = index;
+    /* The kernel must see the entry before the new tail */
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    return sqe;
+}
+
+static void
+queueOpen(Ring *ring, Slot *slot)
+{
+    struct io_uring_sqe *sqe = queueEntry(ring, slot);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)slot->path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+/*
+ * Reads what fits into the slot's buffer, leaving room for the terminator
+ */
+static void
+queueRead(Ring *ring, Slot *slot)
+{
+    struct io_uring_sqe *sqe = queueEntry(ring, slot);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->size);
+    sqe->len = (unsigned int)(slot->capacity - 1 - slot->size);
+    sqe->off = slot->size;
+}
+
+/*
+ * Submits what was queued and waits for at least one completion, returns 1
+ * if the ring cannot be used anymore
+ */
+static int
+enterRing(Ring *ring)
+{
+    for (;;)
+    {
+        long ret = syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0)
+        {
+            ring->queued -= (unsigned int)ret;
+            return 0;
+        }
+        if (EINTR == errno) continue;
+        if (EAGAIN == errno || EBUSY == errno)
+        {
+            sched_yield();
+            continue;
+        }
+        return 1;
+    }
+}
+
+/*
+ * Adds the file of a slot to batch, with its data unless failed, and frees
+ * the slot
+ */
+static void
+finishSlot(Batch *batch, Slot *slot, int failed)
+{
+    if (-1 != slot->fd) close(slot->fd);
+    if (failed && slot->data)
+    {
+        free(slot->data);
+        slot->data = NULL;
+    }
+    if (slot->data) slot->data[slot->size] = '\0';
+    addFile(batch, slot->path, slot->data, slot->size, &slot->st, 0);
+    slot->path = NULL;
+}
+
+/*
+ * Moves a slot on after its operation completed with res, returns 1 once
+ * its file was added to batch
+ */
+static int
+completeSlot(Ring *ring, Batch *batch, Slot *slot, int res)
+{
+    if (-1 == slot->fd)
+    {
+        if (res < 0)
+        {
+            finishSlot(batch, slot, 1);
+            return 1;
+        }
+        slot->fd = res;
+        /* The inode was just looked up, so this does not block */
+        if (0 != fstat(slot->fd, &slot->st) ||
+            slot->st.st_size > LOADER_MAX_SIZE)
+        {
+            finishSlot(batch, slot, 1);
+            return 1;
+        }
+        /* One byte more than expected, to see the end in a single read */
+        slot->capacity = (size_t)slot->st.st_size + 2;
+        slot->data = (char *)malloc(slot->capacity);
+        assert(slot->data);
+        slot->size = 0;
+        queueRead(ring, slot);
+        return 0;
+    }
+    if (res < 0)
+    {
+        finishSlot(batch, slot, 1);
+        return 1;
+    }
+    slot->size += (size_t)res;
+    if (slot->size < slot->capacity - 1)
+    {
+        /* A short read, the end of the file */
+        finishSlot(batch, slot, 0);
+        return 1;
+    }
+    /* The file grew since it was opened */
+    slot->capacity *= 2;
+    slot->data = (char *)realloc(slot->data, slot->capacity);
+    assert(slot->data);
+    queueRead(ring, slot);
+    return 0;
+}
+
+static void *
+ringMain(void *arg)
+{
+    Loader *loader = (Loader *)arg;
+    Ring *ring = &loader->ring;
+    Slot slots[LOADER_DEPTH];
+    Slot *free_slots[LOADER_DEPTH];
+    size_t free_count = 0;
+    for (size_t i = 0; i < LOADER_DEPTH; ++i)
+    {
+        slots[i].path = NULL;
+        free_slots[free_count++] = &slots[LOADER_DEPTH - 1 - i];
+    }
+    Batch batch = {NULL, NULL, 0};
+
+    for (;;)
+    {
+        /* Fill the free slots, only waiting for paths if none is busy and
+         * no fresh file is held back */
+        char *path;
+        while (free_count &&
+               (path = takePath(loader, LOADER_DEPTH == free_count &&
+                                        !batch.head)))
+        {
+            if (addFresh(loader, &batch, path)) continue;
+            Slot *slot = free_slots[--free_count];
+            slot->path = path;
+            slot->fd = -1;
+            slot->data = NULL;
+            slot->size = 0;
+            queueOpen(ring, slot);
+        }
+        if (deliver(loader, &batch)) continue;
+        if (LOADER_DEPTH == free_count) break;
+
+        if (enterRing(ring))
+        {
+            /* Give up on the ring, the kernel may still write into the
+             * buffers of busy slots so they are leaked, and their files
+             * are read again by whoever takes them */
+            for (size_t i = 0; i < LOADER_DEPTH; ++i)
+            {
+                if (!slots[i].path) continue;
+                if (-1 != slots[i].fd) close(slots[i].fd);
+                addFile(&batch, slots[i].path, NULL, 0, NULL, 0);
+            }
+            deliver(loader, &batch);
+            return readerMain(loader);
+        }
+
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+            Slot *slot = (Slot *)(uintptr_t)cqe->user_data;
+            if (completeSlot(ring, &batch, slot, cqe->res))
+            {
+                free_slots[free_count++] = slot;
+            }
+            ++head;
+        }
+        /* The kernel may reuse the entries once the head moved past them */
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        deliver(loader, &batch);
+    }
+    return NULL;
+}
+#endif
+
+/* Loader Functions */
+Loader *
+pkgStartLoader(int use_threads, Pkg_Cache *cache, unsigned int fields)
+{
+    Loader *loader = (Loader *)calloc(1, sizeof(Loader));
+    assert(loader);
+    loader->cache = cache;
+    loader->fields = fields;
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->submitted, NULL);
+    pthread_cond_init(&loader->loaded, NULL);
+
+#ifdef LOADER_IO_URING
+    loader->ring.fd = -1;
+    if (!use_threads && 0 == setupRing(&loader->ring, LOADER_DEPTH))
+    {
+        if (0 == pthread_create(&loader->threads[0], NULL,
+                                ringMain, loader))
+        {
+            loader->thread_count = 1;
+            return loader;
+        }
+        freeRing(&loader->ring);
+    }
+#endif
+
+    for (unsigned int i = 0; i < LOADER_THREADS; ++i)
+    {
+        if (0 == pthread_create(&loader->threads[loader->thread_count],
+                                NULL, readerMain, loader))
+        {
+            loader->thread_count++;
+        }
+    }
+    if (0 == loader->thread_count)
+    {
+        pthread_cond_destroy(&loader->loaded);
+        pthread_cond_destroy(&loader->submitted);
+        pthread_mutex_destroy(&loader->lock);
+        free(loader);
+        return NULL;
+    }
+    return loader;
+}
+
+void
+pkgLoaderSubmit(Loader *loader, char **paths, size_t count)
+{
+    pthread_mutex_lock(&loader->lock);
+    for (size_t i = 0; i < count; ++i)
+    {
+        *(char **)stagingAppend(&loader->paths, sizeof(char *)) = paths[i];
+    }
+    loader->outstanding += count;
+    pthread_cond_signal(&loader->submitted);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+void
+pkgLoaderClose(Loader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    loader->closed = 1;
+    pthread_cond_broadcast(&loader->submitted);
+    pthread_cond_broadcast(&loader->loaded);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+LoadedFile *
+pkgLoaderNext(Loader *loader, int wait)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (wait && !loader->head &&
+           !(loader->closed && 0 == loader->outstanding))
+    {
+        pthread_cond_wait(&loader->loaded, &loader->lock);
+    }
+    LoadedFile *file = loader->head;
+    if (file)
+    {
+        loader->head = file->next;
+        if (!loader->head) loader->tail = NULL;
+        file->next = NULL;
+        /* Wake everyone waiting, there is nothing left for them */
+        if (0 == --loader->outstanding && loader->closed)
+        {
+            pthread_cond_broadcast(&loader->loaded);
+        }
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return file;
+}
+
+void
+pkgFreeLoadedFile(LoadedFile *file)
+{
+    if (file->data) free(file->data);
+    free(file->path);
+    free(file);
+}
+
+void
+pkgStopLoader(Loader *loader)
+{
+    for (unsigned int i = 0; i < loader->thread_count; ++i)
+    {
+        pthread_join(loader->threads[i], NULL);
+    }
+#ifdef LOADER_IO_URING
+    if (-1 != loader->ring.fd) freeRing(&loader->ring);
+#endif
+    for (size_t i = loader->next_path; i < loader->paths.count; ++i)
+    {
+        free(((char **)loader->paths.items)[i]);
+    }
+    if (loader->paths.items) free(loader->paths.items);
+    while (loader->head)
+    {
+        LoadedFile *file = loader->head;
+        loader->head = file->next;
+        pkgFreeLoadedFile(file);
+    }
+    pthread_cond_destroy(&loader->loaded);
+    pthread_cond_destroy(&loader->submitted);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader);
+}
@@ -0,0 +1,867 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+#include "hash.h"
+#include "internal.h"
+
+const char *pkg_element_attr_names[ATTR_COUNT] = {
+    "email",
+    "type",
+    "version_lt",
+    "version_lte",
+    "version_eq",
+    "version_gt",
+    "version_gte"
+};
+
+/* Names of the tags, in the order of ElementTag */
+static const char *element_tag_names[TAG_UNKNOWN] = {
+    "name",
+    "version",
+    "description",
+    "maintainer",
+    "license",
+    "url",
+    "author",
+    "buildtool_depend",
+    "build_depend",
+    "run_depend",
+    "test_depend",
+    "export",
+    "text",
+    "depend",
+    "build_export_depend",
+    "buildtool_export_depend",
+    "exec_depend",
+    "doc_depend",
+    "conflict",
+    "replace",
+    "group_depend",
+    "member_of_group"
+};
+
+const unsigned int pkg_element_tag_fields[TAG_UNKNOWN] = {
+    PKG_FIELD_NAME,
+    PKG_FIELD_VERSION,
+    PKG_FIELD_DESCRIPTION,
+    PKG_FIELD_MAINTAINERS,
+    PKG_FIELD_LICENSES,
+    PKG_FIELD_URLS,
+    PKG_FIELD_AUTHORS,
+    PKG_FIELD_BUILDTOOL_DEPENDS,
+    PKG_FIELD_BUILD_DEPENDS,
+    PKG_FIELD_RUN_DEPENDS,
+    PKG_FIELD_TEST_DEPENDS,
+    PKG_FIELD_EXPORTS
+    /* the remaining tags fill in nothing */
+};
+
+/* Combines the length and first letter of a tag name, which is enough to
+ * tell all known tags apart, see pkgLookupTag */
+#define TAG_KEY(len, first) (((len) << 5) | ((first) & 0x1f))
+
+ElementTag
+pkgLookupTag(const char *name)
+{
+    size_t len = strlen(name);
+    if (len > 23) return TAG_UNKNOWN;
+    ElementTag tag;
+    switch (TAG_KEY(len, name[0]))
+    {
+        case TAG_KEY(3, 'u'): tag = TAG_URL; break;
+        case TAG_KEY(4, 'n'): tag = TAG_NAME; break;
+        case TAG_KEY(4, 't'): tag = TAG_TEXT; break;
+        case TAG_KEY(6, 'a'): tag = TAG_AUTHOR; break;
+        case TAG_KEY(6, 'd'): tag = TAG_DEPEND; break;
+        case TAG_KEY(6, 'e'): tag = TAG_EXPORT; break;
+        case TAG_KEY(7, 'l'): tag = TAG_LICENSE; break;
+        case TAG_KEY(7, 'r'): tag = TAG_REPLACE; break;
+        case TAG_KEY(7, 'v'): tag = TAG_VERSION; break;
+        case TAG_KEY(8, 'c'): tag = TAG_CONFLICT; break;
+        case TAG_KEY(10, 'd'): tag = TAG_DOC_DEPEND; break;
+        case TAG_KEY(10, 'm'): tag = TAG_MAINTAINER; break;
+        case TAG_KEY(10, 'r'): tag = TAG_RUN_DEPEND; break;
+        case TAG_KEY(11, 'd'): tag = TAG_DESCRIPTION; break;
+        case TAG_KEY(11, 'e'): tag = TAG_EXEC_DEPEND; break;
+        case TAG_KEY(11, 't'): tag = TAG_TEST_DEPEND; break;
+        case TAG_KEY(12, 'b'): tag = TAG_BUILD_DEPEND; break;
+        case TAG_KEY(12, 'g'): tag = TAG_GROUP_DEPEND; break;
+        case TAG_KEY(15, 'm'): tag = TAG_MEMBER_OF_GROUP; break;
+        case TAG_KEY(16, 'b'): tag = TAG_BUILDTOOL_DEPEND; break;
+        case TAG_KEY(19, 'b'): tag = TAG_BUILD_EXPORT_DEPEND; break;
+        case TAG_KEY(23, 'b'): tag = TAG_BUILDTOOL_EXPORT_DEPEND; break;
+        default: return TAG_UNKNOWN;
+    }
+    /* One comparison confirms the candidate */
+    if (0 != memcmp(element_tag_names[tag], name, len)) return TAG_UNKNOWN;
+    return tag;
+}
+
+static pthread_once_t libxml_init_once = PTHREAD_ONCE_INIT;
+
+static void
+initLibXML()
+{
+    /* Test for ABI compatability */
+    LIBXML_TEST_VERSION
+    xmlInitParser();
+}
+
+void
+pkgInitLibXML()
+{
+    pthread_once(&libxml_init_once, initLibXML);
+}
+
+char *
+pkgReadFile(const char *path, struct stat *st, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) return NULL;
+    if (0 != fstat(fd, st))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t capacity = (size_t)st->st_size + 1;
+    char *data = (char *)malloc(capacity);
+    assert(data);
+    *size = 0;
+    for (;;)
+    {
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            data = (char *)realloc(data, capacity);
+            assert(data);
+        }
+        ssize_t ret = read(fd, data + *size, capacity - *size);
+        if (ret < 0 && EINTR == errno) continue;
+        if (ret < 0)
+        {
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        if (0 == ret) break;
+        *size += (size_t)ret;
+    }
+    close(fd);
+    data[*size] = '\0';
+    return data;
+}
+
+int
+pkgWriteFile(const char *path, const void *data, size_t size)
+{
+    /* Write to a file of our own next to the destination and rename it, so
+     * readers never see a partially written file, and concurrent writers
+     * cannot truncate each other's output */
+    size_t path_len = strlen(path);
+    char *tmp_path = (char *)malloc(path_len + 8);
+    assert(tmp_path);
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".XXXXXX", 8);
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0)
+    {
+        free(tmp_path);
+        return 1;
+    }
+    /* mkstemp creates the file private to its owner, the files replaced are
+     * meant to be read by other tools */
+    int ret = fchmod(fd, 0644);
+    const char *next = (const char *)data;
+    size_t left = size;
+    while (!ret && left)
+    {
+        ssize_t written = write(fd, next, left);
+        if (written < 0)
+        {
+            if (EINTR == errno) continue;
+            ret = 1;
+            break;
+        }
+        next += written;
+        left -= (size_t)written;
+    }
+    if (!ret) ret = fsync(fd);
+    if (close(fd)) ret = 1;
+    if (!ret) ret = rename(tmp_path, path);
+    if (ret)
+    {
+        unlink(tmp_path);
+        ret = 1;
+    }
+    free(tmp_path);
+    return ret;
+}
+
+static inline Pkg_PersonList *
+newPersonList(Pkg_Parser *parser, StagedList list)
+{
+    return initPersonList((Pkg_PersonList *)stagingAppend(
+        &parser->lists[list], sizeof(Pkg_PersonList)));
+}
+
+static inline Pkg_LicenseList *
+newLicenseList(Pkg_Parser *parser)
+{
+    return initLicenseList((Pkg_LicenseList *)stagingAppend(
+        &parser->lists[LIST_LICENSES], sizeof(Pkg_LicenseList)));
+}
+
+static inline Pkg_URLList *
+newURLList(Pkg_Parser *parser)
+{
+    return initURLList((Pkg_URLList *)stagingAppend(
+        &parser->lists[LIST_URLS], sizeof(Pkg_URLList)));
+}
+
+static inline Pkg_DependencyList *
+newDependencyList(Pkg_Parser *parser, StagedList list)
+{
+    return initDependencyList((Pkg_DependencyList *)stagingAppend(
+        &parser->lists[list], sizeof(Pkg_DependencyList)));
+}
+
+/*
+ * Copies a staged list into memory owned by pkg and chains its next pointers
+ */
+static void *
+moveList(
+    Pkg_Package *pkg,
+    Staging *staging,
+    size_t item_size,
+    size_t next_offset,
+    size_t *count)
+{
+    *count = staging->count;
+    if (!staging->count) return NULL;
+    char *items = (char *)pkgAlloc(pkg, staging->count * item_size);
+    memcpy(items, staging->items, staging->count * item_size);
+    for (size_t i = 0; i < staging->count; ++i)
+    {
+        char *next = NULL;
+        if (i + 1 < staging->count) next = items + (i + 1) * item_size;
+        memcpy(items + i * item_size + next_offset, &next, sizeof(next));
+    }
+    staging->count = 0;
+    return items;
+}
+
+#define MOVE_LIST(pkg, parser, list, type, member, count) \
+    (pkg)->member = (type *)moveList( \
+        (pkg), &(parser)->lists[list], sizeof(type), offsetof(type, next), \
+        &(pkg)->count)
+
+/*
+ * Moves every staged list into pkg, leaving the staging empty
+ */
+static void
+finishPackage(Pkg_Parser *parser, Pkg_Package *pkg)
+{
+    MOVE_LIST(pkg, parser, LIST_MAINTAINERS, Pkg_PersonList,
+              maintainers, maintainer_count);
+    MOVE_LIST(pkg, parser, LIST_LICENSES, Pkg_LicenseList,
+              licenses, license_count);
+    MOVE_LIST(pkg, parser, LIST_URLS, Pkg_URLList,
+              urls, url_count);
+    MOVE_LIST(pkg, parser, LIST_AUTHORS, Pkg_PersonList,
+              authors, author_count);
+    MOVE_LIST(pkg, parser, LIST_BUILDTOOL_DEPENDS, Pkg_DependencyList,
+              buildtool_depends, buildtool_depend_count);
+    MOVE_LIST(pkg, parser, LIST_BUILD_DEPENDS, Pkg_DependencyList,
+              build_depends, build_depend_count);
+    MOVE_LIST(pkg, parser, LIST_RUN_DEPENDS, Pkg_DependencyList,
+              run_depends, run_depend_count);
+    MOVE_LIST(pkg, parser, LIST_TEST_DEPENDS, Pkg_DependencyList,
+              test_depends, test_depend_count);
+}
+
+static inline int
+str_is_only_zeros(const char *str)
+{
+    for (int i = 0; i < strlen(str); ++i)
+    {
+        if ('0' == str[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline char *
+getContent(
+    Pkg_Package *pkg,
+    const Element *element,
+    const char * path)
+{
+    char *result = pkgStrdup(pkg, element->text);
+    if (!result)
+    {
+        fprintf(stderr,
+                "Failed to strdup content of '<%s>' of %s\n",
+                element->tag_name,
+                path);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Returns the content as a name, interned if the package interns names
+ */
+static inline char *
+getName(Pkg_Package *pkg, const Element *element, const char *path)
+{
+    if (!pkg->names) return getContent(pkg, element, path);
+    return (char *)Pkg_Intern(pkg->names, element->text);
+}
+
+/*
+ * Returns a copy of the attribute owned by pkg or NULL if not set
+ */
+static inline char *
+getProp(Pkg_Package *pkg, const Element *element, ElementAttr attr)
+{
+    if (!element->attrs[attr]) return NULL;
+    return pkgStrdup(pkg, element->attrs[attr]);
+}
+
+static inline int
+handleDepend(
+    Pkg_Parser *parser,
+    Pkg_Package *pkg,
+    StagedList list,
+    const Element *element,
+    const char *path)
+{
+    Pkg_DependencyList *dep = newDependencyList(parser, list);
+    dep->name = getName(pkg, element, path);
+    if (!dep->name) return 1;
+    /* Attributes in the order of Pkg_VersionConstraint */
+    const ElementAttr version_attrs[PKG_VERSION_CONSTRAINT_COUNT] = {
+        ATTR_VERSION_LT,
+        ATTR_VERSION_LTE,
+        ATTR_VERSION_EQ,
+        ATTR_VERSION_GT,
+        ATTR_VERSION_GTE
+    };
+    for (int i = 0; i < PKG_VERSION_CONSTRAINT_COUNT; ++i)
+    {
+        const char *version_str = element->attrs[version_attrs[i]];
+        if (version_str)
+        {
+            Pkg_Version version;
+            if (Pkg_ParseVersion(version_str, &version))
+            {
+                const char *tag_name = element->tag_name;
+                fprintf(
+                    stderr,
+                    "Failed to parse version from the '%s' attribute of the "
+                    "'<%s>%s</%s>' tag in %s: %s\n",
+                    pkg_element_attr_names[version_attrs[i]],
+                    tag_name, dep->name, tag_name, path, version_str);
+                return 1;
+            }
+            dep->version_keys[i] = Pkg_PackVersion(&version);
+            dep->constraints |= PKG_CONSTRAINT_BIT(i);
+        }
+    }
+    return 0;
+}
+
+int
+pkgHandlePackageFormat(Pkg_Package *pkg, const char *format, const char *path)
+{
+    /* Assume format version 1 if not found */
+    pkg->package_format = 1;
+    if (format)
+    {
+        /* The string is only '0's then set it to zero */
+        if (0 != str_is_only_zeros(format))
+        {
+            pkg->package_format = 0;
+        }
+        else
+        {
+            /* Otherwise use atoi to determine the number if it is a number */
+            int pkg_format_num = atoi(format);
+            if (0 == pkg_format_num)
+            {
+                /* If atoi returns 0, then the str was not a number */
+                /* We know this because we checked for it being zero */
+                /* explicitly before choosing to call atoi */
+                /* In which case this is an error */
+                fprintf(
+                    stderr,
+                    "Invalid value in <package> tag's version attribute in "
+                    "%s: %s\n",
+                    path, format);
+                return 1;
+            }
+            pkg->package_format = pkg_format_num;
+        }
+    }
+    /* We don't support anything but package version 1 */
+    /* So if the version isn't 1, error */
+    if (pkg->package_format != 1)
+    {
+        fprintf(
+            stderr,
+            "This parser cannot parse package manifests of version %u "
+            "in %s\n",
+            pkg->package_format, path);
+        return 1;
+    }
+    return 0;
+}
+
+int
+pkgHandleElement(
+    Pkg_Parser *parser,
+    Pkg_Package *pkg,
+    const Element *element,
+    const char *path)
+{
+    const char *tag_name = element->tag_name;
+    if (TAG_UNKNOWN != element->tag)
+    {
+        parser->seen_fields |= pkg_element_tag_fields[element->tag];
+    }
+    switch (element->tag)
+    {
+        case TAG_NAME:
+            /* A repeated tag replaces the content of the earlier one */
+            if (pkg->name && !pkg->arena && !pkg->names) free(pkg->name);
+            pkg->name = getName(pkg, element, path);
+            if (!pkg->name) return 1;
+            break;
+        case TAG_VERSION:
+            if (Pkg_ParseVersion(element->text, &pkg->version))
+            {
+                fprintf(stderr,
+                        "Invalid <version> tag: '%s'\n", element->text);
+                return 1;
+            }
+            break;
+        case TAG_DESCRIPTION:
+            if (pkg->description && !pkg->arena) free(pkg->description);
+            pkg->description = getContent(pkg, element, path);
+            if (!pkg->description) return 1;
+            break;
+        case TAG_MAINTAINER:
+        {
+            Pkg_PersonList *maintainer = \
+                newPersonList(parser, LIST_MAINTAINERS);
+            maintainer->name = getContent(pkg, element, path);
+            if (!maintainer->name) return 1;
+            maintainer->email = getProp(pkg, element, ATTR_EMAIL);
+            break;
+        }
+        case TAG_LICENSE:
+        {
+            Pkg_LicenseList *license = newLicenseList(parser);
+            license->license = getContent(pkg, element, path);
+            if (!license->license) return 1;
+            break;
+        }
+        case TAG_URL:
+        {
+            Pkg_URLList *url = newURLList(parser);
+            url->url = getContent(pkg, element, path);
+            if (!url->url) return 1;
+            const char *url_type = element->attrs[ATTR_TYPE];
+            if (url_type)
+            {
+                if (0 == strcmp("website", url_type))
+                {
+                    url->type = PKG_URL_WEBSITE;
+                } else
+                if (0 == strcmp("bugtracker", url_type))
+                {
+                    url->type = PKG_URL_BUGTRACKER;
+                } else
+                if (0 == strcmp("repository", url_type))
+                {
+                    url->type = PKG_URL_REPOSITORY;
+                }
+                else
+                {
+                    fprintf(stderr,
+                            "Unkown url type '%s' in %s\n", url_type, path);
+                    return 1;
+                }
+            }
+            else
+            {
+                url->type = PKG_URL_NOT_SET;
+            }
+            break;
+        }
+        case TAG_AUTHOR:
+        {
+            Pkg_PersonList *author = newPersonList(parser, LIST_AUTHORS);
+            author->name = getContent(pkg, element, path);
+            if (!author->name) return 1;
+            author->email = getProp(pkg, element, ATTR_EMAIL);
+            break;
+        }
+        case TAG_BUILDTOOL_DEPEND:
+            return handleDepend(parser, pkg, LIST_BUILDTOOL_DEPENDS,
+                                element, path);
+        case TAG_BUILD_DEPEND:
+            return handleDepend(parser, pkg, LIST_BUILD_DEPENDS,
+                                element, path);
+        case TAG_RUN_DEPEND:
+            return handleDepend(parser, pkg, LIST_RUN_DEPENDS,
+                                element, path);
+        case TAG_TEST_DEPEND:
+            return handleDepend(parser, pkg, LIST_TEST_DEPENDS,
+                                element, path);
+        case TAG_EXPORT:
+            /* Sliced out of the input once it is parsed, see sliceExport */
+            break;
+        case TAG_TEXT:
+            /* pass */
+            break;
+        case TAG_DEPEND:
+        case TAG_BUILD_EXPORT_DEPEND:
+        case TAG_BUILDTOOL_EXPORT_DEPEND:
+        case TAG_EXEC_DEPEND:
+        case TAG_DOC_DEPEND:
+        case TAG_CONFLICT:
+        case TAG_REPLACE:
+        case TAG_GROUP_DEPEND:
+        case TAG_MEMBER_OF_GROUP:
+            /* Only valid in formats after 1, which pkgHandlePackageFormat
+             * rejects, and Pkg_Package has nowhere to keep them, so they
+             * are reported rather than silently dropped */
+        case TAG_UNKNOWN:
+        default:
+            fprintf(stderr, "Unknown tag '<%s>' in %s\n", tag_name, path);
+            fprintf(stderr, "Unknown tag content: '%s'\n", element->text);
+            break;
+    }
+    return 0;
+}
+
+/* Pkg_Parser Functions */
+Pkg_Parser *
+Pkg_InitParser()
+{
+    pkgInitLibXML();
+
+    Pkg_Parser *parser = (Pkg_Parser *)malloc(sizeof(Pkg_Parser));
+    parser->backend = PKG_BACKEND_DOM;
+    parser->ctxt = xmlNewParserCtxt();
+    assert(parser->ctxt);
+    parser->reader = NULL;
+    bufferInit(&parser->text, 256);
+    bufferInit(&parser->attrs, 256);
+    resetAttrs(parser);
+    memset(parser->lists, 0, sizeof(parser->lists));
+    memset(&parser->elements, 0, sizeof(parser->elements));
+    parser->names = NULL;
+    parser->fields = PKG_FIELD_ALL;
+    parser->seen_fields = 0;
+    return parser;
+}
+
+void
+Pkg_FreeParser(Pkg_Parser *parser)
+{
+    xmlFreeParserCtxt(parser->ctxt);
+    if (parser->reader) xmlFreeTextReader(parser->reader);
+    free(parser->text.data);
+    free(parser->attrs.data);
+    for (int i = 0; i < LIST_COUNT; ++i)
+    {
+        if (parser->lists[i].items) free(parser->lists[i].items);
+    }
+    if (parser->elements.items) free(parser->elements.items);
+    free(parser);
+}
+
+void
+Pkg_ParserSetBackend(Pkg_Parser *parser, Pkg_ParserBackend backend)
+{
+    parser->backend = backend;
+}
+
+void
+Pkg_ParserSetInternTable(Pkg_Parser *parser, Pkg_InternTable *table)
+{
+    parser->names = table;
+}
+
+void
+Pkg_ParserSetFields(Pkg_Parser *parser, unsigned int fields)
+{
+    parser->fields = fields & PKG_FIELD_ALL;
+}
+
+/*
+ * Copies the <export> tag out of the input, as it appears in the manifest
+ */
+static int
+sliceExport(const Input *input, Pkg_Package *pkg)
+{
+    const char *data = input->buffer;
+    size_t size = input->size;
+    char *file = NULL;
+    if (!data)
+    {
+        /* Only manifests with an <export> tag are read a second time */
+        struct stat st;
+        file = pkgReadFile(input->name, &st, &size);
+        if (!file)
+        {
+            fprintf(stderr,
+                    "Failed to load package manifest %s\n", input->name);
+            return 1;
+        }
+        data = file;
+    }
+
+    int ret = 0;
+    if (pkgFindExport(data, size, &pkg->exports_offset, &pkg->exports_size))
+    {
+        pkg->exports = pkgStrndup(
+            pkg, data + pkg->exports_offset, pkg->exports_size);
+        assert(pkg->exports);
+    }
+    else
+    {
+        fprintf(stderr, "Failed to locate <export> in %s\n", input->name);
+        ret = 1;
+    }
+    if (file) free(file);
+    return ret;
+}
+
+/*
+ * Hands the input to the parser's backend
+ */
+static int
+parseInput(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg)
+{
+    pkg->names = parser->names;
+    pkg->fields = parser->fields;
+    parser->seen_fields = 0;
+
+    /* Put the name into the pkg's filename attribute */
+    pkg->filename = pkgStrdup(pkg, input->name);
+    assert(pkg->filename);
+
+    /* A file is read once, for the content hash, sliceExport and the
+     * scanner, which only works on memory. libxml2 reports files which
+     * cannot be read, and empty ones, which are no error in a buffer. */
+    Input loaded;
+    char *file = NULL;
+    if (!input->buffer)
+    {
+        struct stat st;
+        size_t size;
+        int scan = PKG_BACKEND_SCAN == parser->backend;
+        file = pkgReadFile(input->name, &st, &size);
+        if (!file && scan)
+        {
+            fprintf(stderr,
+                    "Failed to load package manifest %s\n", input->name);
+            return 1;
+        }
+        if (file && !size && !scan)
+        {
+            free(file);
+            file = NULL;
+        }
+        if (file)
+        {
+            loaded.name = input->name;
+            loaded.buffer = file;
+            loaded.size = size;
+            input = &loaded;
+        }
+    }
+
+    /* libxml2 takes the size of memory buffers as an int */
+    if (input->buffer && input->size > INT_MAX)
+    {
+        fprintf(stderr, "Package manifest %s is too large\n", input->name);
+        if (file) free(file);
+        return 1;
+    }
+
+    int ret;
+    switch (parser->backend)
+    {
+        case PKG_BACKEND_STREAM:
+            ret = pkgParseStream(parser, input, pkg);
+            break;
+        case PKG_BACKEND_SCAN:
+            ret = pkgParseScan(parser, input, pkg);
+            break;
+        case PKG_BACKEND_DOM:
+        default:
+            ret = pkgParseDom(parser, input, pkg);
+            break;
+    }
+    /* The scan backend slices it out itself */
+    if (!ret && (parser->seen_fields & PKG_FIELD_EXPORTS) && !pkg->exports)
+    {
+        ret = sliceExport(input, pkg);
+    }
+
+    /* Also done on failure, so that Pkg_FreePackage frees what was parsed */
+    finishPackage(parser, pkg);
+    if (!ret)
+    {
+        if (input->buffer)
+        {
+            pkg->content_hash = pkgFastHash(input->buffer, input->size);
+        }
+        pkg->semantic_hash = pkgSemanticHash(pkg, &parser->text);
+    }
+    if (file) free(file);
+
+    return ret;
+}
+
+int
+Pkg_ParserParsePackageManifest(
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    /* Assert a path */
+    assert(path);
+
+    Input input;
+    input.name = path;
+    input.buffer = NULL;
+    input.size = 0;
+    return parseInput(parser, &input, pkg);
+}
+
+int
+Pkg_ParserParsePackageManifestFromBuffer(
+    Pkg_Parser *parser,
+    const char *buf,
+    size_t len,
+    const char *name,
+    Pkg_Package *pkg)
+{
+    /* Assert a buffer */
+    assert(buf || !len);
+
+    Input input;
+    input.name = name ? name : "<buffer>";
+    /* An empty buffer must still not be mistaken for a file */
+    input.buffer = buf ? buf : "";
+    input.size = len;
+    return parseInput(parser, &input, pkg);
+}
+
+int
+Pkg_ParserParsePackageManifestMapped(
+    Pkg_Parser *parser,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    /* Assert a path */
+    assert(path);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (-1 == fd || 0 != fstat(fd, &st))
+    {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        if (-1 != fd) close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *data = NULL;
+    if (size)
+    {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+    if (MAP_FAILED == data)
+    {
+        fprintf(stderr, "Failed to map package manifest %s\n", path);
+        return 1;
+    }
+
+    int ret = Pkg_ParserParsePackageManifestFromBuffer(
+        parser, (const char *)data, size, path, pkg);
+
+    if (data) munmap(data, size);
+    return ret;
+}
+
+int
+Pkg_ParsePackageManifest(const char *path, Pkg_Package *pkg)
+{
+    Pkg_Parser *parser = Pkg_InitParser();
+    int ret = Pkg_ParserParsePackageManifest(parser, path, pkg);
+    Pkg_FreeParser(parser);
+    return ret;
+}
+
+int
+Pkg_ParsePackageManifestFromBuffer(
+    const char *buf,
+    size_t len,
+    const char *name,
+    Pkg_Package *pkg)
+{
+    Pkg_Parser *parser = Pkg_InitParser();
+    int ret = Pkg_ParserParsePackageManifestFromBuffer(
+        parser, buf, len, name, pkg);
+    Pkg_FreeParser(parser);
+    return ret;
+}
+
+int
+Pkg_ParsePackageManifestMapped(const char *path, Pkg_Package *pkg)
+{
+    Pkg_Parser *parser = Pkg_InitParser();
+    int ret = Pkg_ParserParsePackageManifestMapped(parser, path, pkg);
+    Pkg_FreeParser(parser);
+    return ret;
+}
@@ -0,0 +1,992 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The scanning parse backend, PKG_BACKEND_SCAN
+ *
+ * Manifests are small, shallow and use little of XML, so most of them can
+ * be read without libxml2. The scanner checks that the whole document is
+ * well formed before any of it reaches pkgHandleElement. A document with
+ * anything it does not handle goes to the DOM backend instead, untouched:
+ * a DOCTYPE, an encoding other than UTF-8, namespaces, non-ASCII names,
+ * deep nesting, and every error. Those get libxml2's results and messages,
+ * the others the same results at a fraction of the cost.
+ *
+ * Runs of plain characters are skipped 16 or 32 bytes at a time with SSE2
+ * or AVX2 where available, see findStop. Define PKG_SCAN_NO_SIMD to build
+ * the scalar version only.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#if !defined(PKG_SCAN_NO_SIMD) && defined(__SSE2__)
+# include <emmintrin.h>
+# define SCAN_SSE2 1
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <immintrin.h>
+#  define SCAN_AVX2 1
+# endif
+#endif
+
+#include "internal.h"
+
+/* Deepest nesting of elements scanned, libxml2 reads anything deeper */
+#define SCAN_MAX_DEPTH 32
+/* Most attributes on one element scanned */
+#define SCAN_MAX_ATTRS 16
+/* Largest document scanned, past it libxml2's limits on the length of
+ * text and names without XML_PARSE_HUGE may apply */
+#define SCAN_MAX_SIZE 10000000
+
+/* Bytes a scan stops at: the three in stop, control characters other than
+ * the three in allow, and the bytes of non-ASCII characters. Unused
+ * entries repeat another one, or are ' ' in allow. */
+typedef struct StopSet
+{
+    unsigned char stop[3];
+    unsigned char allow[3];
+} StopSet;
+
+/* Character data, where line ends are normalized */
+static const StopSet text_stops = { { '<', '&', ']' }, { '\t', '\n', ' ' } };
+/* Attribute values, where all whitespace is normalized */
+static const StopSet dquote_stops = { { '"', '<', '&' }, { ' ', ' ', ' ' } };
+static const StopSet squote_stops = { { '\'', '<', '&' }, { ' ', ' ', ' ' } };
+static const StopSet cdata_stops = { { ']', ']', ']' }, { '\t', '\n', ' ' } };
+/* Comments and processing instructions, which are dropped */
+static const StopSet comment_stops = {
+    { '-', '-', '-' }, { '\t', '\n', '\r' }
+};
+static const StopSet pi_stops = { { '?', '?', '?' }, { '\t', '\n', '\r' } };
+
+static inline int
+isStop(const StopSet *set, unsigned char c)
+{
+    if (c == set->stop[0] || c == set->stop[1] || c == set->stop[2])
+    {
+        return 1;
+    }
+    if (c >= 0x20 && c < 0x80) return 0;
+    return c != set->allow[0] && c != set->allow[1] && c != set->allow[2];
+}
+
+static const char *
+findStopScalar(const char *p, const char *end, const StopSet *set)
+{
+    while (p < end && !isStop(set, (unsigned char)*p)) ++p;
+    return p;
+}
+
+#if defined(SCAN_SSE2)
+static const char *
+findStopSSE2(const char *p, const char *end, const StopSet *set)
+{
+    const __m128i stop0 = _mm_set1_epi8((char)set->stop[0]);
+    const __m128i stop1 = _mm_set1_epi8((char)set->stop[1]);
+    const __m128i stop2 = _mm_set1_epi8((char)set->stop[2]);
+    const __m128i allow0 = _mm_set1_epi8((char)set->allow[0]);
+    const __m128i allow1 = _mm_set1_epi8((char)set->allow[1]);
+    const __m128i allow2 = _mm_set1_epi8((char)set->allow[2]);
+    const __m128i space = _mm_set1_epi8(0x20);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        /* Signed, so the bytes of non-ASCII characters are below too */
+        __m128i control = _mm_cmplt_epi8(v, space);
+        __m128i allowed = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, allow0), _mm_cmpeq_epi8(v, allow1)),
+            _mm_cmpeq_epi8(v, allow2));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, stop0), _mm_cmpeq_epi8(v, stop1)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, stop2),
+                         _mm_andnot_si128(allowed, control)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz((unsigned int)mask);
+        p += 16;
+    }
+    return findStopScalar(p, end, set);
+}
+#endif
+
+#if defined(SCAN_AVX2)
+__attribute__((target("avx2")))
+static const char *
+findStopAVX2(const char *p, const char *end, const StopSet *set)
+{
+    const __m256i stop0 = _mm256_set1_epi8((char)set->stop[0]);
+    const __m256i stop1 = _mm256_set1_epi8((char)set->stop[1]);
+    const __m256i stop2 = _mm256_set1_epi8((char)set->stop[2]);
+    const __m256i allow0 = _mm256_set1_epi8((char)set->allow[0]);
+    const __m256i allow1 = _mm256_set1_epi8((char)set->allow[1]);
+    const __m256i allow2 = _mm256_set1_epi8((char)set->allow[2]);
+    const __m256i space = _mm256_set1_epi8(0x20);
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i control = _mm256_cmpgt_epi8(space, v);
+        __m256i allowed = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, allow0),
+                            _mm256_cmpeq_epi8(v, allow1)),
+            _mm256_cmpeq_epi8(v, allow2));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, stop0),
+                            _mm256_cmpeq_epi8(v, stop1)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, stop2),
+                            _mm256_andnot_si256(allowed, control)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return findStopSSE2(p, end, set);
+}
+#endif
+
+/* Returns the first byte of set in [p, end), end if there is none */
+static const char *(*findStop)(const char *, const char *, const StopSet *) =
+    findStopScalar;
+
+static pthread_once_t scan_init_once = PTHREAD_ONCE_INIT;
+
+static void
+initScan()
+{
+#if defined(SCAN_SSE2)
+    findStop = findStopSSE2;
+#endif
+#if defined(SCAN_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) findStop = findStopAVX2;
+#endif
+}
+
+/* A child element of <package>, its strings are offsets into the pool */
+typedef struct ScanElement
+{
+    ElementTag tag;
+    size_t tag_name;
+    size_t text;
+    /* (size_t)-1 for attributes which are not present */
+    size_t attrs[ATTR_COUNT];
+} ScanElement;
+
+typedef struct Scanner
+{
+    const char *cur;
+    const char *end;
+    /* decoded strings, NUL terminated and back to back */
+    Buffer *pool;
+    /* byte range of the last <export> child of the root, NULL if none,
+     * export_end is NULL while it is open */
+    const char *export_begin;
+    const char *export_end;
+} Scanner;
+
+static inline void
+emit(Buffer *out, const char *str, size_t len)
+{
+    if (out && len) bufferAppend(out, str, len);
+}
+
+static inline int
+isSpace(char c)
+{
+    return ' ' == c || '\n' == c || '\t' == c || '\r' == c;
+}
+
+/*
+ * Skips whitespace, returns whether there was any
+ */
+static inline int
+skipSpace(Scanner *s)
+{
+    const char *start = s->cur;
+    while (s->cur < s->end && isSpace(*s->cur)) ++s->cur;
+    return s->cur != start;
+}
+
+static inline int
+startsWith(const Scanner *s, const char *str, size_t len)
+{
+    return (size_t)(s->end - s->cur) >= len && 0 == memcmp(s->cur, str, len);
+}
+
+/*
+ * Returns the length of the character at p, 0 if it is not allowed in XML
+ */
+static size_t
+charLength(const char *p, const char *end)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    size_t left = (size_t)(end - p);
+    if (u[0] < 0x80)
+    {
+        return u[0] >= 0x20 || isSpace((char)u[0]) ? 1 : 0;
+    }
+    if (u[0] < 0xc2) return 0;
+    if (u[0] < 0xe0)
+    {
+        return left >= 2 && 0x80 == (u[1] & 0xc0) ? 2 : 0;
+    }
+    if (u[0] < 0xf0)
+    {
+        if (left < 3 || 0x80 != (u[1] & 0xc0) || 0x80 != (u[2] & 0xc0))
+        {
+            return 0;
+        }
+        uint32_t c = ((uint32_t)(u[0] & 0x0f) << 12) |
+                     ((uint32_t)(u[1] & 0x3f) << 6) | (u[2] & 0x3f);
+        /* Overlong, surrogates and U+FFFE and U+FFFF */
+        if (c < 0x800 || (c >= 0xd800 && c < 0xe000) || c >= 0xfffe)
+        {
+            return 0;
+        }
+        return 3;
+    }
+    /* 0xf8 and up lead no character, above 0xf4 they lead past U+10FFFF */
+    if (u[0] > 0xf4) return 0;
+    if (left < 4 || 0x80 != (u[1] & 0xc0) || 0x80 != (u[2] & 0xc0) ||
+        0x80 != (u[3] & 0xc0))
+    {
+        return 0;
+    }
+    uint32_t c = ((uint32_t)(u[0] & 0x07) << 18) |
+                 ((uint32_t)(u[1] & 0x3f) << 12) |
+                 ((uint32_t)(u[2] & 0x3f) << 6) | (u[3] & 0x3f);
+    return c >= 0x10000 && c <= 0x10ffff ? 4 : 0;
+}
+
+/*
+ * Consumes a character a scan stopped at which is not markup: whitespace,
+ * another control character or a non-ASCII character
+ *
+ * Line ends become \n, and all whitespace a space if normalize_space is
+ * set, as in attribute values. Returns 1 if the character is not allowed.
+ */
+static int
+scanChar(Scanner *s, Buffer *out, int normalize_space)
+{
+    char c = *s->cur;
+    if (isSpace(c))
+    {
+        ++s->cur;
+        if ('\r' == c)
+        {
+            if (s->cur < s->end && '\n' == *s->cur) ++s->cur;
+            c = '\n';
+        }
+        if (normalize_space) c = ' ';
+        emit(out, &c, 1);
+        return 0;
+    }
+    size_t len = charLength(s->cur, s->end);
+    if (!len) return 1;
+    emit(out, s->cur, len);
+    s->cur += len;
+    return 0;
+}
+
+static inline int
+isNameStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || '_' == c;
+}
+
+static inline int
+isNameChar(char c)
+{
+    return isNameStart(c) || (c >= '0' && c <= '9') || '-' == c || '.' == c;
+}
+
+/*
+ * Consumes a name, returns its length or 0 if there is none, or it has a
+ * namespace prefix or non-ASCII characters
+ */
+static size_t
+scanName(Scanner *s)
+{
+    const char *p = s->cur;
+    if (p == s->end || !isNameStart(*p)) return 0;
+    for (++p; p < s->end && isNameChar(*p); ++p);
+    if (p < s->end && (':' == *p || (unsigned char)*p >= 0x80)) return 0;
+    size_t len = (size_t)(p - s->cur);
+    s->cur = p;
+    return len;
+}
+
+/*
+ * Returns the UTF-8 encoding of c in utf8, and its length
+ */
+static size_t
+encodeChar(uint32_t c, char *utf8)
+{
+    if (c < 0x80)
+    {
+        utf8[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800)
+    {
+        utf8[0] = (char)(0xc0 | (c >> 6));
+        utf8[1] = (char)(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000)
+    {
+        utf8[0] = (char)(0xe0 | (c >> 12));
+        utf8[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+        utf8[2] = (char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    utf8[0] = (char)(0xf0 | (c >> 18));
+    utf8[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    utf8[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    utf8[3] = (char)(0x80 | (c & 0x3f));
+    return 4;
+}
+
+static inline int
+isXMLChar(uint32_t c)
+{
+    if (c < 0x20) return '\t' == c || '\n' == c || '\r' == c;
+    return c < 0xd800 || (c >= 0xe000 && c < 0xfffe) ||
+           (c >= 0x10000 && c <= 0x10ffff);
+}
+
+/*
+ * Consumes a character or predefined entity reference, returns 1 for any
+ * other reference
+ */
+static int
+scanReference(Scanner *s, Buffer *out)
+{
+    const char *p = s->cur + 1;
+    size_t left = (size_t)(s->end - p);
+    const char *semi = (const char *)memchr(p, ';', left < 12 ? left : 12);
+    if (!semi || semi == p) return 1;
+    size_t len = (size_t)(semi - p);
+    char utf8[4];
+    size_t utf8_len = 1;
+    if ('#' == p[0])
+    {
+        uint32_t c = 0;
+        size_t i = 1;
+        int hex = len > 1 && 'x' == p[1];
+        if (hex) ++i;
+        if (i == len) return 1;
+        for (; i < len; ++i)
+        {
+            char d = p[i];
+            uint32_t digit;
+            if (d >= '0' && d <= '9')
+            {
+                digit = (uint32_t)(d - '0');
+            } else
+            if (hex && (d | 0x20) >= 'a' && (d | 0x20) <= 'f')
+            {
+                digit = (uint32_t)((d | 0x20) - 'a' + 10);
+            }
+            else
+            {
+                return 1;
+            }
+            c = c * (hex ? 16 : 10) + digit;
+            if (c > 0x10ffff) return 1;
+        }
+        if (!isXMLChar(c)) return 1;
+        utf8_len = encodeChar(c, utf8);
+    } else
+    if (3 == len && 0 == memcmp(p, "amp", 3))
+    {
+        utf8[0] = '&';
+    } else
+    if (2 == len && 0 == memcmp(p, "lt", 2))
+    {
+        utf8[0] = '<';
+    } else
+    if (2 == len && 0 == memcmp(p, "gt", 2))
+    {
+        utf8[0] = '>';
+    } else
+    if (4 == len && 0 == memcmp(p, "apos", 4))
+    {
+        utf8[0] = '\'';
+    } else
+    if (4 == len && 0 == memcmp(p, "quot", 4))
+    {
+        utf8[0] = '"';
+    }
+    else
+    {
+        return 1;
+    }
+    emit(out, utf8, utf8_len);
+    s->cur = semi + 1;
+    return 0;
+}
+
+/*
+ * Consumes character data up to the next markup or the end of the input
+ */
+static int
+scanText(Scanner *s, Buffer *out)
+{
+    for (;;)
+    {
+        const char *stop = findStop(s->cur, s->end, &text_stops);
+        emit(out, s->cur, (size_t)(stop - s->cur));
+        s->cur = stop;
+        if (stop == s->end || '<' == *stop) return 0;
+        if ('&' == *stop)
+        {
+            if (scanReference(s, out)) return 1;
+        } else
+        if (']' == *stop)
+        {
+            /* Not allowed outside of CDATA sections */
+            if (startsWith(s, "]]>", 3)) return 1;
+            emit(out, "]", 1);
+            ++s->cur;
+        }
+        else
+        {
+            if (scanChar(s, out, 0)) return 1;
+        }
+    }
+}
+
+/*
+ * Consumes a CDATA section, s->cur is past "<![CDATA["
+ */
+static int
+scanCData(Scanner *s, Buffer *out)
+{
+    for (;;)
+    {
+        const char *stop = findStop(s->cur, s->end, &cdata_stops);
+        emit(out, s->cur, (size_t)(stop - s->cur));
+        s->cur = stop;
+        if (stop == s->end) return 1;
+        if (']' == *stop)
+        {
+            if (startsWith(s, "]]>", 3))
+            {
+                s->cur += 3;
+                return 0;
+            }
+            emit(out, "]", 1);
+            ++s->cur;
+        }
+        else
+        {
+            if (scanChar(s, out, 0)) return 1;
+        }
+    }
+}
+
+/*
+ * Consumes a comment, s->cur is past "<!--"
+ */
+static int
+skipComment(Scanner *s)
+{
+    for (;;)
+    {
+        s->cur = findStop(s->cur, s->end, &comment_stops);
+        if (s->cur == s->end) return 1;
+        if ('-' == *s->cur)
+        {
+            /* "--" must end the comment */
+            if (startsWith(s, "--", 2))
+            {
+                if (!startsWith(s, "-->", 3)) return 1;
+                s->cur += 3;
+                return 0;
+            }
+            ++s->cur;
+        }
+        else
+        {
+            if (scanChar(s, NULL, 0)) return 1;
+        }
+    }
+}
+
+/*
+ * Consumes a processing instruction, s->cur is past "<?"
+ */
+static int
+skipPI(Scanner *s)
+{
+    const char *target = s->cur;
+    size_t len = scanName(s);
+    /* Only the XML declaration may be called xml */
+    if (!len || (3 == len && 0 == strncasecmp(target, "xml", 3))) return 1;
+    if (!skipSpace(s))
+    {
+        if (!startsWith(s, "?>", 2)) return 1;
+        s->cur += 2;
+        return 0;
+    }
+    for (;;)
+    {
+        s->cur = findStop(s->cur, s->end, &pi_stops);
+        if (s->cur == s->end) return 1;
+        if ('?' == *s->cur)
+        {
+            if (startsWith(s, "?>", 2))
+            {
+                s->cur += 2;
+                return 0;
+            }
+            ++s->cur;
+        }
+        else
+        {
+            if (scanChar(s, NULL, 0)) return 1;
+        }
+    }
+}
+
+/*
+ * Consumes whitespace, comments and processing instructions outside of
+ * the root element
+ */
+static int
+skipMisc(Scanner *s)
+{
+    for (;;)
+    {
+        skipSpace(s);
+        if (startsWith(s, "<!--", 4))
+        {
+            s->cur += 4;
+            if (skipComment(s)) return 1;
+        } else
+        if (startsWith(s, "<?", 2))
+        {
+            s->cur += 2;
+            if (skipPI(s)) return 1;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+}
+
+/*
+ * Consumes an attribute value, decoding it into out unless it is NULL
+ */
+static int
+scanAttrValue(Scanner *s, Buffer *out)
+{
+    char quote = *s->cur++;
+    const StopSet *stops = '"' == quote ? &dquote_stops : &squote_stops;
+    for (;;)
+    {
+        const char *stop = findStop(s->cur, s->end, stops);
+        emit(out, s->cur, (size_t)(stop - s->cur));
+        s->cur = stop;
+        if (stop == s->end || '<' == *stop) return 1;
+        if (quote == *stop)
+        {
+            ++s->cur;
+            return 0;
+        }
+        if ('&' == *stop)
+        {
+            if (scanReference(s, out)) return 1;
+        }
+        else
+        {
+            if (scanChar(s, out, 1)) return 1;
+        }
+    }
+}
+
+/*
+ * Consumes the attributes of a start tag whose name was just consumed, up
+ * to and including its end
+ *
+ * The values of the count attributes called names are decoded into the
+ * pool, with their offsets stored in offsets, the others are only checked.
+ * Sets empty for an empty element tag.
+ */
+static int
+scanAttributes(
+    Scanner *s,
+    const char **names,
+    size_t count,
+    size_t *offsets,
+    int *empty)
+{
+    const char *seen[SCAN_MAX_ATTRS];
+    size_t seen_lens[SCAN_MAX_ATTRS];
+    size_t seen_count = 0;
+    for (;;)
+    {
+        int space = skipSpace(s);
+        if (s->cur == s->end) return 1;
+        if ('>' == *s->cur)
+        {
+            ++s->cur;
+            *empty = 0;
+            return 0;
+        }
+        if ('/' == *s->cur)
+        {
+            if (!startsWith(s, "/>", 2)) return 1;
+            s->cur += 2;
+            *empty = 1;
+            return 0;
+        }
+        if (!space || SCAN_MAX_ATTRS == seen_count) return 1;
+
+        const char *name = s->cur;
+        size_t len = scanName(s);
+        /* A default namespace may come with warnings about its URI */
+        if (!len || (5 == len && 0 == memcmp("xmlns", name, 5))) return 1;
+        for (size_t i = 0; i < seen_count; ++i)
+        {
+            if (len == seen_lens[i] && 0 == memcmp(seen[i], name, len))
+            {
+                return 1;
+            }
+        }
+        seen[seen_count] = name;
+        seen_lens[seen_count++] = len;
+
+        skipSpace(s);
+        if (s->cur == s->end || '=' != *s->cur) return 1;
+        ++s->cur;
+        skipSpace(s);
+        if (s->cur == s->end || ('"' != *s->cur && '\'' != *s->cur))
+        {
+            return 1;
+        }
+        Buffer *out = NULL;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (0 == strncmp(names[i], name, len) && '\0' == names[i][len])
+            {
+                offsets[i] = s->pool->size;
+                out = s->pool;
+                break;
+            }
+        }
+        if (scanAttrValue(s, out)) return 1;
+        if (out) bufferAppend(out, "", 1);
+    }
+}
+
+/*
+ * Records a child element of <package> whose name was just consumed, and
+ * consumes the rest of its start tag
+ *
+ * Points out at where its text goes, NULL if it is not extracted.
+ */
+static int
+beginElement(
+    Pkg_Parser *parser,
+    Scanner *s,
+    const char *name,
+    size_t len,
+    int *empty,
+    Buffer **out)
+{
+    Buffer *pool = s->pool;
+    size_t tag_name = pool->size;
+    bufferAppend(pool, name, len);
+    bufferAppend(pool, "", 1);
+    ElementTag tag = pkgLookupTag(pool->data + tag_name);
+    *out = NULL;
+
+    /* Nothing to copy out of an element whose field was not requested */
+    if (!wantElement(parser, tag))
+    {
+        pool->size = tag_name;
+        pool->data[tag_name] = '\0';
+        return scanAttributes(s, NULL, 0, NULL, empty);
+    }
+
+    ScanElement *element = (ScanElement *)stagingAppend(
+        &parser->elements, sizeof(ScanElement));
+    element->tag = tag;
+    element->tag_name = tag_name;
+    for (int i = 0; i < ATTR_COUNT; ++i) element->attrs[i] = (size_t)-1;
+    /* The <export> tag is taken from the input as is, see sliceExport */
+    if (TAG_EXPORT == tag)
+    {
+        s->export_begin = name - 1;
+        if (scanAttributes(s, NULL, 0, NULL, empty)) return 1;
+        s->export_end = *empty ? s->cur : NULL;
+    }
+    else
+    {
+        if (scanAttributes(s, pkg_element_attr_names, ATTR_COUNT,
+                           element->attrs, empty))
+        {
+            return 1;
+        }
+        if (!*empty) *out = pool;
+    }
+    element->text = pool->size;
+    if (!*out) bufferAppend(pool, "", 1);
+    return 0;
+}
+
+/*
+ * Consumes the content of the root element and its end tag
+ */
+static int
+scanContent(Pkg_Parser *parser, Scanner *s, const char *root, size_t len)
+{
+    /* Names of the open elements, the root's first */
+    const char *names[SCAN_MAX_DEPTH];
+    size_t lens[SCAN_MAX_DEPTH];
+    size_t depth = 1;
+    names[0] = root;
+    lens[0] = len;
+    /* Where the text of the current child of <package> goes, if anywhere */
+    Buffer *out = NULL;
+    for (;;)
+    {
+        if (scanText(s, out)) return 1;
+        if (s->cur == s->end) return 1;
+        ++s->cur;
+        if (startsWith(s, "/", 1))
+        {
+            ++s->cur;
+            const char *name = s->cur;
+            size_t name_len = scanName(s);
+            if (name_len != lens[depth - 1] ||
+                0 != memcmp(name, names[depth - 1], name_len))
+            {
+                return 1;
+            }
+            skipSpace(s);
+            if (s->cur == s->end || '>' != *s->cur) return 1;
+            ++s->cur;
+            if (0 == --depth) return 0;
+            if (1 == depth && out)
+            {
+                bufferAppend(out, "", 1);
+                out = NULL;
+            }
+            if (1 == depth && s->export_begin && !s->export_end)
+            {
+                s->export_end = s->cur;
+            }
+        } else
+        if (startsWith(s, "!--", 3))
+        {
+            s->cur += 3;
+            if (skipComment(s)) return 1;
+        } else
+        if (startsWith(s, "![CDATA[", 8))
+        {
+            s->cur += 8;
+            if (scanCData(s, out)) return 1;
+        } else
+        if (startsWith(s, "?", 1))
+        {
+            ++s->cur;
+            if (skipPI(s)) return 1;
+        }
+        else
+        {
+            const char *name = s->cur;
+            size_t name_len = scanName(s);
+            if (!name_len || SCAN_MAX_DEPTH == depth) return 1;
+            int empty;
+            if (1 == depth)
+            {
+                if (beginElement(parser, s, name, name_len, &empty, &out))
+                {
+                    return 1;
+                }
+            }
+            else
+            {
+                if (scanAttributes(s, NULL, 0, NULL, &empty)) return 1;
+            }
+            if (!empty)
+            {
+                names[depth] = name;
+                lens[depth++] = name_len;
+            }
+        }
+    }
+}
+
+/*
+ * Consumes a pseudo attribute of the XML declaration, returns 1 if it is
+ * malformed
+ */
+static int
+scanDeclValue(Scanner *s, const char **value, size_t *len)
+{
+    skipSpace(s);
+    if (s->cur == s->end || '=' != *s->cur) return 1;
+    ++s->cur;
+    skipSpace(s);
+    if (s->cur == s->end || ('"' != *s->cur && '\'' != *s->cur)) return 1;
+    char quote = *s->cur++;
+    const char *end = (const char *)memchr(
+        s->cur, quote, (size_t)(s->end - s->cur));
+    if (!end) return 1;
+    *value = s->cur;
+    *len = (size_t)(end - s->cur);
+    s->cur = end + 1;
+    return 0;
+}
+
+/*
+ * Checks the XML declaration, s->cur is past "<?xml" and whitespace
+ */
+static int
+scanXMLDecl(Scanner *s)
+{
+    const char *value;
+    size_t len;
+    if (!startsWith(s, "version", 7)) return 1;
+    s->cur += 7;
+    if (scanDeclValue(s, &value, &len) ||
+        3 != len || 0 != memcmp("1.0", value, 3))
+    {
+        return 1;
+    }
+    int space = skipSpace(s);
+    if (space && startsWith(s, "encoding", 8))
+    {
+        s->cur += 8;
+        /* Anything else is converted by libxml2 */
+        if (scanDeclValue(s, &value, &len) ||
+            5 != len || 0 != strncasecmp("UTF-8", value, 5))
+        {
+            return 1;
+        }
+        space = skipSpace(s);
+    }
+    if (space && startsWith(s, "standalone", 10))
+    {
+        s->cur += 10;
+        if (scanDeclValue(s, &value, &len) ||
+            !((3 == len && 0 == memcmp("yes", value, 3)) ||
+              (2 == len && 0 == memcmp("no", value, 2))))
+        {
+            return 1;
+        }
+        skipSpace(s);
+    }
+    if (!startsWith(s, "?>", 2)) return 1;
+    s->cur += 2;
+    return 0;
+}
+
+/*
+ * Scans the whole document, recording the children of <package> in the
+ * parser's elements, with their strings and the format attribute in the
+ * pool
+ *
+ * Returns 1 if the document is left to libxml2.
+ */
+static int
+scanDocument(Pkg_Parser *parser, Scanner *s, size_t *format)
+{
+    if (s->end - s->cur > SCAN_MAX_SIZE) return 1;
+    if (startsWith(s, "\xef\xbb\xbf", 3)) s->cur += 3;
+    if (startsWith(s, "<?xml", 5) && s->end - s->cur > 5 &&
+        isSpace(s->cur[5]))
+    {
+        s->cur += 5;
+        skipSpace(s);
+        if (scanXMLDecl(s)) return 1;
+    }
+    if (skipMisc(s)) return 1;
+
+    /* The root element, as the other backends accept it */
+    if (!startsWith(s, "<", 1)) return 1;
+    ++s->cur;
+    const char *root = s->cur;
+    size_t len = scanName(s);
+    if (len < 7 || 0 != memcmp("package", root, 7)) return 1;
+    const char *format_name[] = { "format" };
+    *format = (size_t)-1;
+    int empty;
+    if (scanAttributes(s, format_name, 1, format, &empty)) return 1;
+    if (!empty && scanContent(parser, s, root, len)) return 1;
+
+    if (skipMisc(s)) return 1;
+    return s->cur != s->end;
+}
+
+int
+pkgParseScan(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg)
+{
+    pthread_once(&scan_init_once, initScan);
+    assert(input->buffer);
+
+    Scanner s;
+    s.cur = input->buffer;
+    s.end = input->buffer + input->size;
+    s.pool = &parser->text;
+    s.export_begin = NULL;
+    s.export_end = NULL;
+    bufferReset(&parser->text);
+    parser->elements.count = 0;
+    size_t format;
+    if (scanDocument(parser, &s, &format))
+    {
+        /* libxml2 has the final word on anything out of the ordinary */
+        return pkgParseDom(parser, input, pkg);
+    }
+
+    const char *path = input->name;
+    const char *pool = parser->text.data;
+    int ret = pkgHandlePackageFormat(
+        pkg, (size_t)-1 == format ? NULL : pool + format, path);
+    if (ret) return ret;
+
+    const ScanElement *elements = (const ScanElement *)parser->elements.items;
+    for (size_t i = 0; i < parser->elements.count; ++i)
+    {
+        Element element;
+        element.tag = elements[i].tag;
+        element.tag_name = pool + elements[i].tag_name;
+        element.text = pool + elements[i].text;
+        for (int a = 0; a < ATTR_COUNT; ++a)
+        {
+            size_t offset = elements[i].attrs[a];
+            element.attrs[a] = (size_t)-1 == offset ? NULL : pool + offset;
+        }
+        if (pkgHandleElement(parser, pkg, &element, path)) return 1;
+    }
+
+    /* Spares sliceExport from looking for it again */
+    if (s.export_begin)
+    {
+        pkg->exports_offset = (size_t)(s.export_begin - input->buffer);
+        pkg->exports_size = (size_t)(s.export_end - s.export_begin);
+        pkg->exports = pkgStrndup(
+            pkg, s.export_begin, pkg->exports_size);
+        assert(pkg->exports);
+    }
+    return 0;
+}
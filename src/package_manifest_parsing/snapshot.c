@@ -0,0 +1,339 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/blob.h>
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/snapshot.h>
+#include <package_manifest_parsing/workspace.h>
+
+#include "hash.h"
+#include "internal.h"
+
+/* The name index is an open addressing table of vertices, PKG_BLOB_NULL if
+ * empty, probed linearly from pkgHash of the name. Its capacity is a power
+ * of two, at least twice the number of packages. Names which appear more
+ * than once are found as their first package.
+ */
+
+static size_t
+indexCapacity(size_t count)
+{
+    size_t capacity = 16;
+    while (capacity < 2 * count) capacity *= 2;
+    return capacity;
+}
+
+/*
+ * Returns the slot name is in, or should go into if it is not indexed
+ */
+static size_t
+findSlot(
+    const uint32_t *index,
+    size_t capacity,
+    const char *name,
+    const char *(*nameOf)(const void *, uint32_t),
+    const void *context)
+{
+    size_t mask = capacity - 1;
+    size_t slot = (size_t)pkgHash(name, strlen(name)) & mask;
+    for (size_t probes = 0; probes < capacity; ++probes)
+    {
+        uint32_t vertex = index[slot];
+        if (PKG_BLOB_NULL == vertex) return slot;
+        const char *other = nameOf(context, vertex);
+        if (other && 0 == strcmp(other, name)) return slot;
+        slot = (slot + 1) & mask;
+    }
+    return capacity;
+}
+
+static const char *
+packageName(const void *context, uint32_t vertex)
+{
+    const Pkg_Workspace *ws = (const Pkg_Workspace *)context;
+    return ws->packages[vertex]->name;
+}
+
+static const char *
+snapshotName(const void *context, uint32_t vertex)
+{
+    const Pkg_Blob *blob = (const Pkg_Blob *)context;
+    if (vertex >= blob->package_count) return NULL;
+    return Pkg_BlobGetString(blob, blob->packages[vertex].name);
+}
+
+int
+Pkg_WriteSnapshot(const Pkg_Workspace *ws, const char *path)
+{
+    size_t count = ws->package_count;
+    if (count >= PKG_BLOB_NULL)
+    {
+        fprintf(stderr, "Too many packages to fit into a snapshot\n");
+        return 1;
+    }
+
+    size_t capacity = indexCapacity(count);
+    uint32_t *index = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    assert(index);
+    for (size_t i = 0; i < capacity; ++i) index[i] = PKG_BLOB_NULL;
+    for (size_t v = 0; v < count; ++v)
+    {
+        const char *name = ws->packages[v]->name;
+        if (!name) continue;
+        size_t slot = findSlot(index, capacity, name, packageName, ws);
+        if (PKG_BLOB_NULL == index[slot]) index[slot] = (uint32_t)v;
+    }
+
+    /* Each dependency is one edge, with the kinds it was declared as */
+    uint32_t *offsets = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+    assert(offsets);
+    Staging edges = { NULL, 0, 0 };
+    Staging kinds = { NULL, 0, 0 };
+    /* where the edge of the current vertex to each vertex is, if any */
+    size_t *edge_of = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    assert(edge_of);
+    for (size_t v = 0; v < count; ++v) edge_of[v] = SIZE_MAX;
+    int overflow = 0;
+    for (size_t v = 0; v < count; ++v)
+    {
+        size_t first = edges.count;
+        offsets[v] = (uint32_t)first;
+        for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+        {
+            size_t dep_count;
+            const Pkg_DependencyList *deps = Pkg_GetDependencies(
+                ws->packages[v], (Pkg_DependencyType)type, &dep_count);
+            for (size_t i = 0; i < dep_count; ++i)
+            {
+                if (!deps[i].name) continue;
+                size_t slot = findSlot(
+                    index, capacity, deps[i].name, packageName, ws);
+                uint32_t target = index[slot];
+                if (PKG_BLOB_NULL == target) continue;
+                size_t edge = edge_of[target];
+                if (SIZE_MAX == edge || edge < first)
+                {
+                    edge_of[target] = edges.count;
+                    *(uint32_t *)stagingAppend(&edges, sizeof(uint32_t)) = \
+                        target;
+                    *(uint8_t *)stagingAppend(&kinds, sizeof(uint8_t)) = \
+                        (uint8_t)PKG_DEPEND_BIT(type);
+                }
+                else
+                {
+                    ((uint8_t *)kinds.items)[edge] |= PKG_DEPEND_BIT(type);
+                }
+            }
+        }
+        if (edges.count >= PKG_BLOB_NULL) overflow = 1;
+    }
+    offsets[count] = (uint32_t)edges.count;
+    free(edge_of);
+
+    int ret = 1;
+    if (overflow)
+    {
+        fprintf(stderr, "Too many dependencies to fit into a snapshot\n");
+    }
+    else
+    {
+        const char *root = ws->root ? ws->root : "";
+        BlobPart extras[] = {
+            { SECTION_ROOT, root, strlen(root) + 1, 1 },
+            { SECTION_INDEX, index, capacity, sizeof(uint32_t) },
+            { SECTION_EDGE_OFFSETS, offsets, count + 1, sizeof(uint32_t) },
+            { SECTION_EDGES, edges.items, edges.count, sizeof(uint32_t) },
+            { SECTION_EDGE_KINDS, kinds.items, kinds.count, sizeof(uint8_t) }
+        };
+        void *data;
+        size_t size;
+        if (0 == pkgWriteBlob(ws->packages, count,
+                              extras, sizeof(extras) / sizeof(extras[0]),
+                              &data, &size))
+        {
+            ret = pkgWriteFile(path, data, size);
+            if (ret)
+            {
+                fprintf(stderr, "Failed to write snapshot %s\n", path);
+            }
+            free(data);
+        }
+    }
+
+    if (edges.items) free(edges.items);
+    if (kinds.items) free(kinds.items);
+    free(offsets);
+    free(index);
+    return ret;
+}
+
+/* Pkg_Snapshot Functions */
+static void
+clearSnapshot(Pkg_Snapshot *snapshot)
+{
+    memset(snapshot, 0, sizeof(Pkg_Snapshot));
+}
+
+Pkg_Snapshot *
+Pkg_InitSnapshot()
+{
+    Pkg_Snapshot *snapshot = (Pkg_Snapshot *)malloc(sizeof(Pkg_Snapshot));
+    assert(snapshot);
+    clearSnapshot(snapshot);
+    return snapshot;
+}
+
+static void
+closeSnapshot(Pkg_Snapshot *snapshot)
+{
+    if (snapshot->map) munmap(snapshot->map, snapshot->map_size);
+    clearSnapshot(snapshot);
+}
+
+void
+Pkg_FreeSnapshot(Pkg_Snapshot *snapshot)
+{
+    closeSnapshot(snapshot);
+    free(snapshot);
+}
+
+/*
+ * Points the snapshot at the sections beyond the packages, returns 1 if
+ * any is missing or inconsistent with the others
+ */
+static int
+openSections(Pkg_Snapshot *snapshot)
+{
+    const Pkg_Blob *blob = &snapshot->blob;
+    const void *items;
+    size_t count;
+
+    if (pkgBlobFindSection(blob, SECTION_ROOT, 1, &items, &count) ||
+        !count || '\0' != ((const char *)items)[count - 1])
+    {
+        return 1;
+    }
+    snapshot->root = (const char *)items;
+
+    if (pkgBlobFindSection(blob, SECTION_INDEX, sizeof(uint32_t),
+                           &items, &count) ||
+        count < 2 * blob->package_count || (count & (count - 1)))
+    {
+        return 1;
+    }
+    snapshot->index = (const uint32_t *)items;
+    snapshot->index_capacity = count;
+
+    if (pkgBlobFindSection(blob, SECTION_EDGE_OFFSETS, sizeof(uint32_t),
+                           &items, &count) ||
+        count != blob->package_count + 1)
+    {
+        return 1;
+    }
+    snapshot->edge_offsets = (const uint32_t *)items;
+
+    if (pkgBlobFindSection(blob, SECTION_EDGES, sizeof(uint32_t),
+                           &items, &count))
+    {
+        return 1;
+    }
+    snapshot->edges = (const uint32_t *)items;
+    snapshot->edge_count = count;
+
+    if (pkgBlobFindSection(blob, SECTION_EDGE_KINDS, sizeof(uint8_t),
+                           &items, &count) ||
+        count != snapshot->edge_count)
+    {
+        return 1;
+    }
+    snapshot->edge_kinds = (const uint8_t *)items;
+    return 0;
+}
+
+int
+Pkg_OpenSnapshot(Pkg_Snapshot *snapshot, const char *path)
+{
+    closeSnapshot(snapshot);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (-1 == fd || 0 != fstat(fd, &st) || 0 == st.st_size)
+    {
+        fprintf(stderr, "Failed to open snapshot %s\n", path);
+        if (-1 != fd) close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    /* Shared, so every process reading the snapshot uses the same pages */
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+    if (MAP_FAILED == map)
+    {
+        fprintf(stderr, "Failed to map snapshot %s\n", path);
+        return 1;
+    }
+    snapshot->map = map;
+    snapshot->map_size = size;
+
+    if (Pkg_OpenBlob(&snapshot->blob, map, size) || openSections(snapshot))
+    {
+        fprintf(stderr, "Invalid snapshot %s\n", path);
+        closeSnapshot(snapshot);
+        return 1;
+    }
+    return 0;
+}
+
+size_t
+Pkg_SnapshotFindPackage(const Pkg_Snapshot *snapshot, const char *name)
+{
+    if (!snapshot->index) return PKG_SNAPSHOT_NOT_FOUND;
+    size_t slot = findSlot(snapshot->index, snapshot->index_capacity,
+                           name, snapshotName, &snapshot->blob);
+    if (slot == snapshot->index_capacity) return PKG_SNAPSHOT_NOT_FOUND;
+    uint32_t vertex = snapshot->index[slot];
+    if (PKG_BLOB_NULL == vertex) return PKG_SNAPSHOT_NOT_FOUND;
+    return vertex;
+}
+
+const uint32_t *
+Pkg_SnapshotGetDependencies(
+    const Pkg_Snapshot *snapshot,
+    size_t vertex,
+    size_t *count,
+    const uint8_t **kinds)
+{
+    *count = 0;
+    if (kinds) *kinds = NULL;
+    if (vertex >= snapshot->blob.package_count) return NULL;
+    uint32_t begin = snapshot->edge_offsets[vertex];
+    uint32_t end = snapshot->edge_offsets[vertex + 1];
+    if (begin >= end || end > snapshot->edge_count) return NULL;
+    *count = end - begin;
+    if (kinds) *kinds = snapshot->edge_kinds + begin;
+    return snapshot->edges + begin;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The streaming parse backend, PKG_BACKEND_STREAM
+ *
+ * Walks the manifest with libxml2's xmlTextReader, so no tree is ever built
+ * for the document.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libxml/xmlreader.h>
+
+#include "internal.h"
+
+static inline void
+appendValue(Pkg_Parser *parser, const xmlChar *value)
+{
+    if (value)
+    {
+        bufferAppend(&parser->text, (char *)value, strlen((char *)value));
+    }
+}
+
+/*
+ * Moves the reader to the end of the element it is on, without looking at
+ * its contents
+ */
+static int
+skipElement(xmlTextReaderPtr reader, const char *path)
+{
+    if (xmlTextReaderIsEmptyElement(reader)) return 0;
+    int depth = xmlTextReaderDepth(reader);
+    int ret;
+    while (1 == (ret = xmlTextReaderRead(reader)))
+    {
+        if (XML_READER_TYPE_END_ELEMENT == xmlTextReaderNodeType(reader) &&
+            depth == xmlTextReaderDepth(reader))
+        {
+            return 0;
+        }
+    }
+    fprintf(stderr, "Failed to load package manifest %s\n", path);
+    return 1;
+}
+
+/*
+ * Fills in pkg from the child element of <package> the reader is on
+ *
+ * Leaves the reader on the end of the element.
+ */
+static int
+handleElement(
+    Pkg_Parser *parser,
+    xmlTextReaderPtr reader,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    Element element;
+    /* Names live in the reader's dictionary, so they outlive the node */
+    element.tag_name = (const char *)xmlTextReaderConstLocalName(reader);
+    element.tag = pkgLookupTag(element.tag_name);
+
+    /* Nothing to copy out of an element whose field was not requested */
+    if (!wantElement(parser, element.tag)) return skipElement(reader, path);
+
+    /* The <export> tag is taken from the input as is, see sliceExport */
+    if (TAG_EXPORT == element.tag)
+    {
+        bufferReset(&parser->text);
+        resetAttrs(parser);
+        element.text = parser->text.data;
+        resolveAttrs(parser, &element);
+        if (skipElement(reader, path)) return 1;
+        return pkgHandleElement(parser, pkg, &element, path);
+    }
+
+    resetAttrs(parser);
+    while (1 == xmlTextReaderMoveToNextAttribute(reader))
+    {
+        collectAttr(parser,
+                    (const char *)xmlTextReaderConstLocalName(reader),
+                    (const char *)xmlTextReaderConstValue(reader));
+    }
+    xmlTextReaderMoveToElement(reader);
+    resolveAttrs(parser, &element);
+
+    bufferReset(&parser->text);
+    if (!xmlTextReaderIsEmptyElement(reader))
+    {
+        int depth = xmlTextReaderDepth(reader);
+        int ret;
+        while (1 == (ret = xmlTextReaderRead(reader)))
+        {
+            int type = xmlTextReaderNodeType(reader);
+            if (XML_READER_TYPE_END_ELEMENT == type &&
+                depth == xmlTextReaderDepth(reader))
+            {
+                break;
+            }
+            switch (type)
+            {
+                case XML_READER_TYPE_TEXT:
+                case XML_READER_TYPE_CDATA:
+                case XML_READER_TYPE_WHITESPACE:
+                case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+                    appendValue(parser, xmlTextReaderConstValue(reader));
+                    break;
+                case XML_READER_TYPE_ENTITY_REFERENCE:
+                {
+                    /* Rare enough to let libxml2 resolve it */
+                    xmlNode *node = xmlTextReaderExpand(reader);
+                    xmlChar *content = node ? xmlNodeGetContent(node) : NULL;
+                    appendValue(parser, content);
+                    if (content) xmlFree(content);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (1 != ret)
+        {
+            fprintf(stderr, "Failed to load package manifest %s\n", path);
+            return 1;
+        }
+    }
+    element.text = parser->text.data;
+
+    return pkgHandleElement(parser, pkg, &element, path);
+}
+
+static int
+parseReader(
+    Pkg_Parser *parser,
+    xmlTextReaderPtr reader,
+    const char *path,
+    Pkg_Package *pkg)
+{
+    /* Search for the <package> tag */
+    int ret;
+    while (1 == (ret = xmlTextReaderRead(reader)))
+    {
+        if (XML_READER_TYPE_ELEMENT == xmlTextReaderNodeType(reader)) break;
+    }
+    if (-1 == ret)
+    {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        return 1;
+    }
+    /* If <package> not found, error */
+    if (1 != ret)
+    {
+        fprintf(stderr, "Failed to find <package> tag in %s\n", path);
+        return 1;
+    }
+    const char *name = (const char *)xmlTextReaderConstLocalName(reader);
+    if (0 != strncmp("package", name, 7))
+    {
+        fprintf(stderr, "Unknown tag '<%s>' in %s\n", name, path);
+        return 1;
+    }
+
+    /* Look for format attribute of <package> tag */
+    xmlChar *package_format = \
+        xmlTextReaderGetAttribute(reader, (xmlChar *)"format");
+    ret = pkgHandlePackageFormat(pkg, (char *)package_format, path);
+    if (package_format) xmlFree(package_format);
+    if (ret) return ret;
+
+    /* Iterate over all of the tags inside of the <package> tag */
+    if (!xmlTextReaderIsEmptyElement(reader))
+    {
+        while (1 == (ret = xmlTextReaderRead(reader)))
+        {
+            int type = xmlTextReaderNodeType(reader);
+            if (XML_READER_TYPE_END_ELEMENT == type &&
+                0 == xmlTextReaderDepth(reader))
+            {
+                break;
+            }
+            if (XML_READER_TYPE_ELEMENT == type)
+            {
+                if (handleElement(parser, reader, path, pkg)) return 1;
+                /* The rest of the manifest holds nothing requested */
+                if (allFieldsSeen(parser)) return 0;
+            }
+        }
+        if (1 != ret)
+        {
+            fprintf(stderr, "Failed to load package manifest %s\n", path);
+            return 1;
+        }
+    }
+
+    /* Read the rest of the document, which must not contain any tags */
+    while (1 == (ret = xmlTextReaderRead(reader)))
+    {
+        if (XML_READER_TYPE_ELEMENT == xmlTextReaderNodeType(reader))
+        {
+            fprintf(
+                stderr,
+                "Found toplevel tag '<%s>' in %s, "
+                "but only one toplevel <package> tag is allowed\n",
+                (const char *)xmlTextReaderConstLocalName(reader),
+                path);
+            return 1;
+        }
+    }
+    if (-1 == ret)
+    {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Points the parser's reader at the input, creating the reader if needed
+ */
+static int
+openReader(Pkg_Parser *parser, const Input *input)
+{
+    /* Reuse the reader of the previous manifest if there is one */
+    if (parser->reader)
+    {
+        if (input->buffer)
+        {
+            return xmlReaderNewMemory(parser->reader,
+                                      input->buffer, (int)input->size,
+                                      input->name, NULL, 0);
+        }
+        return xmlReaderNewFile(parser->reader, input->name, NULL, 0);
+    }
+    if (input->buffer)
+    {
+        parser->reader = xmlReaderForMemory(input->buffer, (int)input->size,
+                                            input->name, NULL, 0);
+    }
+    else
+    {
+        parser->reader = xmlReaderForFile(input->name, NULL, 0);
+    }
+    return parser->reader ? 0 : -1;
+}
+
+int
+pkgParseStream(Pkg_Parser *parser, const Input *input, Pkg_Package *pkg)
+{
+    const char *path = input->name;
+    if (0 != openReader(parser, input))
+    {
+        fprintf(stderr, "Failed to load package manifest %s\n", path);
+        return 1;
+    }
+
+    int ret = parseReader(parser, parser->reader, path, pkg);
+
+    /* Release the input, the reader itself is kept for the next manifest */
+    xmlTextReaderClose(parser->reader);
+
+    return ret;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <package_manifest_parsing/pkg.h>
+
+#define COMPONENT_SHIFT(i) ((2 - (i)) * PKG_VERSION_COMPONENT_BITS)
+
+static inline int
+isSpace(char c)
+{
+    return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+/* Pkg_Version Functions */
+int
+Pkg_ParseVersion(const char *str, Pkg_Version *version)
+{
+    unsigned int components[3];
+    const char *c = str;
+    while (isSpace(*c)) ++c;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (i && '.' != *c++) return 1;
+        if (*c < '0' || *c > '9') return 1;
+        unsigned int value = 0;
+        for (; *c >= '0' && *c <= '9'; ++c)
+        {
+            value = value * 10 + (unsigned int)(*c - '0');
+            if (value > PKG_VERSION_COMPONENT_MAX) return 1;
+        }
+        components[i] = value;
+    }
+    while (isSpace(*c)) ++c;
+    if ('\0' != *c) return 1;
+
+    version->major = components[0];
+    version->minor = components[1];
+    version->patch = components[2];
+    return 0;
+}
+
+static inline Pkg_VersionKey
+packComponent(unsigned int component, int i)
+{
+    if (component > PKG_VERSION_COMPONENT_MAX)
+    {
+        component = PKG_VERSION_COMPONENT_MAX;
+    }
+    return (Pkg_VersionKey)component << COMPONENT_SHIFT(i);
+}
+
+Pkg_VersionKey
+Pkg_PackVersion(const Pkg_Version *version)
+{
+    return packComponent(version->major, 0) |
+           packComponent(version->minor, 1) |
+           packComponent(version->patch, 2);
+}
+
+void
+Pkg_UnpackVersion(Pkg_VersionKey key, Pkg_Version *version)
+{
+    version->major = \
+        (unsigned int)(key >> COMPONENT_SHIFT(0)) & PKG_VERSION_COMPONENT_MAX;
+    version->minor = \
+        (unsigned int)(key >> COMPONENT_SHIFT(1)) & PKG_VERSION_COMPONENT_MAX;
+    version->patch = \
+        (unsigned int)(key >> COMPONENT_SHIFT(2)) & PKG_VERSION_COMPONENT_MAX;
+}
+
+int
+Pkg_CompareVersions(const Pkg_Version *a, const Pkg_Version *b)
+{
+    Pkg_VersionKey key_a = Pkg_PackVersion(a);
+    Pkg_VersionKey key_b = Pkg_PackVersion(b);
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+unsigned int
+Pkg_DependencyFailedConstraints(
+    const Pkg_DependencyList *dep,
+    Pkg_VersionKey key)
+{
+    const Pkg_VersionKey *keys = dep->version_keys;
+    /* Bits of the constraints which hold, then masked to the set ones */
+    unsigned int satisfied = \
+        (key < keys[PKG_VERSION_LT]) << PKG_VERSION_LT |
+        (key <= keys[PKG_VERSION_LTE]) << PKG_VERSION_LTE |
+        (key == keys[PKG_VERSION_EQ]) << PKG_VERSION_EQ |
+        (key > keys[PKG_VERSION_GT]) << PKG_VERSION_GT |
+        (key >= keys[PKG_VERSION_GTE]) << PKG_VERSION_GTE;
+    return dep->constraints & ~satisfied;
+}
+
+int
+Pkg_DependencyAcceptsKey(const Pkg_DependencyList *dep, Pkg_VersionKey key)
+{
+    unsigned int constraints = dep->constraints;
+    const Pkg_VersionKey *keys = dep->version_keys;
+    if (!constraints) return 1;
+    if ((constraints & PKG_CONSTRAINT_BIT(PKG_VERSION_LT)) &&
+        !(key < keys[PKG_VERSION_LT])) return 0;
+    if ((constraints & PKG_CONSTRAINT_BIT(PKG_VERSION_LTE)) &&
+        !(key <= keys[PKG_VERSION_LTE])) return 0;
+    if ((constraints & PKG_CONSTRAINT_BIT(PKG_VERSION_EQ)) &&
+        !(key == keys[PKG_VERSION_EQ])) return 0;
+    if ((constraints & PKG_CONSTRAINT_BIT(PKG_VERSION_GT)) &&
+        !(key > keys[PKG_VERSION_GT])) return 0;
+    if ((constraints & PKG_CONSTRAINT_BIT(PKG_VERSION_GTE)) &&
+        !(key >= keys[PKG_VERSION_GTE])) return 0;
+    return 1;
+}
+
+int
+Pkg_DependencyAccepts(
+    const Pkg_DependencyList *dep,
+    const Pkg_Version *version)
+{
+    return Pkg_DependencyAcceptsKey(dep, Pkg_PackVersion(version));
+}
@@ -0,0 +1,695 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/watch.h>
+
+#include "internal.h"
+
+/* What a watched directory reports, events about files other than
+ * manifests and ignore markers are dropped once read */
+#define WATCH_EVENTS \
+    (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | \
+     IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/* A burst of events is over once none arrived for WATCH_SETTLE_MS, but it
+ * is cut short after WATCH_SETTLE_ROUNDS of those waits */
+#define WATCH_SETTLE_MS 10
+#define WATCH_SETTLE_ROUNDS 20
+
+struct Watches
+{
+    int fd;
+    pthread_mutex_t lock;
+    /* directory of each watch descriptor, NULL for unused ones */
+    char **dirs;
+    /* generation each watch was last renewed in */
+    unsigned long *stamps;
+    size_t capacity;
+    /* counts the polls which crawled, stale watches are removed after
+     * each */
+    unsigned long generation;
+};
+
+/* Growable array of malloc'd paths */
+typedef struct Paths
+{
+    char **items;
+    size_t count;
+    size_t capacity;
+} Paths;
+
+/* Growable array of packages */
+typedef struct Packages
+{
+    Pkg_Package **items;
+    size_t count;
+    size_t capacity;
+} Packages;
+
+struct Pkg_Watcher
+{
+    Watches watches;
+    /* workspace being watched, NULL until Pkg_WatchWorkspace */
+    Pkg_Workspace *ws;
+    /* parses manifests with the settings of the workspace */
+    Pkg_Parser *parser;
+    Pkg_Graph *graph;
+    /* directories to crawl again, and manifests to parse again, collected
+     * from the events */
+    Paths dirty;
+    Paths written;
+    /* set if inotify dropped events, everything is crawled and parsed
+     * again then */
+    int overflow;
+    /* packages which left the workspace in the last poll, its diff still
+     * points at them */
+    Packages retired;
+};
+
+/* Paths Functions */
+static void
+addPath(Paths *paths, char *path)
+{
+    assert(path);
+    if (paths->count == paths->capacity)
+    {
+        paths->capacity = paths->capacity ? paths->capacity * 2 : 16;
+        paths->items = (char **)realloc(paths->items,
+                                        paths->capacity * sizeof(char *));
+        assert(paths->items);
+    }
+    paths->items[paths->count++] = path;
+}
+
+static void
+clearPaths(Paths *paths)
+{
+    for (size_t i = 0; i < paths->count; ++i) free(paths->items[i]);
+    paths->count = 0;
+}
+
+static int
+comparePaths(const void *lhs, const void *rhs)
+{
+    return strcmp(*(const char **)lhs, *(const char **)rhs);
+}
+
+static void
+sortPaths(Paths *paths)
+{
+    if (paths->count < 2) return;
+    qsort(paths->items, paths->count, sizeof(char *), comparePaths);
+}
+
+/*
+ * Returns 1 if the sorted paths contain path
+ */
+static int
+hasPath(const Paths *paths, const char *path)
+{
+    if (!paths->count) return 0;
+    return NULL != bsearch(&path, paths->items, paths->count,
+                           sizeof(char *), comparePaths);
+}
+
+/*
+ * Returns 1 if the sorted paths contain a directory path is below
+ */
+static int
+hasAncestor(const Paths *paths, const char *path)
+{
+    char *copy = strdup(path);
+    assert(copy);
+    int found = 0;
+    for (char *slash = strrchr(copy, '/'); slash && !found;
+         slash = strrchr(copy, '/'))
+    {
+        *slash = '\0';
+        found = hasPath(paths, copy);
+    }
+    free(copy);
+    return found;
+}
+
+static inline int
+isBelow(const char *path, const char *dir, size_t dir_len)
+{
+    return 0 == strncmp(path, dir, dir_len) &&
+           ('\0' == path[dir_len] || '/' == path[dir_len]);
+}
+
+static void
+addPackage(Packages *packages, Pkg_Package *pkg)
+{
+    if (packages->count == packages->capacity)
+    {
+        packages->capacity = packages->capacity ? packages->capacity * 2 : 16;
+        packages->items = (Pkg_Package **)realloc(
+            packages->items, packages->capacity * sizeof(Pkg_Package *));
+        assert(packages->items);
+    }
+    packages->items[packages->count++] = pkg;
+}
+
+/* Watches Functions */
+void
+pkgWatchDirectory(Watches *watches, const char *dir)
+{
+    int wd = inotify_add_watch(watches->fd, dir, WATCH_EVENTS);
+    if (wd < 0)
+    {
+        /* A directory which is gone again is for the events to report */
+        if (ENOENT != errno && ENOTDIR != errno)
+        {
+            fprintf(stderr, "Failed to watch directory %s: %s\n",
+                    dir, strerror(errno));
+        }
+        return;
+    }
+    pthread_mutex_lock(&watches->lock);
+    if ((size_t)wd >= watches->capacity)
+    {
+        size_t capacity = watches->capacity ? watches->capacity : 64;
+        while ((size_t)wd >= capacity) capacity *= 2;
+        watches->dirs = (char **)realloc(watches->dirs,
+                                         capacity * sizeof(char *));
+        watches->stamps = (unsigned long *)realloc(
+            watches->stamps, capacity * sizeof(unsigned long));
+        assert(watches->dirs && watches->stamps);
+        memset(watches->dirs + watches->capacity, 0,
+               (capacity - watches->capacity) * sizeof(char *));
+        watches->capacity = capacity;
+    }
+    /* A directory moved within the workspace keeps its watch */
+    if (!watches->dirs[wd] || strcmp(watches->dirs[wd], dir))
+    {
+        if (watches->dirs[wd]) free(watches->dirs[wd]);
+        watches->dirs[wd] = strdup(dir);
+        assert(watches->dirs[wd]);
+    }
+    watches->stamps[wd] = watches->generation;
+    pthread_mutex_unlock(&watches->lock);
+}
+
+/*
+ * Removes the watches on dir and below which were not renewed by the
+ * latest crawl, their directories are gone or no longer crawled
+ */
+static void
+unwatchStale(Watches *watches, const char *dir)
+{
+    size_t dir_len = strlen(dir);
+    for (size_t wd = 0; wd < watches->capacity; ++wd)
+    {
+        if (!watches->dirs[wd] ||
+            watches->stamps[wd] == watches->generation ||
+            !isBelow(watches->dirs[wd], dir, dir_len))
+        {
+            continue;
+        }
+        inotify_rm_watch(watches->fd, (int)wd);
+        free(watches->dirs[wd]);
+        watches->dirs[wd] = NULL;
+    }
+}
+
+/*
+ * Turns an event into directories to crawl and manifests to parse
+ */
+static void
+handleEvent(Pkg_Watcher *watcher, const struct inotify_event *event)
+{
+    Watches *watches = &watcher->watches;
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        watcher->overflow = 1;
+        return;
+    }
+    if (event->wd < 0 || (size_t)event->wd >= watches->capacity) return;
+    char *dir = watches->dirs[event->wd];
+    if (!dir) return;
+    if (event->mask & IN_IGNORED)
+    {
+        /* The directory is gone, its parent reports that */
+        free(dir);
+        watches->dirs[event->wd] = NULL;
+        return;
+    }
+    const char *name = event->name;
+    if (!event->len || '.' == name[0]) return;
+    if (0 == strcmp("package.xml", name))
+    {
+        addPath(&watcher->dirty, strdup(dir));
+        addPath(&watcher->written, pkgJoinPath(dir, name));
+    } else
+    if (pkgIsIgnoreMarker(name))
+    {
+        addPath(&watcher->dirty, strdup(dir));
+    } else
+    if (event->mask & IN_ISDIR)
+    {
+        addPath(&watcher->dirty, pkgJoinPath(dir, name));
+    }
+}
+
+static void
+readEvents(Pkg_Watcher *watcher)
+{
+    char buffer[16384]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while (0 < (len = read(watcher->watches.fd, buffer, sizeof(buffer))))
+    {
+        for (char *p = buffer; p < buffer + len;)
+        {
+            const struct inotify_event *event = \
+                (const struct inotify_event *)p;
+            handleEvent(watcher, event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/*
+ * Returns 1 if there are events to read within timeout_ms
+ */
+static int
+waitForEvents(int fd, int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return 1 == poll(&pfd, 1, timeout_ms) && (pfd.revents & POLLIN);
+}
+
+/*
+ * Crawls dir like Pkg_ParseWorkspace does, on this thread, watching every
+ * directory and collecting the manifests in found
+ */
+static void
+crawl(Pkg_Watcher *watcher, const char *dir, Paths *found)
+{
+    pkgWatchDirectory(&watcher->watches, dir);
+    int has_manifest;
+    char **subdirs;
+    size_t subdir_count;
+    int error = pkgListDirectory(dir, &has_manifest, &subdirs, &subdir_count);
+    if (error)
+    {
+        if (ENOENT != error && ENOTDIR != error)
+        {
+            fprintf(stderr, "Failed to open directory %s: %s\n",
+                    dir, strerror(error));
+        }
+        return;
+    }
+    if (has_manifest) addPath(found, pkgJoinPath(dir, "package.xml"));
+    for (size_t i = 0; i < subdir_count; ++i)
+    {
+        crawl(watcher, subdirs[i], found);
+        free(subdirs[i]);
+    }
+    if (subdirs) free(subdirs);
+}
+
+/*
+ * Returns 1 if the crawler reaches dir, given that its parent is watched
+ */
+static int
+isCrawled(const Pkg_Workspace *ws, const char *dir)
+{
+    if (0 == strcmp(ws->root, dir)) return 1;
+    const char *slash = strrchr(dir, '/');
+    if (!slash) return 0;
+    char *parent = strndup(dir, (size_t)(slash - dir));
+    assert(parent);
+    int crawled = !pkgStopsCrawl(parent);
+    free(parent);
+    return crawled;
+}
+
+/*
+ * Finds the packages of the workspace whose manifests are below dir,
+ * which are next to each other as the packages are sorted by filename
+ */
+static void
+findPackages(
+    const Pkg_Workspace *ws,
+    const char *dir,
+    size_t *begin,
+    size_t *end)
+{
+    char *prefix = pkgJoinPath(dir, "");
+    size_t prefix_len = strlen(prefix);
+    size_t low = 0;
+    size_t high = ws->package_count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(ws->packages[mid]->filename, prefix) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    *begin = low;
+    while (low < ws->package_count &&
+           0 == strncmp(ws->packages[low]->filename, prefix, prefix_len))
+    {
+        ++low;
+    }
+    *end = low;
+    free(prefix);
+}
+
+static Pkg_Package *
+parseManifest(Pkg_Watcher *watcher, const char *path)
+{
+    Pkg_Package *pkg = Pkg_InitPackage();
+    if (Pkg_ParserParsePackageManifest(watcher->parser, path, pkg))
+    {
+        Pkg_FreePackage(pkg);
+        return NULL;
+    }
+    return pkg;
+}
+
+/*
+ * Crawls dir again, collecting the packages below it which leave the
+ * workspace in removed, marking them in replaced, and those which join it
+ * in added
+ */
+static void
+updateDirectory(
+    Pkg_Watcher *watcher,
+    const char *dir,
+    int parse_all,
+    unsigned char *replaced,
+    Packages *removed,
+    Packages *added)
+{
+    Pkg_Workspace *ws = watcher->ws;
+    size_t begin;
+    size_t end;
+    findPackages(ws, dir, &begin, &end);
+    Paths found = {NULL, 0, 0};
+    crawl(watcher, dir, &found);
+    unwatchStale(&watcher->watches, dir);
+    sortPaths(&found);
+
+    /* Both are sorted by path, so they are merged */
+    size_t i = begin;
+    size_t j = 0;
+    while (i < end || j < found.count)
+    {
+        int cmp = i == end ? 1 : j == found.count ? -1 : \
+            strcmp(ws->packages[i]->filename, found.items[j]);
+        if (cmp <= 0)
+        {
+            int written = 0 == cmp &&
+                (parse_all || hasPath(&watcher->written, found.items[j]));
+            /* Unchanged packages stay as they are */
+            if (0 == cmp && !written)
+            {
+                ++i;
+                ++j;
+                continue;
+            }
+            replaced[i] = 1;
+            addPackage(removed, ws->packages[i++]);
+            if (cmp < 0) continue;
+        }
+        Pkg_Package *pkg = parseManifest(watcher, found.items[j++]);
+        if (pkg) addPackage(added, pkg);
+    }
+    clearPaths(&found);
+    if (found.items) free(found.items);
+}
+
+/*
+ * Points the graph at the packages which replaced removed ones without any
+ * change, returns 1 if one of them cannot be found by its name and file,
+ * like a package sharing its name or one which moved, so that the graph has
+ * to be built again
+ */
+static int
+replaceVertices(
+    Pkg_Graph *graph,
+    const Packages *removed,
+    const Packages *added)
+{
+    for (size_t i = 0; i < removed->count; ++i)
+    {
+        const Pkg_Package *pkg = removed->items[i];
+        if (!pkg->name) return 1;
+        size_t v = Pkg_GraphFindPackage(graph, pkg->name);
+        if (PKG_GRAPH_NOT_FOUND == v || graph->packages[v] != pkg) return 1;
+    }
+    for (size_t i = 0; i < added->count; ++i)
+    {
+        const Pkg_Package *pkg = added->items[i];
+        if (!pkg->name) return 1;
+        size_t v = Pkg_GraphFindPackage(graph, pkg->name);
+        if (PKG_GRAPH_NOT_FOUND == v ||
+            strcmp(graph->packages[v]->filename, pkg->filename))
+        {
+            return 1;
+        }
+    }
+    /* The same names and files, so the vertices keep their order */
+    for (size_t i = 0; i < added->count; ++i)
+    {
+        Pkg_Package *pkg = added->items[i];
+        graph->packages[Pkg_GraphFindPackage(graph, pkg->name)] = pkg;
+    }
+    return 0;
+}
+
+/*
+ * Crawls the directories which events were reported for and updates the
+ * workspace, returns 1 if a package changed
+ */
+static int
+applyEvents(Pkg_Watcher *watcher, Pkg_WorkspaceDiff *diff)
+{
+    Pkg_Workspace *ws = watcher->ws;
+    int parse_all = watcher->overflow;
+    if (parse_all)
+    {
+        clearPaths(&watcher->dirty);
+        addPath(&watcher->dirty, strdup(ws->root));
+        watcher->overflow = 0;
+    }
+    sortPaths(&watcher->dirty);
+    sortPaths(&watcher->written);
+    watcher->watches.generation++;
+
+    unsigned char *replaced = (unsigned char *)calloc(
+        ws->package_count ? ws->package_count : 1, 1);
+    assert(replaced);
+    Packages removed = {NULL, 0, 0};
+    Packages added = {NULL, 0, 0};
+    for (size_t d = 0; d < watcher->dirty.count; ++d)
+    {
+        const char *dir = watcher->dirty.items[d];
+        /* Crawling a directory covers everything below it */
+        if (d && 0 == strcmp(dir, watcher->dirty.items[d - 1])) continue;
+        if (hasAncestor(&watcher->dirty, dir)) continue;
+        if (!isCrawled(ws, dir)) continue;
+        updateDirectory(watcher, dir, parse_all, replaced, &removed, &added);
+    }
+    clearPaths(&watcher->dirty);
+    clearPaths(&watcher->written);
+
+    int ret = 0;
+    if (removed.count || added.count)
+    {
+        /* The remaining packages are still sorted, the added ones are
+         * merged in */
+        if (added.count > 1)
+        {
+            qsort(added.items, added.count, sizeof(Pkg_Package *),
+                  pkgComparePackages);
+        }
+        size_t count = ws->package_count - removed.count + added.count;
+        Pkg_Package **packages = (Pkg_Package **)malloc(
+            (count ? count : 1) * sizeof(Pkg_Package *));
+        assert(packages);
+        size_t i = 0;
+        size_t j = 0;
+        for (size_t k = 0; k < count; ++k)
+        {
+            while (i < ws->package_count && replaced[i]) ++i;
+            if (j == added.count ||
+                (i < ws->package_count &&
+                 pkgComparePackages(&ws->packages[i], &added.items[j]) < 0))
+            {
+                packages[k] = ws->packages[i++];
+            }
+            else
+            {
+                packages[k] = added.items[j++];
+            }
+        }
+        free(ws->packages);
+        ws->packages = packages;
+        ws->package_count = count;
+
+        ret = pkgDiffPackages(removed.items, removed.count,
+                              added.items, added.count, diff);
+        /* Saving a manifest without a semantic change keeps the graph */
+        if (ret || replaceVertices(watcher->graph, &removed, &added))
+        {
+            Pkg_BuildGraph(watcher->graph, ws->packages, ws->package_count,
+                           PKG_DEPEND_ALL);
+        }
+        for (size_t k = 0; k < removed.count; ++k)
+        {
+            addPackage(&watcher->retired, removed.items[k]);
+        }
+    }
+    else
+    {
+        pkgDiffPackages(NULL, 0, NULL, 0, diff);
+    }
+    if (removed.items) free(removed.items);
+    if (added.items) free(added.items);
+    free(replaced);
+    return ret;
+}
+
+static void
+releaseRetired(Pkg_Watcher *watcher)
+{
+    for (size_t i = 0; i < watcher->retired.count; ++i)
+    {
+        Pkg_FreePackage(watcher->retired.items[i]);
+    }
+    watcher->retired.count = 0;
+}
+
+/* Pkg_Watcher Functions */
+Pkg_Watcher *
+Pkg_InitWatcher()
+{
+    Pkg_Watcher *watcher = (Pkg_Watcher *)calloc(1, sizeof(Pkg_Watcher));
+    assert(watcher);
+    watcher->watches.fd = -1;
+    pthread_mutex_init(&watcher->watches.lock, NULL);
+    watcher->graph = Pkg_InitGraph();
+    return watcher;
+}
+
+void
+Pkg_FreeWatcher(Pkg_Watcher *watcher)
+{
+    Watches *watches = &watcher->watches;
+    releaseRetired(watcher);
+    if (watcher->retired.items) free(watcher->retired.items);
+    clearPaths(&watcher->dirty);
+    if (watcher->dirty.items) free(watcher->dirty.items);
+    clearPaths(&watcher->written);
+    if (watcher->written.items) free(watcher->written.items);
+    for (size_t wd = 0; wd < watches->capacity; ++wd)
+    {
+        if (watches->dirs[wd]) free(watches->dirs[wd]);
+    }
+    if (watches->dirs) free(watches->dirs);
+    if (watches->stamps) free(watches->stamps);
+    if (watches->fd >= 0) close(watches->fd);
+    pthread_mutex_destroy(&watches->lock);
+    if (watcher->parser) Pkg_FreeParser(watcher->parser);
+    Pkg_FreeGraph(watcher->graph);
+    free(watcher);
+}
+
+int
+Pkg_WatchWorkspace(
+    Pkg_Watcher *watcher,
+    const char *root,
+    unsigned int nthreads,
+    Pkg_Workspace *ws)
+{
+    /* Assert a workspace which is not watched yet */
+    assert(!watcher->ws);
+
+    watcher->watches.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->watches.fd < 0)
+    {
+        fprintf(stderr, "Failed to watch workspace %s: %s\n",
+                root, strerror(errno));
+        return 1;
+    }
+    pkgParseWorkspace(root, nthreads, ws, &watcher->watches);
+    /* Only set once root turned out to be a directory */
+    if (!ws->root) return 1;
+
+    watcher->ws = ws;
+    watcher->parser = Pkg_InitParser();
+    Pkg_ParserSetBackend(watcher->parser, ws->backend);
+    Pkg_ParserSetInternTable(watcher->parser, ws->names);
+    Pkg_ParserSetFields(watcher->parser, ws->fields);
+    Pkg_BuildGraph(watcher->graph, ws->packages, ws->package_count,
+                   PKG_DEPEND_ALL);
+    return 0;
+}
+
+int
+Pkg_WatcherPoll(Pkg_Watcher *watcher, int timeout_ms, Pkg_WorkspaceDiff *diff)
+{
+    releaseRetired(watcher);
+    int fd = watcher->watches.fd;
+    if (!watcher->ws || !waitForEvents(fd, timeout_ms))
+    {
+        pkgDiffPackages(NULL, 0, NULL, 0, diff);
+        return 0;
+    }
+    readEvents(watcher);
+    for (int round = 0;
+         round < WATCH_SETTLE_ROUNDS && waitForEvents(fd, WATCH_SETTLE_MS);
+         ++round)
+    {
+        readEvents(watcher);
+    }
+    return applyEvents(watcher, diff);
+}
+
+int
+Pkg_WatcherGetFd(const Pkg_Watcher *watcher)
+{
+    return watcher->watches.fd;
+}
+
+const Pkg_Graph *
+Pkg_WatcherGetGraph(const Pkg_Watcher *watcher)
+{
+    return watcher->graph;
+}
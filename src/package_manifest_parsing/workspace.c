@@ -0,0 +1,697 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/workspace.h>
+
+#include "internal.h"
+
+/* Files which mark a directory, and everything below it, as ignored */
+static const char *ignore_markers[] = {
+    "CATKIN_IGNORE",
+    "COLCON_IGNORE"
+};
+#define IGNORE_MARKER_COUNT (sizeof(ignore_markers)/sizeof(ignore_markers[0]))
+
+struct Crawl;
+
+/* Manifests a worker hands to the loader at once, so the loader wakes up
+ * once per batch rather than for every manifest */
+#define SUBMIT_BATCH 32
+
+/* Per thread state of the crawler
+ *
+ * Each worker owns a deque of directories which still have to be crawled.
+ * The owner pushes and pops at the bottom, idle workers steal from the top,
+ * so stolen directories tend to be the ones closest to the root.
+ */
+typedef struct Worker
+{
+    pthread_t thread;
+    int started;
+    pthread_mutex_t lock;
+    /* deque of directories, valid entries are [top, bottom) */
+    char **dirs;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+    /* parser used for every manifest this worker finds */
+    Pkg_Parser *parser;
+    /* arena the packages found by this worker are allocated from */
+    Pkg_Arena *arena;
+    /* manifests found and not submitted to the loader yet */
+    char *submissions[SUBMIT_BATCH];
+    size_t submission_count;
+    /* package left over from a cache miss or a failed parse, arena packages
+     * cannot be freed so it is reused for the next manifest */
+    Pkg_Package *spare;
+    /* packages parsed by this worker */
+    Pkg_Package **packages;
+    size_t package_count;
+    size_t package_capacity;
+    size_t failure_count;
+    struct Crawl *crawl;
+    unsigned int id;
+} Worker;
+
+typedef struct Crawl
+{
+    Worker *workers;
+    unsigned int worker_count;
+    /* number of directories which are queued or being crawled, and of
+     * manifests found which were not submitted to the loader yet */
+    atomic_size_t pending;
+    /* idle workers wait on idle until directories are pushed, which bumps
+     * pushes, or pending drops to 0 */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle;
+    size_t pushes;
+    /* cache manifests are looked up in first, NULL to always parse */
+    Pkg_Cache *cache;
+    /* reads the manifests found, NULL to read them while crawling */
+    Loader *loader;
+    /* watches every directory crawled, NULL if not watching */
+    Watches *watches;
+} Crawl;
+
+/* Pkg_Workspace Functions */
+Pkg_Workspace *
+Pkg_InitWorkspace()
+{
+    Pkg_Workspace *ws = (Pkg_Workspace *)malloc(sizeof(Pkg_Workspace));
+    ws->root = NULL;
+    ws->packages = NULL;
+    ws->package_count = 0;
+    ws->failure_count = 0;
+    ws->arenas = NULL;
+    ws->arena_count = 0;
+    ws->backend = PKG_BACKEND_DOM;
+    ws->fields = PKG_FIELD_ALL;
+    ws->names = Pkg_InitInternTable();
+    ws->cache = NULL;
+    ws->read_method = PKG_READ_IO_URING;
+    return ws;
+}
+
+void
+Pkg_FreeWorkspace(Pkg_Workspace *ws)
+{
+    for (size_t i = 0; i < ws->package_count; ++i)
+    {
+        Pkg_FreePackage(ws->packages[i]);
+    }
+    for (size_t i = 0; i < ws->arena_count; ++i)
+    {
+        Pkg_FreeArena(ws->arenas[i]);
+    }
+    if (ws->arenas) free(ws->arenas);
+    Pkg_FreeInternTable(ws->names);
+    if (ws->packages) free(ws->packages);
+    if (ws->root) free(ws->root);
+    free(ws);
+}
+
+static void
+pushDir(Worker *worker, char *dir)
+{
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom == worker->capacity)
+    {
+        if (worker->top > 0)
+        {
+            /* Reclaim the space left behind by thieves */
+            memmove(worker->dirs,
+                    worker->dirs + worker->top,
+                    (worker->bottom - worker->top) * sizeof(char *));
+            worker->bottom -= worker->top;
+            worker->top = 0;
+        }
+        else
+        {
+            worker->capacity = worker->capacity ? worker->capacity * 2 : 64;
+            worker->dirs = (char **)realloc(worker->dirs,
+                                            worker->capacity * sizeof(char *));
+            assert(worker->dirs);
+        }
+    }
+    worker->dirs[worker->bottom++] = dir;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static char *
+popDir(Worker *worker)
+{
+    char *dir = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom > worker->top)
+    {
+        dir = worker->dirs[--worker->bottom];
+        if (worker->bottom == worker->top)
+        {
+            worker->top = 0;
+            worker->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return dir;
+}
+
+static char *
+stealDir(Worker *thief)
+{
+    Crawl *crawl = thief->crawl;
+    for (unsigned int i = 1; i < crawl->worker_count; ++i)
+    {
+        unsigned int victim_id = (thief->id + i) % crawl->worker_count;
+        Worker *victim = &crawl->workers[victim_id];
+        char *dir = NULL;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->bottom > victim->top)
+        {
+            dir = victim->dirs[victim->top++];
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (dir) return dir;
+    }
+    return NULL;
+}
+
+int
+pkgIsIgnoreMarker(const char *name)
+{
+    for (size_t i = 0; i < IGNORE_MARKER_COUNT; ++i)
+    {
+        if (0 == strcmp(ignore_markers[i], name))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 if the entry is a directory, symlinks are not followed
+ */
+static inline int
+isDirectory(const char *dir, struct dirent *entry)
+{
+    if (DT_DIR == entry->d_type) return 1;
+    if (DT_UNKNOWN != entry->d_type) return 0;
+    /* Not all filesystems fill in d_type */
+    char *path = pkgJoinPath(dir, entry->d_name);
+    struct stat st;
+    int is_dir = (0 == lstat(path, &st) && S_ISDIR(st.st_mode));
+    free(path);
+    return is_dir;
+}
+
+static void
+addPackage(Worker *worker, Pkg_Package *pkg)
+{
+    if (worker->package_count == worker->package_capacity)
+    {
+        worker->package_capacity = \
+            worker->package_capacity ? worker->package_capacity * 2 : 64;
+        worker->packages = (Pkg_Package **)realloc(
+            worker->packages,
+            worker->package_capacity * sizeof(Pkg_Package *));
+        assert(worker->packages);
+    }
+    worker->packages[worker->package_count++] = pkg;
+}
+
+static Pkg_Package *
+takePackage(Worker *worker)
+{
+    Pkg_Package *pkg = worker->spare;
+    worker->spare = NULL;
+    return pkg ? pkg : Pkg_InitPackageInArena(worker->arena);
+}
+
+static void
+sparePackage(Worker *worker, Pkg_Package *pkg)
+{
+    pkgResetPackage(pkg);
+    worker->spare = pkg;
+}
+
+/*
+ * Parses the manifest at path, from the cache if the loader found it fresh,
+ * from file if the loader read it, otherwise it is read here, which also
+ * reports why it cannot be
+ */
+static void
+parseManifest(Worker *worker, const char *path, const LoadedFile *file)
+{
+    Pkg_Package *pkg = takePackage(worker);
+    Pkg_Cache *cache = worker->crawl->cache;
+    if (file && file->fresh)
+    {
+        if (pkgCacheLookup(cache, worker->parser, path, &file->st, pkg))
+        {
+            addPackage(worker, pkg);
+            return;
+        }
+        /* The entry went bad since, parse the manifest again */
+        file = NULL;
+    }
+    /* libxml2 reports an empty file, but not an empty buffer */
+    if (file && 0 == file->size) file = NULL;
+    int ret;
+    if (file && file->data && cache)
+    {
+        ret = pkgCacheParseBuffer(cache, worker->parser, path, &file->st,
+                                  file->data, file->size, pkg);
+    } else
+    if (file && file->data)
+    {
+        ret = Pkg_ParserParsePackageManifestFromBuffer(
+            worker->parser, file->data, file->size, path, pkg);
+    } else
+    if (cache)
+    {
+        ret = Pkg_CacheParsePackageManifest(cache, worker->parser, path, pkg);
+    }
+    else
+    {
+        ret = Pkg_ParserParsePackageManifest(worker->parser, path, pkg);
+    }
+    if (ret)
+    {
+        sparePackage(worker, pkg);
+        worker->failure_count++;
+        return;
+    }
+    addPackage(worker, pkg);
+}
+
+/*
+ * Returns how often directories were pushed so far, to wait for the next
+ * push with waitForWork
+ */
+static size_t
+getPushes(Crawl *crawl)
+{
+    pthread_mutex_lock(&crawl->idle_lock);
+    size_t pushes = crawl->pushes;
+    pthread_mutex_unlock(&crawl->idle_lock);
+    return pushes;
+}
+
+/*
+ * Wakes idle workers after count directories were pushed
+ */
+static void
+announceWork(Crawl *crawl, size_t count)
+{
+    pthread_mutex_lock(&crawl->idle_lock);
+    crawl->pushes++;
+    if (count > 1)
+    {
+        pthread_cond_broadcast(&crawl->idle);
+    }
+    else
+    {
+        pthread_cond_signal(&crawl->idle);
+    }
+    pthread_mutex_unlock(&crawl->idle_lock);
+}
+
+/*
+ * Blocks until directories were pushed since getPushes returned pushes, or
+ * the crawl is over
+ */
+static void
+waitForWork(Crawl *crawl, size_t pushes)
+{
+    pthread_mutex_lock(&crawl->idle_lock);
+    while (pushes == crawl->pushes && 0 != atomic_load(&crawl->pending))
+    {
+        pthread_cond_wait(&crawl->idle, &crawl->idle_lock);
+    }
+    pthread_mutex_unlock(&crawl->idle_lock);
+}
+
+/*
+ * Marks count directories or submissions as done, whoever finishes the last
+ * one knows the crawl is over, wakes the idle workers and closes the loader
+ */
+static void
+finishPending(Crawl *crawl, size_t count)
+{
+    if (count != atomic_fetch_sub(&crawl->pending, count)) return;
+    pthread_mutex_lock(&crawl->idle_lock);
+    pthread_cond_broadcast(&crawl->idle);
+    pthread_mutex_unlock(&crawl->idle_lock);
+    if (crawl->loader) pkgLoaderClose(crawl->loader);
+}
+
+static void
+flushSubmissions(Worker *worker)
+{
+    if (!worker->submission_count) return;
+    pkgLoaderSubmit(worker->crawl->loader, worker->submissions,
+                    worker->submission_count);
+    finishPending(worker->crawl, worker->submission_count);
+    worker->submission_count = 0;
+}
+
+/*
+ * Hands the manifest in dir to the loader, which also checks the cache for
+ * it, or parses it right away without one
+ */
+static void
+queueManifest(Worker *worker, const char *dir)
+{
+    Crawl *crawl = worker->crawl;
+    char *path = pkgJoinPath(dir, "package.xml");
+    if (crawl->loader)
+    {
+        /* Pending until submitted, so the loader is not closed before */
+        atomic_fetch_add(&crawl->pending, 1);
+        worker->submissions[worker->submission_count++] = path;
+        if (SUBMIT_BATCH == worker->submission_count)
+        {
+            flushSubmissions(worker);
+        }
+        return;
+    }
+    parseManifest(worker, path, NULL);
+    free(path);
+}
+
+/*
+ * Whether the file name exists in dir, without following a symlink
+ */
+static int
+hasFile(const char *dir, const char *name)
+{
+    char *path = pkgJoinPath(dir, name);
+    struct stat st;
+    int exists = 0 == lstat(path, &st);
+    free(path);
+    return exists;
+}
+
+int
+pkgStopsCrawl(const char *dir)
+{
+    if (hasFile(dir, "package.xml")) return 1;
+    for (size_t i = 0; i < IGNORE_MARKER_COUNT; ++i)
+    {
+        if (hasFile(dir, ignore_markers[i])) return 1;
+    }
+    return 0;
+}
+
+int
+pkgListDirectory(
+    const char *dir,
+    int *has_manifest,
+    char ***subdirs,
+    size_t *subdir_count)
+{
+    *has_manifest = 0;
+    *subdirs = NULL;
+    *subdir_count = 0;
+    DIR *handle = opendir(dir);
+    if (!handle) return errno;
+
+    int ignored = 0;
+    size_t subdir_capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(handle)))
+    {
+        const char *name = entry->d_name;
+        /* Skips '.', '..' and hidden directories */
+        if ('.' == name[0]) continue;
+        if (pkgIsIgnoreMarker(name))
+        {
+            ignored = 1;
+            break;
+        }
+        if (0 == strcmp("package.xml", name))
+        {
+            *has_manifest = 1;
+            continue;
+        }
+        /* Subdirectories are of no interest below a package */
+        if (*has_manifest || !isDirectory(dir, entry)) continue;
+        if (*subdir_count == subdir_capacity)
+        {
+            subdir_capacity = subdir_capacity ? subdir_capacity * 2 : 16;
+            *subdirs = (char **)realloc(*subdirs,
+                                        subdir_capacity * sizeof(char *));
+            assert(*subdirs);
+        }
+        (*subdirs)[(*subdir_count)++] = pkgJoinPath(dir, name);
+    }
+    closedir(handle);
+
+    if (ignored || *has_manifest)
+    {
+        for (size_t i = 0; i < *subdir_count; ++i) free((*subdirs)[i]);
+        if (*subdirs) free(*subdirs);
+        *subdirs = NULL;
+        *subdir_count = 0;
+    }
+    if (ignored) *has_manifest = 0;
+    return 0;
+}
+
+static void
+crawlDirectory(Worker *worker, const char *dir)
+{
+    /* Watched before it is listed, so nothing created meanwhile is missed */
+    if (worker->crawl->watches)
+    {
+        pkgWatchDirectory(worker->crawl->watches, dir);
+    }
+
+    int has_manifest;
+    char **subdirs;
+    size_t subdir_count;
+    int error = pkgListDirectory(dir, &has_manifest, &subdirs, &subdir_count);
+    if (error)
+    {
+        fprintf(stderr, "Failed to open directory %s: %s\n",
+                dir, strerror(error));
+        return;
+    }
+
+    if (has_manifest)
+    {
+        queueManifest(worker, dir);
+    }
+    for (size_t i = 0; i < subdir_count; ++i)
+    {
+        atomic_fetch_add(&worker->crawl->pending, 1);
+        pushDir(worker, subdirs[i]);
+    }
+    if (subdir_count) announceWork(worker->crawl, subdir_count);
+    if (subdirs) free(subdirs);
+}
+
+static void *
+workerMain(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    Crawl *crawl = worker->crawl;
+    LoadedFile *file;
+    for (;;)
+    {
+        /* Manifests read so far come first, they hold on to memory */
+        file = crawl->loader ? pkgLoaderNext(crawl->loader, 0) : NULL;
+        if (file)
+        {
+            parseManifest(worker, file->path, file);
+            pkgFreeLoadedFile(file);
+            continue;
+        }
+        char *dir = popDir(worker);
+        size_t pushes = 0;
+        if (!dir)
+        {
+            /* Out of work of its own, what was found has to go out before
+             * the crawl can end */
+            flushSubmissions(worker);
+            pushes = getPushes(crawl);
+            dir = stealDir(worker);
+        }
+        if (!dir)
+        {
+            /* Nothing to steal, done once no one else can produce work,
+             * else wait until someone does */
+            if (0 == atomic_load(&crawl->pending)) break;
+            waitForWork(crawl, pushes);
+            continue;
+        }
+        crawlDirectory(worker, dir);
+        free(dir);
+        finishPending(crawl, 1);
+    }
+    /* Parse the manifests which are still being read */
+    while (crawl->loader && (file = pkgLoaderNext(crawl->loader, 1)))
+    {
+        parseManifest(worker, file->path, file);
+        pkgFreeLoadedFile(file);
+    }
+    return NULL;
+}
+
+int
+pkgComparePackages(const void *lhs, const void *rhs)
+{
+    const Pkg_Package *a = *(const Pkg_Package **)lhs;
+    const Pkg_Package *b = *(const Pkg_Package **)rhs;
+    return strcmp(a->filename, b->filename);
+}
+
+int
+Pkg_ParseWorkspace(const char *root, unsigned int nthreads, Pkg_Workspace *ws)
+{
+    return pkgParseWorkspace(root, nthreads, ws, NULL);
+}
+
+int
+pkgParseWorkspace(
+    const char *root,
+    unsigned int nthreads,
+    Pkg_Workspace *ws,
+    Watches *watches)
+{
+    /* Assert a root */
+    assert(root);
+
+    struct stat st;
+    if (0 != stat(root, &st) || !S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "Workspace root %s is not a directory\n", root);
+        return 1;
+    }
+
+    if (0 == nthreads)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+
+    ws->root = strdup(root);
+    assert(ws->root);
+    /* Strip trailing slashes so joined paths stay canonical */
+    size_t root_len = strlen(ws->root);
+    while (root_len > 1 && '/' == ws->root[root_len - 1])
+    {
+        ws->root[--root_len] = '\0';
+    }
+
+    Crawl crawl;
+    crawl.worker_count = nthreads;
+    crawl.workers = (Worker *)calloc(nthreads, sizeof(Worker));
+    assert(crawl.workers);
+    atomic_init(&crawl.pending, 0);
+    pthread_mutex_init(&crawl.idle_lock, NULL);
+    pthread_cond_init(&crawl.idle, NULL);
+    crawl.pushes = 0;
+    crawl.cache = ws->cache;
+    crawl.loader = pkgStartLoader(PKG_READ_THREADS == ws->read_method,
+                                  ws->cache, ws->fields);
+    crawl.watches = watches;
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        crawl.workers[i].crawl = &crawl;
+        crawl.workers[i].id = i;
+        crawl.workers[i].parser = Pkg_InitParser();
+        Pkg_ParserSetBackend(crawl.workers[i].parser, ws->backend);
+        Pkg_ParserSetInternTable(crawl.workers[i].parser, ws->names);
+        Pkg_ParserSetFields(crawl.workers[i].parser, ws->fields);
+        crawl.workers[i].arena = Pkg_InitArena();
+        pthread_mutex_init(&crawl.workers[i].lock, NULL);
+    }
+
+    char *start = strdup(ws->root);
+    assert(start);
+    atomic_fetch_add(&crawl.pending, 1);
+    pushDir(&crawl.workers[0], start);
+
+    /* The calling thread acts as the first worker */
+    for (unsigned int i = 1; i < nthreads; ++i)
+    {
+        if (pthread_create(&crawl.workers[i].thread, NULL,
+                           workerMain, &crawl.workers[i]))
+        {
+            fprintf(stderr, "Failed to create crawler thread\n");
+            continue;
+        }
+        crawl.workers[i].started = 1;
+    }
+    workerMain(&crawl.workers[0]);
+
+    size_t total = 0;
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        Worker *worker = &crawl.workers[i];
+        if (worker->started)
+        {
+            pthread_join(worker->thread, NULL);
+        }
+        total += worker->package_count;
+        ws->failure_count += worker->failure_count;
+    }
+    if (crawl.loader) pkgStopLoader(crawl.loader);
+
+    /* Merge the per worker results, the workspace takes over the arenas */
+    ws->arenas = (Pkg_Arena **)malloc(nthreads * sizeof(Pkg_Arena *));
+    assert(ws->arenas);
+    ws->packages = (Pkg_Package **)malloc(
+        (total ? total : 1) * sizeof(Pkg_Package *));
+    assert(ws->packages);
+    for (unsigned int i = 0; i < nthreads; ++i)
+    {
+        Worker *worker = &crawl.workers[i];
+        if (worker->packages)
+        {
+            memcpy(ws->packages + ws->package_count,
+                   worker->packages,
+                   worker->package_count * sizeof(Pkg_Package *));
+            ws->package_count += worker->package_count;
+            free(worker->packages);
+        }
+        if (worker->dirs) free(worker->dirs);
+        Pkg_FreeParser(worker->parser);
+        ws->arenas[ws->arena_count++] = worker->arena;
+        pthread_mutex_destroy(&worker->lock);
+    }
+    free(crawl.workers);
+    pthread_cond_destroy(&crawl.idle);
+    pthread_mutex_destroy(&crawl.idle_lock);
+
+    /* Crawl order depends on scheduling, sort to make results repeatable */
+    qsort(ws->packages, ws->package_count, sizeof(Pkg_Package *),
+          pkgComparePackages);
+
+    return ws->failure_count ? 1 : 0;
+}
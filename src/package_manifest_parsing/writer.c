@@ -0,0 +1,532 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/writer.h>
+
+#include "internal.h"
+
+/* Size at which a file writer hands its buffer to the file */
+#define WRITER_CHUNK_SIZE (64 * 1024)
+
+struct Pkg_Writer
+{
+    /* file to write to, NULL to keep the output in memory */
+    FILE *file;
+    Buffer buffer;
+    /* set once a write to the file failed */
+    int error;
+};
+
+/* Pkg_Writer Functions */
+static Pkg_Writer *
+initWriter(FILE *file)
+{
+    Pkg_Writer *writer = (Pkg_Writer *)malloc(sizeof(Pkg_Writer));
+    assert(writer);
+    writer->file = file;
+    bufferInit(&writer->buffer, WRITER_CHUNK_SIZE);
+    writer->error = 0;
+    return writer;
+}
+
+Pkg_Writer *
+Pkg_InitFileWriter(FILE *file)
+{
+    assert(file);
+    return initWriter(file);
+}
+
+Pkg_Writer *
+Pkg_InitMemoryWriter()
+{
+    return initWriter(NULL);
+}
+
+/*
+ * Hands the buffer to the file without flushing the file itself
+ */
+static void
+drain(Pkg_Writer *writer)
+{
+    if (!writer->file || !writer->buffer.size) return;
+    size_t written = fwrite(writer->buffer.data, 1, writer->buffer.size,
+                            writer->file);
+    if (written != writer->buffer.size) writer->error = 1;
+    bufferReset(&writer->buffer);
+}
+
+int
+Pkg_WriterFlush(Pkg_Writer *writer)
+{
+    if (!writer->file) return 0;
+    drain(writer);
+    if (0 != fflush(writer->file)) writer->error = 1;
+    return writer->error;
+}
+
+void
+Pkg_FreeWriter(Pkg_Writer *writer)
+{
+    Pkg_WriterFlush(writer);
+    free(writer->buffer.data);
+    free(writer);
+}
+
+const char *
+Pkg_WriterGetData(const Pkg_Writer *writer, size_t *size)
+{
+    *size = writer->buffer.size;
+    return writer->buffer.data;
+}
+
+void
+Pkg_WriterAppend(Pkg_Writer *writer, const char *data, size_t len)
+{
+    if (writer->file && writer->buffer.size + len >= WRITER_CHUNK_SIZE)
+    {
+        drain(writer);
+        if (len >= WRITER_CHUNK_SIZE)
+        {
+            /* Too big to be worth copying */
+            if (len != fwrite(data, 1, len, writer->file)) writer->error = 1;
+            return;
+        }
+    }
+    bufferAppend(&writer->buffer, data, len);
+}
+
+static inline void
+put(Pkg_Writer *writer, const char *str)
+{
+    Pkg_WriterAppend(writer, str, strlen(str));
+}
+
+static inline void
+putChar(Pkg_Writer *writer, char c)
+{
+    Pkg_WriterAppend(writer, &c, 1);
+}
+
+/*
+ * Writes str, or "(null)" like printf does if it is not set
+ */
+static inline void
+putText(Pkg_Writer *writer, const char *str)
+{
+    put(writer, str ? str : "(null)");
+}
+
+static void
+putUnsigned(Pkg_Writer *writer, unsigned long value)
+{
+    char digits[24];
+    size_t pos = sizeof(digits);
+    do
+    {
+        digits[--pos] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    Pkg_WriterAppend(writer, digits + pos, sizeof(digits) - pos);
+}
+
+static void
+putVersion(Pkg_Writer *writer, const Pkg_Version *version)
+{
+    putUnsigned(writer, version->major);
+    putChar(writer, '.');
+    putUnsigned(writer, version->minor);
+    putChar(writer, '.');
+    putUnsigned(writer, version->patch);
+}
+
+static const char *
+urlTypeName(Pkg_URLType type)
+{
+    switch (type)
+    {
+        case PKG_URL_WEBSITE:
+            return "website";
+        case PKG_URL_BUGTRACKER:
+            return "bugtracker";
+        case PKG_URL_REPOSITORY:
+            return "repository";
+        case PKG_URL_NOT_SET:
+        default:
+            return NULL;
+    }
+}
+
+/* Names of the dependency lists, in the order of Pkg_DependencyType */
+static const char *depend_type_names[PKG_DEPEND_TYPE_COUNT] = {
+    "buildtool_depends",
+    "build_depends",
+    "run_depends",
+    "test_depends"
+};
+
+/* Attribute names of the constraints, in the order of
+ * Pkg_VersionConstraint */
+static const char *constraint_names[PKG_VERSION_CONSTRAINT_COUNT] = {
+    "version_lt",
+    "version_lte",
+    "version_eq",
+    "version_gt",
+    "version_gte"
+};
+
+/* Text format */
+static void
+putPersonsText(Pkg_Writer *writer, const Pkg_PersonList *person)
+{
+    for (; person; person = person->next)
+    {
+        put(writer, "  ");
+        putText(writer, person->name);
+        if (person->email)
+        {
+            put(writer, " <");
+            put(writer, person->email);
+            putChar(writer, '>');
+        }
+        putChar(writer, '\n');
+    }
+}
+
+static void
+putDependenciesText(Pkg_Writer *writer, const Pkg_DependencyList *dep)
+{
+    /* In the order they have always been printed in */
+    const Pkg_VersionConstraint constraints[] = {
+        PKG_VERSION_EQ,
+        PKG_VERSION_LT,
+        PKG_VERSION_LTE,
+        PKG_VERSION_GT,
+        PKG_VERSION_GTE
+    };
+    for (; dep; dep = dep->next)
+    {
+        put(writer, "  ");
+        putText(writer, dep->name);
+        putChar(writer, '\n');
+        for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+        {
+            Pkg_Version version;
+            if (Pkg_GetDependencyVersion(dep, constraints[c], &version))
+            {
+                put(writer, "   ");
+                put(writer, constraint_names[constraints[c]]);
+                put(writer, ": ");
+                putVersion(writer, &version);
+                putChar(writer, '\n');
+            }
+        }
+    }
+}
+
+static void
+writeText(Pkg_Writer *writer, const Pkg_Package *pkg)
+{
+    put(writer, "Package:\n name: ");
+    putText(writer, pkg->name);
+    put(writer, "\n version: ");
+    putVersion(writer, &pkg->version);
+    put(writer, "\n description: ");
+    putText(writer, pkg->description);
+    put(writer, "\n maintainers:\n");
+    putPersonsText(writer, pkg->maintainers);
+    put(writer, " licenses:\n");
+    for (const Pkg_LicenseList *l = pkg->licenses; l; l = l->next)
+    {
+        put(writer, "  ");
+        putText(writer, l->license);
+        putChar(writer, '\n');
+    }
+    put(writer, " urls:\n");
+    for (const Pkg_URLList *url = pkg->urls; url; url = url->next)
+    {
+        put(writer, "  ");
+        putText(writer, url->url);
+        const char *type = urlTypeName(url->type);
+        if (type)
+        {
+            put(writer, " (");
+            put(writer, type);
+            putChar(writer, ')');
+        }
+        putChar(writer, '\n');
+    }
+    put(writer, " authors:\n");
+    putPersonsText(writer, pkg->authors);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t count;
+        const Pkg_DependencyList *deps = Pkg_GetDependencies(
+            pkg, (Pkg_DependencyType)type, &count);
+        if (!deps) continue;
+        putChar(writer, ' ');
+        put(writer, depend_type_names[type]);
+        put(writer, ":\n");
+        putDependenciesText(writer, deps);
+    }
+    if (pkg->exports)
+    {
+        put(writer, " export:\n  ");
+        put(writer, pkg->exports);
+        putChar(writer, '\n');
+    }
+}
+
+/* JSON Lines format */
+
+/*
+ * Writes str as a JSON string, or null if it is not set
+ */
+static void
+putJSONString(Pkg_Writer *writer, const char *str)
+{
+    if (!str)
+    {
+        put(writer, "null");
+        return;
+    }
+    static const char hex[] = "0123456789abcdef";
+    putChar(writer, '"');
+    const char *run = str;
+    for (const char *p = str; *p; ++p)
+    {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && '"' != c && '\\' != c) continue;
+        Pkg_WriterAppend(writer, run, (size_t)(p - run));
+        run = p + 1;
+        switch (c)
+        {
+            case '"': put(writer, "\\\""); break;
+            case '\\': put(writer, "\\\\"); break;
+            case '\n': put(writer, "\\n"); break;
+            case '\r': put(writer, "\\r"); break;
+            case '\t': put(writer, "\\t"); break;
+            default:
+            {
+                char escape[6] = { '\\', 'u', '0', '0',
+                                   hex[c >> 4], hex[c & 0xf] };
+                Pkg_WriterAppend(writer, escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    put(writer, run);
+    putChar(writer, '"');
+}
+
+static void
+putJSONKey(Pkg_Writer *writer, const char *key)
+{
+    putChar(writer, '"');
+    put(writer, key);
+    put(writer, "\":");
+}
+
+static void
+putPersonsJSON(
+    Pkg_Writer *writer,
+    const char *key,
+    const Pkg_PersonList *person)
+{
+    putChar(writer, ',');
+    putJSONKey(writer, key);
+    putChar(writer, '[');
+    for (const Pkg_PersonList *p = person; p; p = p->next)
+    {
+        if (p != person) putChar(writer, ',');
+        put(writer, "{\"name\":");
+        putJSONString(writer, p->name);
+        put(writer, ",\"email\":");
+        putJSONString(writer, p->email);
+        putChar(writer, '}');
+    }
+    putChar(writer, ']');
+}
+
+static void
+writeJSON(Pkg_Writer *writer, const Pkg_Package *pkg)
+{
+    put(writer, "{\"filename\":");
+    putJSONString(writer, pkg->filename);
+    put(writer, ",\"name\":");
+    putJSONString(writer, pkg->name);
+    put(writer, ",\"version\":\"");
+    putVersion(writer, &pkg->version);
+    put(writer, "\",\"package_format\":");
+    putUnsigned(writer, pkg->package_format);
+    put(writer, ",\"description\":");
+    putJSONString(writer, pkg->description);
+    putPersonsJSON(writer, "maintainers", pkg->maintainers);
+    put(writer, ",\"licenses\":[");
+    for (const Pkg_LicenseList *l = pkg->licenses; l; l = l->next)
+    {
+        if (l != pkg->licenses) putChar(writer, ',');
+        putJSONString(writer, l->license);
+    }
+    put(writer, "],\"urls\":[");
+    for (const Pkg_URLList *url = pkg->urls; url; url = url->next)
+    {
+        if (url != pkg->urls) putChar(writer, ',');
+        put(writer, "{\"url\":");
+        putJSONString(writer, url->url);
+        put(writer, ",\"type\":");
+        putJSONString(writer, urlTypeName(url->type));
+        putChar(writer, '}');
+    }
+    putChar(writer, ']');
+    putPersonsJSON(writer, "authors", pkg->authors);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t count;
+        const Pkg_DependencyList *deps = Pkg_GetDependencies(
+            pkg, (Pkg_DependencyType)type, &count);
+        putChar(writer, ',');
+        putJSONKey(writer, depend_type_names[type]);
+        putChar(writer, '[');
+        for (const Pkg_DependencyList *dep = deps; dep; dep = dep->next)
+        {
+            if (dep != deps) putChar(writer, ',');
+            put(writer, "{\"name\":");
+            putJSONString(writer, dep->name);
+            for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+            {
+                Pkg_Version version;
+                if (!Pkg_GetDependencyVersion(
+                        dep, (Pkg_VersionConstraint)c, &version))
+                {
+                    continue;
+                }
+                putChar(writer, ',');
+                putJSONKey(writer, constraint_names[c]);
+                putChar(writer, '"');
+                putVersion(writer, &version);
+                putChar(writer, '"');
+            }
+            putChar(writer, '}');
+        }
+        putChar(writer, ']');
+    }
+    put(writer, ",\"exports\":");
+    putJSONString(writer, pkg->exports);
+    put(writer, "}\n");
+}
+
+/* TSV format */
+
+/*
+ * Writes str as part of a field, escaping what would end the field
+ */
+static void
+putTSVString(Pkg_Writer *writer, const char *str)
+{
+    if (!str) return;
+    const char *run = str;
+    for (const char *p = str; *p; ++p)
+    {
+        char c = *p;
+        if ('\t' != c && '\n' != c && '\r' != c && '\\' != c) continue;
+        Pkg_WriterAppend(writer, run, (size_t)(p - run));
+        run = p + 1;
+        switch (c)
+        {
+            case '\t': put(writer, "\\t"); break;
+            case '\n': put(writer, "\\n"); break;
+            case '\r': put(writer, "\\r"); break;
+            default: put(writer, "\\\\"); break;
+        }
+    }
+    put(writer, run);
+}
+
+static void
+writeTSV(Pkg_Writer *writer, const Pkg_Package *pkg)
+{
+    /* Operators of the constraints, in the order of Pkg_VersionConstraint */
+    static const char *operators[PKG_VERSION_CONSTRAINT_COUNT] = {
+        "<", "<=", "=", ">", ">="
+    };
+    putTSVString(writer, pkg->filename);
+    putChar(writer, '\t');
+    putTSVString(writer, pkg->name);
+    putChar(writer, '\t');
+    putVersion(writer, &pkg->version);
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        putChar(writer, '\t');
+        size_t count;
+        const Pkg_DependencyList *deps = Pkg_GetDependencies(
+            pkg, (Pkg_DependencyType)type, &count);
+        for (const Pkg_DependencyList *dep = deps; dep; dep = dep->next)
+        {
+            if (dep != deps) putChar(writer, ',');
+            putTSVString(writer, dep->name);
+            for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+            {
+                Pkg_Version version;
+                if (Pkg_GetDependencyVersion(
+                        dep, (Pkg_VersionConstraint)c, &version))
+                {
+                    put(writer, operators[c]);
+                    putVersion(writer, &version);
+                }
+            }
+        }
+    }
+    putChar(writer, '\n');
+}
+
+void
+Pkg_WriteTSVHeader(Pkg_Writer *writer)
+{
+    put(writer, "filename\tname\tversion");
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        putChar(writer, '\t');
+        put(writer, depend_type_names[type]);
+    }
+    putChar(writer, '\n');
+}
+
+void
+Pkg_WritePackage(
+    Pkg_Writer *writer,
+    const Pkg_Package *pkg,
+    Pkg_OutputFormat format)
+{
+    switch (format)
+    {
+        case PKG_OUTPUT_JSON:
+            writeJSON(writer, pkg);
+            break;
+        case PKG_OUTPUT_TSV:
+            writeTSV(writer, pkg);
+            break;
+        case PKG_OUTPUT_TEXT:
+        default:
+            writeText(writer, pkg);
+            break;
+    }
+}
@@ -14,25 +14,822 @@
  * limitations under the License.
  */
 
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include <package_manifest_parsing/cache.h>
+#include <package_manifest_parsing/graph.h>
 #include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/snapshot.h>
+#include <package_manifest_parsing/watch.h>
+#include <package_manifest_parsing/workspace.h>
+#include <package_manifest_parsing/writer.h>
 
-int main(int argc, char **argv)
+/* Command line options */
+typedef struct Options
+{
+    const char *workspace;
+    /* directory of a workspace to follow instead of parsing it once */
+    const char *watch;
+    unsigned int nthreads;
+    Pkg_ParserBackend backend;
+    const char *cache;
+    Pkg_ReadMethod read_method;
+    int order;
+    const char *dependents;
+    int check;
+    /* directory of the old workspace to diff against */
+    const char *diff;
+    const char *snapshot;
+    unsigned long bench;
+    Pkg_OutputFormat format;
+    /* manifests to parse, "-" reads their paths from stdin one per line */
+    const char **paths;
+    size_t path_count;
+} Options;
+
+static int
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] <path/to/package.xml|-> ...\n"
+            "       %s [options] --workspace <dir> [-j N] [--order]\n"
+            "       %s [options] --workspace <dir> --dependents <a,b,...>\n"
+            "       %s [options] --workspace <dir> --check\n"
+            "       %s [options] --workspace <dir> --diff <old_dir>\n"
+            "       %s [options] --workspace <dir> --snapshot <file>\n"
+            "       %s [options] --watch <dir> [-j N]\n"
+            "       %s [options] --bench N <path/to/package.xml>\n"
+            "\n"
+            "  -               read paths of manifests from stdin, one per\n"
+            "                  line\n"
+            "  --format <fmt>  print packages as text, json (one object per\n"
+            "                  line) or tsv\n"
+            "  --stream        use the streaming backend, without a tree\n"
+            "  --scan          use the built-in scanner, with libxml2 for\n"
+            "                  what it does not handle\n"
+            "  --cache <file>  reuse results of earlier runs kept in file\n"
+            "  --read-threads  read the manifests of the workspace with a\n"
+            "                  pool of threads instead of io_uring\n"
+            "  --order         print the packages in build order, by level\n"
+            "  --dependents    print the packages which depend on the given\n"
+            "                  packages, directly or not\n"
+            "  --check         check the version constraints of dependencies\n"
+            "                  on packages of the workspace\n"
+            "  --diff          print the packages which were added, removed\n"
+            "                  or changed since the workspace in old_dir\n"
+            "  --snapshot      save the parsed workspace to a file which\n"
+            "                  tools can map, see snapshot.h\n"
+            "  --watch         print the packages of the workspace which\n"
+            "                  change, and those depending on them, as\n"
+            "                  manifests are saved, until interrupted\n"
+            "  --bench N       time N parses of the manifest from memory\n",
+            prog, prog, prog, prog, prog, prog, prog, prog);
+    return 1;
+}
+
+static int
+parseArgs(int argc, char **argv, Options *options)
 {
-    if (argc < 2)
+    options->workspace = NULL;
+    options->watch = NULL;
+    options->nthreads = 0;
+    options->backend = PKG_BACKEND_DOM;
+    options->cache = NULL;
+    options->read_method = PKG_READ_IO_URING;
+    options->order = 0;
+    options->dependents = NULL;
+    options->check = 0;
+    options->diff = NULL;
+    options->snapshot = NULL;
+    options->bench = 0;
+    options->format = PKG_OUTPUT_TEXT;
+    options->paths = (const char **)malloc(argc * sizeof(const char *));
+    options->path_count = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (0 == strcmp("--workspace", arg) && i + 1 < argc)
+        {
+            options->workspace = argv[++i];
+        } else
+        if (0 == strcmp("--watch", arg) && i + 1 < argc)
+        {
+            options->watch = argv[++i];
+        } else
+        if (0 == strcmp("-j", arg) && i + 1 < argc)
+        {
+            options->nthreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else
+        if (0 == strcmp("--stream", arg))
+        {
+            options->backend = PKG_BACKEND_STREAM;
+        } else
+        if (0 == strcmp("--scan", arg))
+        {
+            options->backend = PKG_BACKEND_SCAN;
+        } else
+        if (0 == strcmp("--cache", arg) && i + 1 < argc)
+        {
+            options->cache = argv[++i];
+        } else
+        if (0 == strcmp("--read-threads", arg))
+        {
+            options->read_method = PKG_READ_THREADS;
+        } else
+        if (0 == strcmp("--order", arg))
+        {
+            options->order = 1;
+        } else
+        if (0 == strcmp("--dependents", arg) && i + 1 < argc)
+        {
+            options->dependents = argv[++i];
+        } else
+        if (0 == strcmp("--check", arg))
+        {
+            options->check = 1;
+        } else
+        if (0 == strcmp("--diff", arg) && i + 1 < argc)
+        {
+            options->diff = argv[++i];
+        } else
+        if (0 == strcmp("--snapshot", arg) && i + 1 < argc)
+        {
+            options->snapshot = argv[++i];
+        } else
+        if (0 == strcmp("--bench", arg) && i + 1 < argc)
+        {
+            options->bench = strtoul(argv[++i], NULL, 10);
+        } else
+        if (0 == strcmp("--format", arg) && i + 1 < argc)
+        {
+            const char *format = argv[++i];
+            if (0 == strcmp("text", format))
+            {
+                options->format = PKG_OUTPUT_TEXT;
+            } else
+            if (0 == strcmp("json", format))
+            {
+                options->format = PKG_OUTPUT_JSON;
+            } else
+            if (0 == strcmp("tsv", format))
+            {
+                options->format = PKG_OUTPUT_TSV;
+            }
+            else
+            {
+                return 1;
+            }
+        } else
+        if ('-' != arg[0] || 0 == strcmp("-", arg))
+        {
+            options->paths[options->path_count++] = arg;
+        }
+        else
+        {
+            return 1;
+        }
+    }
+    /* Exactly one of a workspace or a manifest must be given */
+    int modes = !!options->order + !!options->dependents + !!options->check +
+                !!options->diff + !!options->snapshot;
+    if (options->watch)
+    {
+        return options->workspace || options->path_count || modes ||
+               options->bench || PKG_OUTPUT_TEXT != options->format;
+    }
+    if (modes && !options->workspace) return 1;
+    if (modes > 1) return 1;
+    if (modes && PKG_OUTPUT_TEXT != options->format) return 1;
+    if (options->bench &&
+        (options->workspace || options->cache || 1 != options->path_count ||
+         0 == strcmp("-", options->paths[0])))
     {
         return 1;
     }
+    return !options->workspace == !options->path_count;
+}
+
+/*
+ * Loads the cache file given in the options, NULL if none was given
+ */
+static Pkg_Cache *
+loadCache(const Options *options)
+{
+    if (!options->cache) return NULL;
+    Pkg_Cache *cache = Pkg_InitCache();
+    /* An unusable cache file is reported and then rebuilt */
+    Pkg_LoadCache(cache, options->cache);
+    return cache;
+}
+
+static void
+saveCache(const Options *options, Pkg_Cache *cache)
+{
+    if (!cache) return;
+    Pkg_SaveCache(cache, options->cache);
+    Pkg_FreeCache(cache);
+}
+
+/*
+ * Writes the TSV header if the format needs one
+ */
+static void
+beginOutput(Pkg_Writer *writer, Pkg_OutputFormat format)
+{
+    if (PKG_OUTPUT_TSV == format) Pkg_WriteTSVHeader(writer);
+}
+
+/*
+ * Flushes the writer, returns 1 after reporting if any output was lost
+ */
+static int
+endOutput(Pkg_Writer *writer)
+{
+    int ret = Pkg_WriterFlush(writer);
+    if (ret) fprintf(stderr, "Failed to write output\n");
+    Pkg_FreeWriter(writer);
+    return ret;
+}
+
+/*
+ * Prints one line per level of the build order of the workspace
+ */
+static int
+printOrder(Pkg_Workspace *ws)
+{
+    Pkg_Graph *graph = Pkg_InitGraph();
+    int ret = Pkg_BuildGraph(
+        graph, ws->packages, ws->package_count, PKG_DEPEND_BUILD_ALL);
+    if (ret) Pkg_PrintGraphErrors(graph, stderr);
+    for (size_t l = 0; l < graph->level_count; ++l)
+    {
+        printf("%zu:", l);
+        for (size_t i = graph->level_offsets[l];
+             i < graph->level_offsets[l + 1]; ++i)
+        {
+            printf(" %s", graph->packages[graph->order[i]]->name);
+        }
+        printf("\n");
+    }
+    Pkg_FreeGraph(graph);
+    return ret;
+}
+
+/*
+ * Prints every package which depends on one of a comma separated list
+ */
+static int
+printDependents(Pkg_Workspace *ws, const char *names)
+{
+    Pkg_Graph *graph = Pkg_InitGraph();
+    int ret = Pkg_BuildGraph(
+        graph, ws->packages, ws->package_count, PKG_DEPEND_ALL);
+    if (ret) Pkg_PrintGraphErrors(graph, stderr);
+
+    size_t *vertices = (size_t *)malloc(
+        (graph->package_count + 1) * sizeof(size_t));
+    size_t vertex_count = 0;
+    char *list = strdup(names);
+    char *save;
+    for (char *name = strtok_r(list, ",", &save); name;
+         name = strtok_r(NULL, ",", &save))
+    {
+        size_t vertex = Pkg_GraphFindPackage(graph, name);
+        if (PKG_GRAPH_NOT_FOUND == vertex)
+        {
+            fprintf(stderr, "Unknown package '%s'\n", name);
+            ret = 1;
+            continue;
+        }
+        if (vertex_count < graph->package_count)
+        {
+            vertices[vertex_count++] = vertex;
+        }
+    }
+    free(list);
+
+    size_t *result = (size_t *)malloc(
+        (graph->package_count + 1) * sizeof(size_t));
+    size_t found = Pkg_GraphGetTransitiveDependents(
+        graph, vertices, vertex_count, PKG_DEPEND_ALL, result);
+    for (size_t i = 0; i < found; ++i)
+    {
+        printf("%s\n", graph->packages[result[i]]->name);
+    }
+    free(result);
+    free(vertices);
+    Pkg_FreeGraph(graph);
+    return ret;
+}
 
+/* Tags of the dependency types, in the order of Pkg_DependencyType */
+static const char *type_names[PKG_DEPEND_TYPE_COUNT] = {
+    "buildtool_depend",
+    "build_depend",
+    "run_depend",
+    "test_depend"
+};
+
+/*
+ * Prints every dependency whose version constraints are not met
+ */
+static int
+printViolations(Pkg_Workspace *ws, unsigned int nthreads)
+{
+    static const char *constraint_names[PKG_VERSION_CONSTRAINT_COUNT] = {
+        "version_lt",
+        "version_lte",
+        "version_eq",
+        "version_gt",
+        "version_gte"
+    };
+    Pkg_ConstraintReport *report = Pkg_InitConstraintReport();
+    int ret = Pkg_CheckWorkspaceConstraints(ws, nthreads, report);
+    for (size_t i = 0; i < report->violation_count; ++i)
+    {
+        const Pkg_ConstraintViolation *violation = &report->violations[i];
+        const Pkg_Version *actual = &violation->target->version;
+        for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+        {
+            Pkg_Version wanted;
+            if (!(violation->failed & PKG_CONSTRAINT_BIT(c))) continue;
+            Pkg_GetDependencyVersion(violation->dependency,
+                                     (Pkg_VersionConstraint)c, &wanted);
+            printf("%s: <%s %s=\"%u.%u.%u\">%s</%s> but %s is %u.%u.%u\n",
+                   violation->package->name,
+                   type_names[violation->type],
+                   constraint_names[c],
+                   wanted.major, wanted.minor, wanted.patch,
+                   violation->dependency->name,
+                   type_names[violation->type],
+                   violation->target->name,
+                   actual->major, actual->minor, actual->patch);
+        }
+    }
+    for (size_t i = 0; i < report->duplicate_count; ++i)
+    {
+        const Pkg_Package *pkg = report->duplicates[i];
+        const Pkg_Package *first = pkg;
+        for (size_t j = 0; j < ws->package_count && first == pkg; ++j)
+        {
+            if (ws->packages[j]->name &&
+                0 == strcmp(ws->packages[j]->name, pkg->name))
+            {
+                first = ws->packages[j];
+            }
+        }
+        fprintf(stderr, "Package name '%s' is used by both %s and %s\n",
+                pkg->name, first->filename, pkg->filename);
+    }
+    fprintf(stderr, "%zu of %zu version constraints violated\n",
+            report->violation_count, report->checked_count);
+    Pkg_FreeConstraintReport(report);
+    return ret;
+}
+
+/*
+ * Prints a line per changed package, marked with +, - or ~, followed by
+ * the dependencies which changed
+ */
+static void
+printChanges(const Pkg_WorkspaceDiff *diff, size_t *added, size_t *removed)
+{
+    /* Operators of the constraints, in the order of Pkg_VersionConstraint */
+    static const char *operators[PKG_VERSION_CONSTRAINT_COUNT] = {
+        "<", "<=", "=", ">", ">="
+    };
+    *added = 0;
+    *removed = 0;
+    for (size_t i = 0; i < diff->change_count; ++i)
+    {
+        const Pkg_PackageChange *change = &diff->changes[i];
+        const Pkg_Version *version;
+        if (change->changes & PKG_CHANGE_ADDED)
+        {
+            version = &change->new_package->version;
+            printf("+ %s %u.%u.%u\n", change->new_package->name,
+                   version->major, version->minor, version->patch);
+            (*added)++;
+            continue;
+        }
+        if (change->changes & PKG_CHANGE_REMOVED)
+        {
+            version = &change->old_package->version;
+            printf("- %s %u.%u.%u\n", change->old_package->name,
+                   version->major, version->minor, version->patch);
+            (*removed)++;
+            continue;
+        }
+        version = &change->new_package->version;
+        printf("~ %s %u.%u.%u", change->new_package->name,
+               version->major, version->minor, version->patch);
+        if (change->changes & PKG_CHANGE_VERSION)
+        {
+            version = &change->old_package->version;
+            printf(" (was %u.%u.%u)",
+                   version->major, version->minor, version->patch);
+        }
+        printf("\n");
+        for (size_t d = 0; d < change->dependency_count; ++d)
+        {
+            const Pkg_DependencyChange *dep_change = \
+                &diff->dependency_changes[change->dependency_offset + d];
+            const Pkg_DependencyList *dep = dep_change->dependency;
+            printf("    %c %s %s", dep_change->added ? '+' : '-',
+                   type_names[dep_change->type], dep->name);
+            for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+            {
+                Pkg_Version wanted;
+                if (!Pkg_GetDependencyVersion(
+                        dep, (Pkg_VersionConstraint)c, &wanted))
+                {
+                    continue;
+                }
+                printf("%s%u.%u.%u", operators[c],
+                       wanted.major, wanted.minor, wanted.patch);
+            }
+            printf("\n");
+        }
+    }
+}
+
+/*
+ * Prints the packages which differ from the old workspace
+ */
+static int
+printDiff(Pkg_Workspace *old_ws, Pkg_Workspace *ws)
+{
+    Pkg_WorkspaceDiff *diff = Pkg_InitWorkspaceDiff();
+    int ret = Pkg_DiffWorkspaces(old_ws, ws, diff);
+    size_t added;
+    size_t removed;
+    printChanges(diff, &added, &removed);
+    fprintf(stderr, "%zu added, %zu removed, %zu changed, %zu unchanged\n",
+            added, removed, diff->change_count - added - removed,
+            diff->unchanged_count);
+    Pkg_FreeWorkspaceDiff(diff);
+    return ret;
+}
+
+static int
+parseWorkspace(const Options *options)
+{
+    Pkg_Workspace *ws = Pkg_InitWorkspace();
+    ws->backend = options->backend;
+    ws->read_method = options->read_method;
+    /* The graph only needs names and dependencies, the check versions too */
+    if (options->order || options->dependents)
+    {
+        ws->fields = PKG_FIELD_NAME | PKG_FIELD_DEPENDS;
+    } else
+    if (options->check)
+    {
+        ws->fields = PKG_FIELD_NAME | PKG_FIELD_VERSION | PKG_FIELD_DEPENDS;
+    }
+    ws->cache = loadCache(options);
+    Pkg_Workspace *old_ws = NULL;
+    int ret = 0;
+    if (options->diff)
+    {
+        old_ws = Pkg_InitWorkspace();
+        old_ws->backend = options->backend;
+        old_ws->read_method = options->read_method;
+        old_ws->cache = ws->cache;
+        ret = Pkg_ParseWorkspace(options->diff, options->nthreads, old_ws);
+        old_ws->cache = NULL;
+    }
+    if (Pkg_ParseWorkspace(options->workspace, options->nthreads, ws))
+    {
+        ret = 1;
+    }
+    saveCache(options, ws->cache);
+    ws->cache = NULL;
+    if (options->order)
+    {
+        if (printOrder(ws)) ret = 1;
+    } else
+    if (options->dependents)
+    {
+        if (printDependents(ws, options->dependents)) ret = 1;
+    } else
+    if (options->check)
+    {
+        if (printViolations(ws, options->nthreads)) ret = 1;
+    } else
+    if (options->diff)
+    {
+        /* Like diff(1), exits with 1 if anything changed */
+        if (printDiff(old_ws, ws)) ret = 1;
+        Pkg_FreeWorkspace(old_ws);
+    } else
+    if (options->snapshot)
+    {
+        if (Pkg_WriteSnapshot(ws, options->snapshot)) ret = 1;
+    }
+    else
+    {
+        Pkg_Writer *writer = Pkg_InitFileWriter(stdout);
+        beginOutput(writer, options->format);
+        for (size_t i = 0; i < ws->package_count; ++i)
+        {
+            Pkg_WritePackage(writer, ws->packages[i], options->format);
+        }
+        if (endOutput(writer)) ret = 1;
+    }
+    Pkg_FreeWorkspace(ws);
+    return ret;
+}
+
+/* Set by SIGINT and SIGTERM to end --watch */
+static volatile sig_atomic_t stop_watching = 0;
+
+static void
+stopWatching(int signal)
+{
+    (void)signal;
+    stop_watching = 1;
+}
+
+/*
+ * Prints the packages which depend on the added or changed ones
+ */
+static void
+printAffected(const Pkg_Graph *graph, const Pkg_WorkspaceDiff *diff)
+{
+    size_t *vertices = (size_t *)malloc(
+        (graph->package_count + 1) * sizeof(size_t));
+    size_t *result = (size_t *)malloc(
+        (graph->package_count + 1) * sizeof(size_t));
+    size_t vertex_count = 0;
+    for (size_t i = 0; i < diff->change_count; ++i)
+    {
+        const Pkg_Package *pkg = diff->changes[i].new_package;
+        if (!pkg || !pkg->name) continue;
+        size_t vertex = Pkg_GraphFindPackage(graph, pkg->name);
+        if (PKG_GRAPH_NOT_FOUND != vertex &&
+            vertex_count < graph->package_count)
+        {
+            vertices[vertex_count++] = vertex;
+        }
+    }
+    size_t found = Pkg_GraphGetTransitiveDependents(
+        graph, vertices, vertex_count, PKG_DEPEND_ALL, result);
+    if (found)
+    {
+        printf("* dependents:");
+        for (size_t i = 0; i < found; ++i)
+        {
+            printf(" %s", graph->packages[result[i]]->name);
+        }
+        printf("\n");
+    }
+    free(result);
+    free(vertices);
+}
+
+/*
+ * Reports the cycle and duplicate names of the graph on stderr, unless the
+ * report is the same as the last one, kept in last_report
+ */
+static void
+reportGraph(const Pkg_Graph *graph, char **last_report)
+{
+    char *report = NULL;
+    size_t size = 0;
+    FILE *file = open_memstream(&report, &size);
+    if (!file)
+    {
+        Pkg_PrintGraphErrors(graph, stderr);
+        return;
+    }
+    Pkg_PrintGraphErrors(graph, file);
+    fclose(file);
+    if (*last_report && 0 == strcmp(*last_report, report))
+    {
+        free(report);
+        return;
+    }
+    fputs(report, stderr);
+    free(*last_report);
+    *last_report = report;
+}
+
+/*
+ * Parses the workspace, then prints every change to it as it happens,
+ * until interrupted
+ */
+static int
+watchWorkspace(const Options *options)
+{
+    Pkg_Workspace *ws = Pkg_InitWorkspace();
+    ws->backend = options->backend;
+    ws->read_method = options->read_method;
+    ws->cache = loadCache(options);
+    Pkg_Watcher *watcher = Pkg_InitWatcher();
+    int ret = Pkg_WatchWorkspace(
+        watcher, options->watch, options->nthreads, ws);
+    saveCache(options, ws->cache);
+    ws->cache = NULL;
+    if (!ret)
+    {
+        fprintf(stderr, "Watching %zu packages in %s\n",
+                ws->package_count, ws->root);
+        /* Without SA_RESTART the signals interrupt the wait for events */
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = stopWatching;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+    }
+    char *graph_report = NULL;
+    if (!ret) reportGraph(Pkg_WatcherGetGraph(watcher), &graph_report);
+    Pkg_WorkspaceDiff *diff = Pkg_InitWorkspaceDiff();
+    while (!ret && !stop_watching)
+    {
+        if (!Pkg_WatcherPoll(watcher, -1, diff)) continue;
+        size_t added;
+        size_t removed;
+        printChanges(diff, &added, &removed);
+        printAffected(Pkg_WatcherGetGraph(watcher), diff);
+        fflush(stdout);
+        reportGraph(Pkg_WatcherGetGraph(watcher), &graph_report);
+    }
+    free(graph_report);
+    Pkg_FreeWorkspaceDiff(diff);
+    Pkg_FreeWatcher(watcher);
+    Pkg_FreeWorkspace(ws);
+    return ret;
+}
+
+/*
+ * Parses the manifest from memory options->bench times and reports the
+ * average time per manifest, bench_tags times the lookup of its tags
+ */
+static int
+benchManifest(const Options *options)
+{
+    const char *path = options->paths[0];
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *data = (char *)malloc(capacity);
+    size_t read;
+    while (0 < (read = fread(data + size, 1, capacity - size, file)))
+    {
+        size += read;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            data = (char *)realloc(data, capacity);
+        }
+    }
+    fclose(file);
+
+    Pkg_Parser *parser = Pkg_InitParser();
+    Pkg_ParserSetBackend(parser, options->backend);
+    int ret = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < options->bench && !ret; ++i)
+    {
+        Pkg_Package *pkg = Pkg_InitPackage();
+        ret = Pkg_ParserParsePackageManifestFromBuffer(
+            parser, data, size, path, pkg);
+        Pkg_FreePackage(pkg);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    Pkg_FreeParser(parser);
+    free(data);
+    if (ret) return ret;
+
+    double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 +
+                (double)(end.tv_nsec - start.tv_nsec);
+    printf("%lu parses, %.2f us per manifest\n",
+           options->bench, ns / 1e3 / (double)options->bench);
+    return 0;
+}
+
+/*
+ * Parses the manifest at path and writes it, returns 1 if it failed to parse
+ */
+static int
+writeManifest(
+    Pkg_Parser *parser,
+    Pkg_Cache *cache,
+    const char *path,
+    Pkg_Writer *writer,
+    Pkg_OutputFormat format)
+{
     Pkg_Package *pkg = Pkg_InitPackage();
-    int ret = Pkg_ParsePackageManifest(argv[1], pkg);
-    if (ret)
+    int ret;
+    if (cache)
+    {
+        ret = Pkg_CacheParsePackageManifest(cache, parser, path, pkg);
+    }
+    else
     {
-        return ret;
+        ret = Pkg_ParserParsePackageManifest(parser, path, pkg);
     }
-    Pkg_PrintPackage(pkg);
+    if (!ret) Pkg_WritePackage(writer, pkg, format);
     Pkg_FreePackage(pkg);
+    return ret;
+}
 
-    return 0;
+/*
+ * Writes the manifests whose paths are on stdin, one per line
+ */
+static int
+writeManifestsFromStdin(
+    Pkg_Parser *parser,
+    Pkg_Cache *cache,
+    Pkg_Writer *writer,
+    Pkg_OutputFormat format)
+{
+    int ret = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    while (-1 != (len = getline(&line, &capacity, stdin)))
+    {
+        while (len && ('\n' == line[len - 1] || '\r' == line[len - 1]))
+        {
+            line[--len] = '\0';
+        }
+        if (!len) continue;
+        if (writeManifest(parser, cache, line, writer, format)) ret = 1;
+    }
+    free(line);
+    return ret;
+}
+
+/*
+ * Parses every manifest given, carrying on past those which fail
+ */
+static int
+parseManifests(const Options *options)
+{
+    Pkg_Parser *parser = Pkg_InitParser();
+    Pkg_ParserSetBackend(parser, options->backend);
+    Pkg_Cache *cache = loadCache(options);
+    Pkg_Writer *writer = Pkg_InitFileWriter(stdout);
+    beginOutput(writer, options->format);
+    int ret = 0;
+    for (size_t i = 0; i < options->path_count; ++i)
+    {
+        const char *path = options->paths[i];
+        int failed;
+        if (0 == strcmp("-", path))
+        {
+            failed = writeManifestsFromStdin(
+                parser, cache, writer, options->format);
+        }
+        else
+        {
+            failed = writeManifest(
+                parser, cache, path, writer, options->format);
+        }
+        if (failed) ret = 1;
+    }
+    if (endOutput(writer)) ret = 1;
+    saveCache(options, cache);
+    Pkg_FreeParser(parser);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    int ret;
+    if (parseArgs(argc, argv, &options))
+    {
+        ret = usage(argv[0]);
+    } else
+    if (options.workspace)
+    {
+        ret = parseWorkspace(&options);
+    } else
+    if (options.watch)
+    {
+        ret = watchWorkspace(&options);
+    } else
+    if (options.bench)
+    {
+        ret = benchManifest(&options);
+    }
+    else
+    {
+        ret = parseManifests(&options);
+    }
+    free(options.paths);
+    return ret;
 }
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times pkgLookupTag against the chain of strcmp calls it replaced.
+ *
+ * The tags are the children of <package> in the given manifests, in the
+ * order they appear, so the mix is that of real manifests. Every tag is
+ * looked up rounds times with each method and the cost per lookup is
+ * printed. The exit status is 1 if the two methods disagree on a tag the
+ * chain knows, so a single round doubles as a check.
+ *
+ * Usage: bench_tags <rounds> <package.xml>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "internal.h"
+
+/* Identifies tag_name the way the parser did before pkgLookupTag */
+static ElementTag
+lookupTagChain(const char *tag_name)
+{
+    if (0 == strcmp("name", tag_name)) return TAG_NAME;
+    if (0 == strcmp("version", tag_name)) return TAG_VERSION;
+    if (0 == strcmp("description", tag_name)) return TAG_DESCRIPTION;
+    if (0 == strcmp("maintainer", tag_name)) return TAG_MAINTAINER;
+    if (0 == strcmp("license", tag_name)) return TAG_LICENSE;
+    if (0 == strcmp("url", tag_name)) return TAG_URL;
+    if (0 == strcmp("author", tag_name)) return TAG_AUTHOR;
+    if (0 == strcmp("buildtool_depend", tag_name))
+        return TAG_BUILDTOOL_DEPEND;
+    if (0 == strcmp("build_depend", tag_name)) return TAG_BUILD_DEPEND;
+    if (0 == strcmp("run_depend", tag_name)) return TAG_RUN_DEPEND;
+    if (0 == strcmp("test_depend", tag_name)) return TAG_TEST_DEPEND;
+    if (0 == strcmp("export", tag_name)) return TAG_EXPORT;
+    if (0 == strcmp("text", tag_name)) return TAG_TEXT;
+    return TAG_UNKNOWN;
+}
+
+/*
+ * Appends the names of the children of <package> in the manifest at path
+ * to tags, returns 1 if it cannot be read
+ */
+static int
+collectTags(const char *path, char ***tags, size_t *count, size_t *capacity)
+{
+    xmlDoc *doc = xmlReadFile(path, NULL, XML_PARSE_NOERROR |
+                                          XML_PARSE_NOWARNING);
+    if (!doc)
+    {
+        fprintf(stderr, "Failed to read %s\n", path);
+        return 1;
+    }
+    xmlNode *root = xmlDocGetRootElement(doc);
+    for (xmlNode *curr = root ? root->children : NULL; curr;
+         curr = curr->next)
+    {
+        if (XML_ELEMENT_NODE != curr->type) continue;
+        if (*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *tags = (char **)realloc(*tags, *capacity * sizeof(char *));
+        }
+        (*tags)[(*count)++] = strdup((const char *)curr->name);
+    }
+    xmlFreeDoc(doc);
+    return 0;
+}
+
+/* Returns the nanoseconds since start */
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double)(end.tv_sec - start->tv_sec) * 1e9 +
+           (double)(end.tv_nsec - start->tv_nsec);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <rounds> <package.xml>...\n", argv[0]);
+        return 1;
+    }
+    unsigned long rounds = strtoul(argv[1], NULL, 10);
+    char **tags = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (collectTags(argv[i], &tags, &count, &capacity)) return 1;
+    }
+    if (!rounds || !count)
+    {
+        fprintf(stderr, "Nothing to time\n");
+        return 1;
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        ElementTag expected = lookupTagChain(tags[i]);
+        if (TAG_UNKNOWN != expected && expected != pkgLookupTag(tags[i]))
+        {
+            fprintf(stderr, "pkgLookupTag disagrees on <%s>\n", tags[i]);
+            ret = 1;
+        }
+    }
+
+    /* Summing the results keeps the lookups from being optimized out */
+    volatile unsigned long sink = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long round = 0; round < rounds; ++round)
+    {
+        unsigned long sum = 0;
+        for (size_t i = 0; i < count; ++i) sum += lookupTagChain(tags[i]);
+        sink += sum;
+    }
+    double chain_ns = elapsed(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long round = 0; round < rounds; ++round)
+    {
+        unsigned long sum = 0;
+        for (size_t i = 0; i < count; ++i) sum += pkgLookupTag(tags[i]);
+        sink += sum;
+    }
+    double lookup_ns = elapsed(&start);
+
+    double lookups = (double)rounds * (double)count;
+    printf("%zu tags, %lu rounds\n", count, rounds);
+    printf("strcmp chain: %.1f ns per tag\n", chain_ns / lookups);
+    printf("pkgLookupTag: %.1f ns per tag\n", lookup_ns / lookups);
+
+    for (size_t i = 0; i < count; ++i) free(tags[i]);
+    free(tags);
+    xmlCleanupParser();
+    return ret;
+}
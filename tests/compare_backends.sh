@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Copyright 2014 Open Source Robotics Foundation, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Parses each manifest with every backend and fails unless they print the
+# same JSON, the same messages and exit with the same status.
+#
+# The scanner hands whatever it does not handle to the DOM backend, so its
+# messages must match those of the DOM backend exactly. The streaming
+# backend reads with libxml2's xmlTextReader, which words its own parser
+# errors differently and stops at the first one, so for it those
+# diagnostics, a line with the position and two of context each, are left
+# out of the comparison. Everything the package parser prints is compared.
+#
+# Usage: compare_backends.sh <path/to/parse> <package.xml>...
+
+parse="$1"
+shift
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# Drops libxml2's diagnostics for manifest $1 from stdin
+dropDiagnostics()
+{
+    awk -v prefix="$1:" '
+        skip > 0 { skip--; next }
+        index($0, prefix) == 1 && / (error|warning) : / { skip = 2; next }
+        { print }'
+}
+
+status=0
+for manifest in "$@"
+do
+    for backend in dom stream scan
+    do
+        case $backend in
+            dom) option= ;;
+            *) option=--$backend ;;
+        esac
+        "$parse" --format json $option "$manifest" \
+            > "$tmp/$backend.out" 2> "$tmp/$backend.err"
+        echo "exit status $?" >> "$tmp/$backend.out"
+    done
+    dropDiagnostics "$manifest" < "$tmp/dom.err" > "$tmp/dom-text.err"
+    dropDiagnostics "$manifest" < "$tmp/stream.err" > "$tmp/stream-text.err"
+
+    for pair in "dom.out scan.out" "dom.err scan.err" \
+                "dom.out stream.out" "dom-text.err stream-text.err"
+    do
+        if ! diff -u "$tmp/${pair% *}" "$tmp/${pair#* }" > "$tmp/diff"
+        then
+            echo "$manifest: the backends disagree"
+            cat "$tmp/diff"
+            status=1
+        fi
+    done
+done
+exit $status
@@ -0,0 +1,1437 @@
+/*
+ * Copyright 2014 Open Source Robotics Foundation, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Checks the library's API against the workspace in tests/workspace.
+ *
+ * The workspace holds alpha, beta, which depends on alpha and on gamma,
+ * and gamma and delta, which depend on each other. beta's test dependency
+ * and gamma's build dependency on alpha ask for versions alpha does not
+ * have. Every check which fails is reported on stderr, the exit status is
+ * 1 if any did.
+ *
+ * Usage: test_api <path/to/tests>
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <package_manifest_parsing/blob.h>
+#include <package_manifest_parsing/cache.h>
+#include <package_manifest_parsing/closure.h>
+#include <package_manifest_parsing/graph.h>
+#include <package_manifest_parsing/pkg.h>
+#include <package_manifest_parsing/snapshot.h>
+#include <package_manifest_parsing/watch.h>
+#include <package_manifest_parsing/workspace.h>
+
+/* Number of checks which failed */
+static int failures = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", \
+                    __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Returns 1 if both strings are NULL or equal */
+static int
+sameString(const char *a, const char *b)
+{
+    if (!a || !b) return a == b;
+    return 0 == strcmp(a, b);
+}
+
+/*
+ * Writes dir/name to path, which holds PATH_MAX bytes, fails a check if it
+ * does not fit
+ */
+static void
+joinPath(char *path, const char *dir, const char *name)
+{
+    int len = snprintf(path, PATH_MAX, "%s/%s", dir, name);
+    CHECK(len >= 0 && len < PATH_MAX);
+}
+
+/*
+ * Reads the whole file at path into a malloc'd string, NULL on error, and
+ * unless size is NULL stores its size there
+ */
+static char *
+readFileSize(const char *path, size_t *size_out)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *text = (char *)malloc(capacity);
+    size_t count;
+    while (text && (count = fread(text + size, 1, capacity - size - 1, file)))
+    {
+        size += count;
+        if (capacity - size == 1)
+        {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+        }
+    }
+    fclose(file);
+    if (text) text[size] = '\0';
+    if (size_out) *size_out = size;
+    return text;
+}
+
+/*
+ * Reads the whole file at path into a malloc'd string, NULL on error
+ */
+static char *
+readFile(const char *path)
+{
+    return readFileSize(path, NULL);
+}
+
+/*
+ * Replaces the file at path with size bytes of data, returns 0 on success
+ */
+static int
+writeFileSize(const char *path, const char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return 1;
+    int ret = size != fwrite(data, 1, size, file);
+    if (fclose(file)) ret = 1;
+    return ret;
+}
+
+/*
+ * Replaces the file at path with text, returns 0 on success
+ */
+static int
+writeFile(const char *path, const char *text)
+{
+    return writeFileSize(path, text, strlen(text));
+}
+
+/*
+ * Replaces the first occurrence of old_text in the file at path with
+ * new_text, returns 0 on success
+ */
+static int
+editFile(const char *path, const char *old_text, const char *new_text)
+{
+    char *text = readFile(path);
+    char *found = text ? strstr(text, old_text) : NULL;
+    if (!found)
+    {
+        free(text);
+        return 1;
+    }
+    size_t prefix = (size_t)(found - text);
+    size_t size = strlen(text) - strlen(old_text) + strlen(new_text);
+    char *edited = (char *)malloc(size + 1);
+    memcpy(edited, text, prefix);
+    strcpy(edited + prefix, new_text);
+    strcat(edited, found + strlen(old_text));
+    int ret = writeFile(path, edited);
+    free(edited);
+    free(text);
+    return ret;
+}
+
+/*
+ * Copies the directory tree at src to dst, which must not exist, returns 0
+ * on success
+ */
+static int
+copyTree(const char *src, const char *dst)
+{
+    DIR *dir = opendir(src);
+    if (!dir || mkdir(dst, 0755))
+    {
+        if (dir) closedir(dir);
+        return 1;
+    }
+    int ret = 0;
+    struct dirent *entry;
+    while (!ret && (entry = readdir(dir)))
+    {
+        if (0 == strcmp(entry->d_name, ".") ||
+            0 == strcmp(entry->d_name, ".."))
+        {
+            continue;
+        }
+        char src_path[4096];
+        char dst_path[4096];
+        snprintf(src_path, sizeof(src_path), "%s/%s", src, entry->d_name);
+        snprintf(dst_path, sizeof(dst_path), "%s/%s", dst, entry->d_name);
+        struct stat st;
+        if (stat(src_path, &st))
+        {
+            ret = 1;
+        } else
+        if (S_ISDIR(st.st_mode))
+        {
+            ret = copyTree(src_path, dst_path);
+        }
+        else
+        {
+            char *text = readFile(src_path);
+            ret = !text || writeFile(dst_path, text);
+            free(text);
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+/*
+ * Removes the directory tree at path
+ */
+static void
+removeTree(const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)))
+    {
+        if (0 == strcmp(entry->d_name, ".") ||
+            0 == strcmp(entry->d_name, ".."))
+        {
+            continue;
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        struct stat st;
+        if (0 == lstat(child, &st) && S_ISDIR(st.st_mode))
+        {
+            removeTree(child);
+        }
+        else
+        {
+            unlink(child);
+        }
+    }
+    if (dir) closedir(dir);
+    rmdir(path);
+}
+
+/*
+ * Returns the package of the workspace called name, NULL if there is none
+ */
+static const Pkg_Package *
+findPackage(const Pkg_Workspace *ws, const char *name)
+{
+    for (size_t i = 0; i < ws->package_count; ++i)
+    {
+        if (sameString(ws->packages[i]->name, name)) return ws->packages[i];
+    }
+    return NULL;
+}
+
+/*
+ * Checks that two packages hold the same contents
+ */
+static void
+checkSamePackage(const Pkg_Package *a, const Pkg_Package *b)
+{
+    CHECK(sameString(a->name, b->name));
+    CHECK(sameString(a->filename, b->filename));
+    CHECK(sameString(a->description, b->description));
+    CHECK(sameString(a->exports, b->exports));
+    CHECK(0 == Pkg_CompareVersions(&a->version, &b->version));
+    CHECK(a->semantic_hash == b->semantic_hash);
+
+    CHECK(a->maintainer_count == b->maintainer_count);
+    for (size_t i = 0;
+         i < a->maintainer_count && i < b->maintainer_count; ++i)
+    {
+        CHECK(sameString(a->maintainers[i].name, b->maintainers[i].name));
+        CHECK(sameString(a->maintainers[i].email, b->maintainers[i].email));
+    }
+    CHECK(a->author_count == b->author_count);
+    for (size_t i = 0; i < a->author_count && i < b->author_count; ++i)
+    {
+        CHECK(sameString(a->authors[i].name, b->authors[i].name));
+        CHECK(sameString(a->authors[i].email, b->authors[i].email));
+    }
+    CHECK(a->license_count == b->license_count);
+    for (size_t i = 0; i < a->license_count && i < b->license_count; ++i)
+    {
+        CHECK(sameString(a->licenses[i].license, b->licenses[i].license));
+    }
+    CHECK(a->url_count == b->url_count);
+    for (size_t i = 0; i < a->url_count && i < b->url_count; ++i)
+    {
+        CHECK(sameString(a->urls[i].url, b->urls[i].url));
+        CHECK(a->urls[i].type == b->urls[i].type);
+    }
+
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t a_count;
+        size_t b_count;
+        const Pkg_DependencyList *a_deps = \
+            Pkg_GetDependencies(a, (Pkg_DependencyType)type, &a_count);
+        const Pkg_DependencyList *b_deps = \
+            Pkg_GetDependencies(b, (Pkg_DependencyType)type, &b_count);
+        CHECK(a_count == b_count);
+        for (size_t i = 0; i < a_count && i < b_count; ++i)
+        {
+            CHECK(sameString(a_deps[i].name, b_deps[i].name));
+            CHECK(a_deps[i].constraints == b_deps[i].constraints);
+            for (int c = 0; c < PKG_VERSION_CONSTRAINT_COUNT; ++c)
+            {
+                if (!(a_deps[i].constraints & PKG_CONSTRAINT_BIT(c)))
+                {
+                    continue;
+                }
+                CHECK(a_deps[i].version_keys[c] == b_deps[i].version_keys[c]);
+            }
+        }
+    }
+}
+
+/*
+ * Checks that two lists of people hold the same names and emails
+ */
+static void
+checkSamePersons(
+    const Pkg_PersonList *a,
+    size_t a_count,
+    const Pkg_PersonList *b,
+    size_t b_count)
+{
+    CHECK(a_count == b_count);
+    for (size_t i = 0; i < a_count && i < b_count; ++i)
+    {
+        CHECK(sameString(a[i].name, b[i].name));
+        CHECK(sameString(a[i].email, b[i].email));
+    }
+}
+
+/*
+ * Checks that pkg, parsed with only fields selected, holds what full holds
+ * for those fields and nothing for the others
+ */
+static void
+checkFields(
+    const Pkg_Package *full,
+    const Pkg_Package *pkg,
+    unsigned int fields)
+{
+    CHECK(fields == pkg->fields);
+    CHECK(sameString(full->filename, pkg->filename));
+
+    CHECK(sameString(fields & PKG_FIELD_NAME ? full->name : NULL,
+                     pkg->name));
+    Pkg_Version none = { 0, 0, 0 };
+    CHECK(0 == Pkg_CompareVersions(
+        fields & PKG_FIELD_VERSION ? &full->version : &none, &pkg->version));
+    CHECK(sameString(fields & PKG_FIELD_DESCRIPTION ? full->description
+                                                     : NULL,
+                     pkg->description));
+    if (fields & PKG_FIELD_MAINTAINERS)
+    {
+        checkSamePersons(full->maintainers, full->maintainer_count,
+                         pkg->maintainers, pkg->maintainer_count);
+    }
+    else
+    {
+        CHECK(!pkg->maintainers && 0 == pkg->maintainer_count);
+    }
+    if (fields & PKG_FIELD_LICENSES)
+    {
+        CHECK(full->license_count == pkg->license_count);
+        for (size_t i = 0;
+             i < full->license_count && i < pkg->license_count; ++i)
+        {
+            CHECK(sameString(full->licenses[i].license,
+                             pkg->licenses[i].license));
+        }
+    }
+    else
+    {
+        CHECK(!pkg->licenses && 0 == pkg->license_count);
+    }
+    if (fields & PKG_FIELD_URLS)
+    {
+        CHECK(full->url_count == pkg->url_count);
+        for (size_t i = 0; i < full->url_count && i < pkg->url_count; ++i)
+        {
+            CHECK(sameString(full->urls[i].url, pkg->urls[i].url));
+            CHECK(full->urls[i].type == pkg->urls[i].type);
+        }
+    }
+    else
+    {
+        CHECK(!pkg->urls && 0 == pkg->url_count);
+    }
+    if (fields & PKG_FIELD_AUTHORS)
+    {
+        checkSamePersons(full->authors, full->author_count,
+                         pkg->authors, pkg->author_count);
+    }
+    else
+    {
+        CHECK(!pkg->authors && 0 == pkg->author_count);
+    }
+
+    /* The dependency fields follow the order of Pkg_DependencyType */
+    for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+    {
+        size_t full_count;
+        size_t count;
+        const Pkg_DependencyList *full_deps = \
+            Pkg_GetDependencies(full, (Pkg_DependencyType)type, &full_count);
+        const Pkg_DependencyList *deps = \
+            Pkg_GetDependencies(pkg, (Pkg_DependencyType)type, &count);
+        if (!(fields & (PKG_FIELD_BUILDTOOL_DEPENDS << type)))
+        {
+            CHECK(!deps && 0 == count);
+            continue;
+        }
+        CHECK(full_count == count);
+        for (size_t i = 0; i < full_count && i < count; ++i)
+        {
+            CHECK(sameString(full_deps[i].name, deps[i].name));
+            CHECK(full_deps[i].constraints == deps[i].constraints);
+        }
+    }
+
+    if (fields & PKG_FIELD_EXPORTS)
+    {
+        CHECK(sameString(full->exports, pkg->exports));
+        CHECK(full->exports_offset == pkg->exports_offset);
+        CHECK(full->exports_size == pkg->exports_size);
+    }
+    else
+    {
+        CHECK(!pkg->exports && 0 == pkg->exports_size);
+    }
+}
+
+/*
+ * Parses the manifest at path with each backend, once with every field and
+ * then with only some of them
+ */
+static void
+testFields(const char *path)
+{
+    /* Each field on its own, the fields the stream backend can stop
+     * reading early for, and some mixes */
+    unsigned int masks[16];
+    size_t mask_count = 0;
+    for (unsigned int field = 1; field & PKG_FIELD_ALL; field <<= 1)
+    {
+        masks[mask_count++] = field;
+    }
+    masks[mask_count++] = PKG_FIELD_NAME | PKG_FIELD_VERSION |
+                          PKG_FIELD_DESCRIPTION | PKG_FIELD_EXPORTS;
+    masks[mask_count++] = PKG_FIELD_NAME | PKG_FIELD_DEPENDS;
+    masks[mask_count++] = PKG_FIELD_MAINTAINERS | PKG_FIELD_AUTHORS |
+                          PKG_FIELD_URLS | PKG_FIELD_TEST_DEPENDS;
+    masks[mask_count++] = 0;
+
+    const Pkg_ParserBackend backends[] = {
+        PKG_BACKEND_DOM, PKG_BACKEND_STREAM, PKG_BACKEND_SCAN
+    };
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b)
+    {
+        Pkg_Parser *parser = Pkg_InitParser();
+        Pkg_ParserSetBackend(parser, backends[b]);
+        Pkg_Package *full = Pkg_InitPackage();
+        CHECK(0 == Pkg_ParserParsePackageManifest(parser, path, full));
+        CHECK(PKG_FIELD_ALL == full->fields);
+        for (size_t m = 0; m < mask_count; ++m)
+        {
+            Pkg_ParserSetFields(parser, masks[m]);
+            Pkg_Package *pkg = Pkg_InitPackage();
+            CHECK(0 == Pkg_ParserParsePackageManifest(parser, path, pkg));
+            checkFields(full, pkg, masks[m]);
+            Pkg_FreePackage(pkg);
+        }
+        Pkg_FreePackage(full);
+        Pkg_FreeParser(parser);
+    }
+}
+
+/*
+ * Writes the workspace into a blob, then reads it back in place and as
+ * packages
+ */
+static void
+testBlob(const Pkg_Workspace *ws)
+{
+    void *data = NULL;
+    size_t size = 0;
+    CHECK(0 == Pkg_WriteBlob(ws->packages, ws->package_count, &data, &size));
+    Pkg_Blob *blob = Pkg_InitBlob();
+    CHECK(0 == Pkg_OpenBlob(blob, data, size));
+    CHECK(blob->package_count == ws->package_count);
+
+    for (size_t i = 0;
+         i < blob->package_count && i < ws->package_count; ++i)
+    {
+        const Pkg_Package *pkg = ws->packages[i];
+        const Pkg_BlobPackage *record = &blob->packages[i];
+        CHECK(sameString(Pkg_BlobGetString(blob, record->name), pkg->name));
+        CHECK(sameString(Pkg_BlobGetString(blob, record->filename),
+                         pkg->filename));
+        CHECK(record->version == Pkg_PackVersion(&pkg->version));
+        CHECK(record->semantic_hash == pkg->semantic_hash);
+
+        size_t count;
+        const Pkg_BlobPerson *maintainers = \
+            Pkg_BlobGetMaintainers(blob, record, &count);
+        CHECK(count == pkg->maintainer_count);
+        for (size_t m = 0; m < count && m < pkg->maintainer_count; ++m)
+        {
+            CHECK(sameString(Pkg_BlobGetString(blob, maintainers[m].name),
+                             pkg->maintainers[m].name));
+            CHECK(sameString(Pkg_BlobGetString(blob, maintainers[m].email),
+                             pkg->maintainers[m].email));
+        }
+        const Pkg_BlobPerson *authors = \
+            Pkg_BlobGetAuthors(blob, record, &count);
+        CHECK(count == pkg->author_count);
+        for (size_t a = 0; a < count && a < pkg->author_count; ++a)
+        {
+            CHECK(sameString(Pkg_BlobGetString(blob, authors[a].name),
+                             pkg->authors[a].name));
+            /* An author without email */
+            CHECK(sameString(Pkg_BlobGetString(blob, authors[a].email),
+                             pkg->authors[a].email));
+        }
+        const uint32_t *licenses = Pkg_BlobGetLicenses(blob, record, &count);
+        CHECK(count == pkg->license_count);
+        for (size_t l = 0; l < count && l < pkg->license_count; ++l)
+        {
+            CHECK(sameString(Pkg_BlobGetString(blob, licenses[l]),
+                             pkg->licenses[l].license));
+        }
+        const Pkg_BlobURL *urls = Pkg_BlobGetURLs(blob, record, &count);
+        CHECK(count == pkg->url_count);
+        for (size_t u = 0; u < count && u < pkg->url_count; ++u)
+        {
+            CHECK(sameString(Pkg_BlobGetString(blob, urls[u].url),
+                             pkg->urls[u].url));
+            CHECK(urls[u].type == (uint32_t)pkg->urls[u].type);
+        }
+        for (int type = 0; type < PKG_DEPEND_TYPE_COUNT; ++type)
+        {
+            size_t dep_count;
+            const Pkg_DependencyList *deps = Pkg_GetDependencies(
+                pkg, (Pkg_DependencyType)type, &dep_count);
+            const Pkg_BlobDependency *records = Pkg_BlobGetDependencies(
+                blob, record, (Pkg_DependencyType)type, &count);
+            CHECK(count == dep_count);
+            for (size_t d = 0; d < count && d < dep_count; ++d)
+            {
+                CHECK(sameString(Pkg_BlobGetString(blob, records[d].name),
+                                 deps[d].name));
+                CHECK(records[d].constraints == deps[d].constraints);
+            }
+        }
+
+        Pkg_Package *copy = Pkg_InitPackage();
+        CHECK(0 == Pkg_BlobLoadPackage(blob, i, copy));
+        checkSamePackage(pkg, copy);
+        Pkg_FreePackage(copy);
+    }
+
+    Pkg_Package *pkg = Pkg_InitPackage();
+    CHECK(1 == Pkg_BlobLoadPackage(blob, blob->package_count, pkg));
+    Pkg_FreePackage(pkg);
+    CHECK(NULL == Pkg_BlobGetString(blob, PKG_BLOB_NULL));
+    CHECK(NULL == Pkg_BlobGetString(blob, (uint32_t)blob->strings_size));
+
+    /* A truncated header and a foreign one are refused */
+    CHECK(1 == Pkg_OpenBlob(blob, data, 8));
+    unsigned char *bytes = (unsigned char *)data;
+    bytes[0] ^= 0xff;
+    CHECK(1 == Pkg_OpenBlob(blob, data, size));
+    Pkg_FreeBlob(blob);
+    free(data);
+}
+
+/*
+ * Computes the closures of the workspace's graph, whose cycle is part of
+ * its own closure
+ */
+static void
+testClosure(const Pkg_Workspace *ws)
+{
+    Pkg_Graph *graph = Pkg_InitGraph();
+    CHECK(1 == Pkg_BuildGraph(graph, ws->packages, ws->package_count,
+                              PKG_DEPEND_ALL));
+    size_t alpha = Pkg_GraphFindPackage(graph, "alpha");
+    size_t beta = Pkg_GraphFindPackage(graph, "beta");
+    size_t gamma = Pkg_GraphFindPackage(graph, "gamma");
+    size_t delta = Pkg_GraphFindPackage(graph, "delta");
+    CHECK(PKG_GRAPH_NOT_FOUND != alpha && PKG_GRAPH_NOT_FOUND != beta &&
+          PKG_GRAPH_NOT_FOUND != gamma && PKG_GRAPH_NOT_FOUND != delta);
+    CHECK(PKG_GRAPH_NOT_FOUND == Pkg_GraphFindPackage(graph, "boost"));
+    CHECK(0 == graph->duplicate_count);
+    CHECK(2 == graph->cycle_length);
+    if (2 == graph->cycle_length)
+    {
+        CHECK((graph->cycle[0] == gamma && graph->cycle[1] == delta) ||
+              (graph->cycle[0] == delta && graph->cycle[1] == gamma));
+    }
+    /* Only alpha can be ordered */
+    CHECK(1 == graph->ordered_count);
+
+    Pkg_Closure *closure = Pkg_InitClosure();
+    Pkg_BuildClosure(closure, graph, PKG_DEPEND_ALL);
+    CHECK(0 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, alpha)));
+    CHECK(3 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, beta)));
+    CHECK(!Pkg_ClosureDependsOn(closure, beta, beta));
+    CHECK(Pkg_ClosureDependsOn(closure, beta, alpha));
+    CHECK(Pkg_ClosureDependsOn(closure, beta, delta));
+    CHECK(!Pkg_ClosureDependsOn(closure, alpha, beta));
+    /* Both ends of the cycle depend on themselves and on alpha */
+    CHECK(3 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, gamma)));
+    CHECK(3 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, delta)));
+    CHECK(Pkg_ClosureDependsOn(closure, gamma, gamma));
+    CHECK(Pkg_ClosureDependsOn(closure, delta, delta));
+    CHECK(Pkg_ClosureDependsOn(closure, delta, alpha));
+    CHECK(!Pkg_ClosureDependsOn(closure, gamma, beta));
+
+    uint64_t *set = Pkg_InitBitset(closure);
+    CHECK(0 == Pkg_BitsetCount(closure, set));
+    Pkg_BitsetAdd(set, beta);
+    CHECK(Pkg_BitsetContains(set, beta));
+    CHECK(!Pkg_BitsetContains(set, alpha));
+    Pkg_BitsetUnion(closure, set, Pkg_ClosureGet(closure, beta));
+    CHECK(4 == Pkg_BitsetCount(closure, set));
+    Pkg_BitsetIntersect(closure, set, Pkg_ClosureGet(closure, gamma));
+    CHECK(3 == Pkg_BitsetCount(closure, set));
+    CHECK(!Pkg_BitsetContains(set, beta));
+    Pkg_BitsetIntersect(closure, set, Pkg_ClosureGet(closure, alpha));
+    CHECK(0 == Pkg_BitsetCount(closure, set));
+    Pkg_FreeBitset(set);
+
+    /* Without run dependencies delta needs nothing and the cycle is gone */
+    Pkg_BuildClosure(closure, graph, PKG_DEPEND_BIT(PKG_DEPEND_BUILD));
+    CHECK(1 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, beta)));
+    CHECK(2 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, gamma)));
+    CHECK(0 == Pkg_BitsetCount(closure, Pkg_ClosureGet(closure, delta)));
+    CHECK(!Pkg_ClosureDependsOn(closure, gamma, gamma));
+
+    Pkg_FreeClosure(closure);
+    Pkg_FreeGraph(graph);
+}
+
+/*
+ * Parses the <export> tag of the catkin manifest and of alpha into their
+ * entries
+ */
+static void
+testExports(const Pkg_Workspace *ws, const char *catkin_path)
+{
+    Pkg_Exports *exports = Pkg_InitExports();
+
+    Pkg_Package *catkin = Pkg_InitPackage();
+    CHECK(0 == Pkg_ParsePackageManifest(catkin_path, catkin));
+    CHECK(0 == Pkg_ParseExports(catkin, exports));
+    CHECK(1 == exports->count);
+    if (1 == exports->count)
+    {
+        const Pkg_Export *rosdoc = &exports->entries[0];
+        CHECK(sameString(rosdoc->tag, "rosdoc"));
+        CHECK(sameString(rosdoc->content, ""));
+        CHECK(1 == rosdoc->attr_count);
+        CHECK(sameString(Pkg_ExportGetAttr(rosdoc, "config"),
+                         "rosdoc.yaml"));
+        CHECK(NULL == Pkg_ExportGetAttr(rosdoc, "plugin"));
+    }
+    Pkg_FreePackage(catkin);
+
+    const Pkg_Package *alpha = findPackage(ws, "alpha");
+    CHECK(alpha && 0 == Pkg_ParseExports(alpha, exports));
+    CHECK(2 == exports->count);
+    if (2 == exports->count)
+    {
+        const Pkg_Export *build_type = &exports->entries[0];
+        CHECK(sameString(build_type->tag, "build_type"));
+        CHECK(sameString(build_type->content, "cmake"));
+        CHECK(0 == build_type->attr_count);
+        const Pkg_Export *nodelet = &exports->entries[1];
+        CHECK(sameString(nodelet->tag, "nodelet"));
+        CHECK(2 == nodelet->attr_count);
+        CHECK(sameString(Pkg_ExportGetAttr(nodelet, "plugin"),
+                         "${prefix}/nodelets.xml"));
+        CHECK(sameString(Pkg_ExportGetAttr(nodelet, "name"), "alpha & co"));
+    }
+
+    /* A package without an <export> tag leaves the entries empty */
+    const Pkg_Package *beta = findPackage(ws, "beta");
+    CHECK(beta && 0 == Pkg_ParseExports(beta, exports));
+    CHECK(0 == exports->count);
+    Pkg_FreeExports(exports);
+}
+
+/*
+ * Checks that mapping the manifest at path gives the same package as
+ * reading it, with every backend
+ */
+static void
+checkMappedManifest(const char *path)
+{
+    Pkg_Package *read = Pkg_InitPackage();
+    Pkg_Package *mapped = Pkg_InitPackage();
+    CHECK(0 == Pkg_ParsePackageManifest(path, read));
+    CHECK(0 == Pkg_ParsePackageManifestMapped(path, mapped));
+    checkSamePackage(read, mapped);
+    CHECK(read->content_hash == mapped->content_hash);
+    Pkg_FreePackage(mapped);
+
+    Pkg_ParserBackend backends[] = {
+        PKG_BACKEND_DOM, PKG_BACKEND_STREAM, PKG_BACKEND_SCAN
+    };
+    Pkg_Parser *parser = Pkg_InitParser();
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b)
+    {
+        Pkg_ParserSetBackend(parser, backends[b]);
+        mapped = Pkg_InitPackage();
+        CHECK(0 == Pkg_ParserParsePackageManifestMapped(parser, path, mapped));
+        checkSamePackage(read, mapped);
+        Pkg_FreePackage(mapped);
+    }
+    Pkg_FreeParser(parser);
+    Pkg_FreePackage(read);
+}
+
+/*
+ * Parses every manifest of the workspace and the catkin manifest by
+ * mapping them, and a few which cannot be parsed
+ */
+static void
+testMapped(const Pkg_Workspace *ws, const char *tests)
+{
+    for (size_t i = 0; i < ws->package_count; ++i)
+    {
+        checkMappedManifest(ws->packages[i]->filename);
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/package_manifests/catkin/package.xml",
+             tests);
+    checkMappedManifest(path);
+
+    /* An empty manifest and a missing one fail as they do when read */
+    const char *broken[] = {"edge_cases/empty.xml", "edge_cases/missing.xml"};
+    for (size_t i = 0; i < sizeof(broken) / sizeof(broken[0]); ++i)
+    {
+        snprintf(path, sizeof(path), "%s/package_manifests/%s",
+                 tests, broken[i]);
+        Pkg_Package *pkg = Pkg_InitPackage();
+        CHECK(1 == Pkg_ParsePackageManifest(path, pkg));
+        Pkg_FreePackage(pkg);
+        pkg = Pkg_InitPackage();
+        CHECK(1 == Pkg_ParsePackageManifestMapped(path, pkg));
+        Pkg_FreePackage(pkg);
+    }
+}
+
+/*
+ * Returns the dependency of the given type of pkg on name, NULL if there is
+ * none
+ */
+static const Pkg_DependencyList *
+findDependency(
+    const Pkg_Package *pkg,
+    Pkg_DependencyType type,
+    const char *name)
+{
+    size_t count;
+    const Pkg_DependencyList *deps = Pkg_GetDependencies(pkg, type, &count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sameString(deps[i].name, name)) return &deps[i];
+    }
+    return NULL;
+}
+
+/*
+ * Checks whether dep accepts the version given as a string, through every
+ * way of asking
+ */
+static int
+accepts(const Pkg_DependencyList *dep, const char *str)
+{
+    Pkg_Version version;
+    if (Pkg_ParseVersion(str, &version)) return -1;
+    Pkg_VersionKey key = Pkg_PackVersion(&version);
+    int accepted = Pkg_DependencyAccepts(dep, &version);
+    CHECK(accepted == Pkg_DependencyAcceptsKey(dep, key));
+    CHECK(accepted == !Pkg_DependencyFailedConstraints(dep, key));
+    return accepted;
+}
+
+/*
+ * Checks each version constraint of beta's dependencies on both sides of
+ * its bound
+ */
+static void
+testConstraints(const Pkg_Workspace *ws)
+{
+    const Pkg_Package *beta = findPackage(ws, "beta");
+    CHECK(beta);
+    if (!beta) return;
+
+    /* version_gte="1.0.0" version_lt="2.0.0" */
+    const Pkg_DependencyList *range = \
+        findDependency(beta, PKG_DEPEND_BUILD, "alpha");
+    CHECK(range);
+    if (range)
+    {
+        CHECK(range->constraints == (PKG_CONSTRAINT_BIT(PKG_VERSION_GTE) |
+                                     PKG_CONSTRAINT_BIT(PKG_VERSION_LT)));
+        CHECK(0 == accepts(range, "0.9.9"));
+        CHECK(1 == accepts(range, "1.0.0"));
+        CHECK(1 == accepts(range, "1.99.0"));
+        CHECK(0 == accepts(range, "2.0.0"));
+        Pkg_Version version;
+        Pkg_ParseVersion("2.0.0", &version);
+        CHECK(PKG_CONSTRAINT_BIT(PKG_VERSION_LT) == \
+              Pkg_DependencyFailedConstraints(
+                  range, Pkg_PackVersion(&version)));
+        /* The fixture's alpha satisfies it */
+        const Pkg_Package *alpha = findPackage(ws, "alpha");
+        CHECK(alpha && Pkg_DependencyAccepts(range, &alpha->version));
+    }
+
+    const Pkg_DependencyList *lte = \
+        findDependency(beta, PKG_DEPEND_BUILD, "lte");
+    CHECK(lte);
+    if (lte)
+    {
+        CHECK(1 == accepts(lte, "1.1.9"));
+        CHECK(1 == accepts(lte, "1.2.0"));
+        CHECK(0 == accepts(lte, "1.2.1"));
+    }
+    const Pkg_DependencyList *eq = \
+        findDependency(beta, PKG_DEPEND_BUILD, "eq");
+    CHECK(eq);
+    if (eq)
+    {
+        CHECK(0 == accepts(eq, "1.1.9"));
+        CHECK(1 == accepts(eq, "1.2.0"));
+        CHECK(0 == accepts(eq, "1.2.1"));
+    }
+    const Pkg_DependencyList *gt = \
+        findDependency(beta, PKG_DEPEND_BUILD, "gt");
+    CHECK(gt);
+    if (gt)
+    {
+        CHECK(0 == accepts(gt, "1.1.9"));
+        CHECK(0 == accepts(gt, "1.2.0"));
+        CHECK(1 == accepts(gt, "1.2.1"));
+    }
+
+    /* Without constraints any version goes */
+    const Pkg_DependencyList *any = \
+        findDependency(beta, PKG_DEPEND_RUN, "alpha");
+    CHECK(any && 0 == any->constraints);
+    if (any)
+    {
+        CHECK(1 == accepts(any, "0.0.0"));
+        CHECK(1 == accepts(any, "2097151.0.0"));
+    }
+}
+
+/*
+ * Checks the constraints of the workspace with nthreads threads
+ */
+static void
+checkConstraintReport(const Pkg_Workspace *ws, unsigned int nthreads)
+{
+    Pkg_ConstraintReport *report = Pkg_InitConstraintReport();
+    CHECK(1 == Pkg_CheckWorkspaceConstraints(ws, nthreads, report));
+    /* beta's build and test dependency on alpha, gamma's on alpha */
+    CHECK(3 == report->checked_count);
+    CHECK(2 == report->violation_count);
+
+    /* In the order of the packages, beta comes before gamma */
+    const Pkg_Package *alpha = findPackage(ws, "alpha");
+    if (report->violation_count == 2)
+    {
+        const Pkg_ConstraintViolation *beta = &report->violations[0];
+        CHECK(beta->package == findPackage(ws, "beta"));
+        CHECK(PKG_DEPEND_TEST == beta->type);
+        CHECK(sameString(beta->dependency->name, "alpha"));
+        CHECK(beta->target == alpha);
+        CHECK(PKG_CONSTRAINT_BIT(PKG_VERSION_EQ) == beta->failed);
+
+        const Pkg_ConstraintViolation *gamma = &report->violations[1];
+        CHECK(gamma->package == findPackage(ws, "gamma"));
+        CHECK(PKG_DEPEND_BUILD == gamma->type);
+        CHECK(sameString(gamma->dependency->name, "alpha"));
+        CHECK(gamma->target == alpha);
+        CHECK(PKG_CONSTRAINT_BIT(PKG_VERSION_GTE) == gamma->failed);
+    }
+
+    /* Without alpha its dependents have nothing to be checked against */
+    const Pkg_Package *dependents[] = {
+        findPackage(ws, "beta"), findPackage(ws, "gamma")
+    };
+    Pkg_Workspace partial = *ws;
+    partial.packages = (Pkg_Package **)dependents;
+    partial.package_count = 2;
+    CHECK(0 == Pkg_CheckWorkspaceConstraints(&partial, nthreads, report));
+    CHECK(0 == report->checked_count);
+    CHECK(0 == report->violation_count);
+    CHECK(0 == report->duplicate_count);
+
+    /* A name taken twice is reported, not printed */
+    const Pkg_Package *twice[] = { alpha, findPackage(ws, "beta"), alpha };
+    partial.packages = (Pkg_Package **)twice;
+    partial.package_count = 3;
+    CHECK(1 == Pkg_CheckWorkspaceConstraints(&partial, nthreads, report));
+    CHECK(2 == report->checked_count);
+    CHECK(1 == report->violation_count);
+    CHECK(1 == report->duplicate_count);
+    CHECK(report->duplicate_count && alpha == report->duplicates[0]);
+    Pkg_FreeConstraintReport(report);
+}
+
+/*
+ * Returns the change of the package called name, NULL if it did not change
+ */
+static const Pkg_PackageChange *
+findChange(const Pkg_WorkspaceDiff *diff, const char *name)
+{
+    for (size_t i = 0; i < diff->change_count; ++i)
+    {
+        const Pkg_PackageChange *change = &diff->changes[i];
+        const Pkg_Package *pkg = \
+            change->new_package ? change->new_package : change->old_package;
+        if (sameString(pkg->name, name)) return change;
+    }
+    return NULL;
+}
+
+/*
+ * Edits a copy of the workspace in the directory copy, returns 0 on success
+ *
+ * alpha gets a new version, beta a new run dependency on epsilon, which is
+ * added, and delta is removed. gamma only gains a comment.
+ */
+static int
+editWorkspace(const char *copy)
+{
+    char path[PATH_MAX];
+    int ret = 0;
+    joinPath(path, copy, "alpha/package.xml");
+    if (editFile(path, "<version>1.2.0</version>", "<version>1.3.0</version>"))
+    {
+        ret = 1;
+    }
+    joinPath(path, copy, "beta/package.xml");
+    if (editFile(path, "<run_depend>gamma</run_depend>",
+                 "<run_depend>gamma</run_depend>\n"
+                 "  <run_depend>epsilon</run_depend>"))
+    {
+        ret = 1;
+    }
+    joinPath(path, copy, "cycle/gamma/package.xml");
+    if (editFile(path, "</package>", "  <!-- reformatted -->\n</package>"))
+    {
+        ret = 1;
+    }
+    joinPath(path, copy, "cycle/delta");
+    removeTree(path);
+    joinPath(path, copy, "epsilon");
+    if (mkdir(path, 0755)) ret = 1;
+    joinPath(path, copy, "epsilon/package.xml");
+    if (writeFile(path,
+                  "<package>\n"
+                  "  <name>epsilon</name>\n"
+                  "  <version>0.1.0</version>\n"
+                  "  <run_depend>alpha</run_depend>\n"
+                  "</package>\n"))
+    {
+        ret = 1;
+    }
+    return ret;
+}
+
+/*
+ * Diffs the workspace against an edited copy of it
+ */
+static void
+testDiff(const Pkg_Workspace *ws, const char *scratch)
+{
+    char copy[PATH_MAX];
+    joinPath(copy, scratch, "diff");
+    CHECK(0 == copyTree(ws->root, copy));
+    CHECK(0 == editWorkspace(copy));
+    Pkg_Workspace *edited = Pkg_InitWorkspace();
+    CHECK(0 == Pkg_ParseWorkspace(copy, 1, edited));
+
+    Pkg_WorkspaceDiff *diff = Pkg_InitWorkspaceDiff();
+    CHECK(1 == Pkg_DiffWorkspaces(ws, edited, diff));
+    CHECK(4 == diff->change_count);
+    CHECK(1 == diff->unchanged_count);
+    CHECK(NULL == findChange(diff, "gamma"));
+
+    const Pkg_PackageChange *alpha = findChange(diff, "alpha");
+    CHECK(alpha && PKG_CHANGE_VERSION == alpha->changes);
+    const Pkg_PackageChange *beta = findChange(diff, "beta");
+    CHECK(beta && PKG_CHANGE_DEPENDENCIES == beta->changes);
+    if (beta)
+    {
+        CHECK(1 == beta->dependency_count);
+        const Pkg_DependencyChange *dep = \
+            &diff->dependency_changes[beta->dependency_offset];
+        CHECK(dep->added && PKG_DEPEND_RUN == dep->type);
+        CHECK(sameString(dep->dependency->name, "epsilon"));
+    }
+    const Pkg_PackageChange *delta = findChange(diff, "delta");
+    CHECK(delta && PKG_CHANGE_REMOVED == delta->changes);
+    CHECK(delta && !delta->new_package);
+    const Pkg_PackageChange *epsilon = findChange(diff, "epsilon");
+    CHECK(epsilon && PKG_CHANGE_ADDED == epsilon->changes);
+    CHECK(epsilon && !epsilon->old_package);
+    /* The removed package comes last */
+    CHECK(delta == &diff->changes[diff->change_count - 1]);
+
+    /* Nothing changed between a workspace and itself */
+    CHECK(0 == Pkg_DiffWorkspaces(edited, edited, diff));
+    CHECK(0 == diff->change_count);
+    CHECK(edited->package_count == diff->unchanged_count);
+
+    Pkg_FreeWorkspaceDiff(diff);
+    Pkg_FreeWorkspace(edited);
+}
+
+/*
+ * Parses the manifest at path through the cache and checks the cache's
+ * stats afterwards, returns the package, which the caller frees
+ */
+static Pkg_Package *
+parseCached(
+    Pkg_Cache *cache,
+    Pkg_Parser *parser,
+    const char *path,
+    size_t hits,
+    size_t misses)
+{
+    Pkg_Package *pkg = Pkg_InitPackage();
+    CHECK(0 == Pkg_CacheParsePackageManifest(cache, parser, path, pkg));
+    size_t cache_hits;
+    size_t cache_misses;
+    Pkg_CacheGetStats(cache, &cache_hits, &cache_misses);
+    CHECK(hits == cache_hits);
+    CHECK(misses == cache_misses);
+    return pkg;
+}
+
+/*
+ * Returns 1 if loading the cache file at path fails and leaves the cache
+ * empty, so that the manifest at manifest is parsed again
+ */
+static int
+rejectsCacheFile(Pkg_Parser *parser, const char *path, const char *manifest)
+{
+    Pkg_Cache *cache = Pkg_InitCache();
+    int rejected = 1 == Pkg_LoadCache(cache, path);
+    Pkg_FreePackage(parseCached(cache, parser, manifest, 0, 1));
+    Pkg_FreeCache(cache);
+    return rejected;
+}
+
+/*
+ * Parses alpha of a copy of the workspace through a cache, while editing
+ * the copy and the cache file
+ */
+static void
+testCache(const Pkg_Workspace *ws, const char *scratch)
+{
+    char copy[4096];
+    char manifest[4096];
+    char cache_path[4096];
+    snprintf(copy, sizeof(copy), "%s/cache", scratch);
+    snprintf(manifest, sizeof(manifest), "%s/cache/alpha/package.xml",
+             scratch);
+    snprintf(cache_path, sizeof(cache_path), "%s/manifests.cache", scratch);
+    CHECK(0 == copyTree(ws->root, copy));
+    Pkg_Parser *parser = Pkg_InitParser();
+    Pkg_Package *parsed = Pkg_InitPackage();
+    CHECK(0 == Pkg_ParserParsePackageManifest(parser, manifest, parsed));
+
+    /* A missing cache file is no error, the first parse misses */
+    Pkg_Cache *cache = Pkg_InitCache();
+    CHECK(0 == Pkg_LoadCache(cache, cache_path));
+    Pkg_Package *pkg = parseCached(cache, parser, manifest, 0, 1);
+    checkSamePackage(parsed, pkg);
+    Pkg_FreePackage(pkg);
+
+    /* A warm hit returns the same package, also from the saved file */
+    pkg = parseCached(cache, parser, manifest, 1, 1);
+    checkSamePackage(parsed, pkg);
+    Pkg_FreePackage(pkg);
+    CHECK(0 == Pkg_SaveCache(cache, cache_path));
+    Pkg_FreeCache(cache);
+    cache = Pkg_InitCache();
+    CHECK(0 == Pkg_LoadCache(cache, cache_path));
+    pkg = parseCached(cache, parser, manifest, 1, 0);
+    checkSamePackage(parsed, pkg);
+    Pkg_FreePackage(pkg);
+
+    /* A new modification time makes the entry stale */
+    struct stat st;
+    CHECK(0 == stat(manifest, &st));
+    struct timespec times[2];
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    times[1].tv_sec -= 60;
+    CHECK(0 == utimensat(AT_FDCWD, manifest, times, 0));
+    pkg = parseCached(cache, parser, manifest, 1, 1);
+    checkSamePackage(parsed, pkg);
+    Pkg_FreePackage(pkg);
+
+    /* So does a new size */
+    CHECK(0 == editFile(manifest, "<version>1.2.0</version>",
+                        "<version>1.20.0</version>"));
+    pkg = parseCached(cache, parser, manifest, 1, 2);
+    CHECK(20 == pkg->version.minor);
+    Pkg_FreePackage(pkg);
+
+    /* An edit which keeps both is only caught by verifying the content */
+    CHECK(0 == stat(manifest, &st));
+    CHECK(0 == editFile(manifest, "<version>1.20.0</version>",
+                        "<version>1.30.0</version>"));
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    CHECK(0 == utimensat(AT_FDCWD, manifest, times, 0));
+    pkg = parseCached(cache, parser, manifest, 2, 2);
+    CHECK(20 == pkg->version.minor);
+    Pkg_FreePackage(pkg);
+    Pkg_CacheSetVerifyContent(cache, 1);
+    pkg = parseCached(cache, parser, manifest, 2, 3);
+    CHECK(30 == pkg->version.minor);
+    Pkg_FreePackage(pkg);
+    pkg = parseCached(cache, parser, manifest, 3, 3);
+    CHECK(30 == pkg->version.minor);
+    Pkg_FreePackage(pkg);
+    CHECK(0 == Pkg_SaveCache(cache, cache_path));
+    Pkg_FreeCache(cache);
+
+    /* Corrupt, truncated and foreign cache files are rejected, the cache
+     * file starts with an 8 byte magic, a u32 version and a u32 byte order
+     * mark */
+    size_t size = 0;
+    char *saved = readFileSize(cache_path, &size);
+    CHECK(saved && size > 16);
+    if (saved && size > 16)
+    {
+        CHECK(0 == writeFileSize(cache_path, saved, size - 1));
+        CHECK(rejectsCacheFile(parser, cache_path, manifest));
+        CHECK(0 == writeFileSize(cache_path, saved, size / 2));
+        CHECK(rejectsCacheFile(parser, cache_path, manifest));
+        saved[8]++;
+        CHECK(0 == writeFileSize(cache_path, saved, size));
+        CHECK(rejectsCacheFile(parser, cache_path, manifest));
+        saved[8]--;
+        saved[12]++;
+        CHECK(0 == writeFileSize(cache_path, saved, size));
+        CHECK(rejectsCacheFile(parser, cache_path, manifest));
+        saved[12]--;
+        saved[0] = 'X';
+        CHECK(0 == writeFileSize(cache_path, saved, size));
+        CHECK(rejectsCacheFile(parser, cache_path, manifest));
+    }
+    free(saved);
+    CHECK(0 == writeFile(cache_path, "not a cache file"));
+    CHECK(rejectsCacheFile(parser, cache_path, manifest));
+
+    Pkg_FreePackage(parsed);
+    Pkg_FreeParser(parser);
+}
+
+/*
+ * Checks that the snapshot's vertex depends on the packages called names,
+ * in that order, with the kinds in kinds
+ */
+static void
+checkSnapshotEdges(
+    const Pkg_Snapshot *snapshot,
+    const char *name,
+    size_t count,
+    const char **names,
+    const unsigned int *kinds)
+{
+    size_t vertex = Pkg_SnapshotFindPackage(snapshot, name);
+    CHECK(PKG_SNAPSHOT_NOT_FOUND != vertex);
+    size_t edge_count;
+    const uint8_t *edge_kinds;
+    const uint32_t *edges = Pkg_SnapshotGetDependencies(
+        snapshot, vertex, &edge_count, &edge_kinds);
+    CHECK(count == edge_count);
+    CHECK(!count || (edges && edge_kinds));
+    for (size_t i = 0; i < count && i < edge_count && edges; ++i)
+    {
+        CHECK(edges[i] == Pkg_SnapshotFindPackage(snapshot, names[i]));
+        CHECK(edge_kinds[i] == kinds[i]);
+    }
+}
+
+/*
+ * Returns 1 if opening the snapshot file at path fails and leaves the
+ * snapshot empty
+ */
+static int
+rejectsSnapshot(Pkg_Snapshot *snapshot, const char *path)
+{
+    return 1 == Pkg_OpenSnapshot(snapshot, path) &&
+           0 == snapshot->blob.package_count &&
+           PKG_SNAPSHOT_NOT_FOUND == \
+               Pkg_SnapshotFindPackage(snapshot, "alpha");
+}
+
+/*
+ * Writes the workspace to a snapshot and reads it back, then checks that
+ * truncated and foreign files are rejected
+ */
+static void
+testSnapshot(const Pkg_Workspace *ws, const char *scratch)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/workspace.pkgdb", scratch);
+    CHECK(0 == Pkg_WriteSnapshot(ws, path));
+    Pkg_Snapshot *snapshot = Pkg_InitSnapshot();
+    CHECK(0 == Pkg_OpenSnapshot(snapshot, path));
+    CHECK(sameString(snapshot->root, ws->root));
+    CHECK(ws->package_count == snapshot->blob.package_count);
+
+    /* Every package is found by name at its place in the workspace */
+    for (size_t v = 0; v < ws->package_count; ++v)
+    {
+        const Pkg_Package *pkg = ws->packages[v];
+        CHECK(v == Pkg_SnapshotFindPackage(snapshot, pkg->name));
+        if (v < snapshot->blob.package_count)
+        {
+            const Pkg_BlobPackage *record = &snapshot->blob.packages[v];
+            CHECK(sameString(
+                Pkg_BlobGetString(&snapshot->blob, record->name), pkg->name));
+        }
+    }
+    CHECK(PKG_SNAPSHOT_NOT_FOUND == \
+          Pkg_SnapshotFindPackage(snapshot, "boost"));
+    CHECK(PKG_SNAPSHOT_NOT_FOUND == Pkg_SnapshotFindPackage(snapshot, ""));
+
+    /* Only dependencies inside the workspace are edges, one per package
+     * depended on with every kind it is declared as */
+    size_t count;
+    CHECK(NULL == Pkg_SnapshotGetDependencies(
+        snapshot, ws->package_count, &count, NULL));
+    CHECK(0 == count);
+    checkSnapshotEdges(snapshot, "alpha", 0, NULL, NULL);
+    const char *beta_names[] = { "alpha", "gamma" };
+    const unsigned int beta_kinds[] = {
+        PKG_DEPEND_BIT(PKG_DEPEND_BUILD) | PKG_DEPEND_BIT(PKG_DEPEND_RUN) |
+            PKG_DEPEND_BIT(PKG_DEPEND_TEST),
+        PKG_DEPEND_BIT(PKG_DEPEND_RUN)
+    };
+    checkSnapshotEdges(snapshot, "beta", 2, beta_names, beta_kinds);
+    const char *gamma_names[] = { "alpha", "delta" };
+    const unsigned int gamma_kinds[] = {
+        PKG_DEPEND_BIT(PKG_DEPEND_BUILD), PKG_DEPEND_BIT(PKG_DEPEND_BUILD)
+    };
+    checkSnapshotEdges(snapshot, "gamma", 2, gamma_names, gamma_kinds);
+    const char *delta_names[] = { "gamma" };
+    const unsigned int delta_kinds[] = { PKG_DEPEND_BIT(PKG_DEPEND_RUN) };
+    checkSnapshotEdges(snapshot, "delta", 1, delta_names, delta_kinds);
+
+    /* Truncated snapshots, plain blobs and other files are rejected */
+    size_t size = 0;
+    char *saved = readFileSize(path, &size);
+    CHECK(saved && size > 64);
+    if (saved && size > 64)
+    {
+        CHECK(0 == writeFileSize(path, saved, size - 1));
+        CHECK(rejectsSnapshot(snapshot, path));
+        CHECK(0 == writeFileSize(path, saved, size / 2));
+        CHECK(rejectsSnapshot(snapshot, path));
+        CHECK(0 == writeFileSize(path, saved, 16));
+        CHECK(rejectsSnapshot(snapshot, path));
+    }
+    free(saved);
+    void *data = NULL;
+    CHECK(0 == Pkg_WriteBlob(ws->packages, ws->package_count, &data, &size));
+    CHECK(0 == writeFileSize(path, (const char *)data, size));
+    free(data);
+    CHECK(rejectsSnapshot(snapshot, path));
+    CHECK(0 == writeFile(path, "not a snapshot"));
+    CHECK(rejectsSnapshot(snapshot, path));
+    CHECK(0 == writeFile(path, ""));
+    CHECK(rejectsSnapshot(snapshot, path));
+    snprintf(path, sizeof(path), "%s/missing.pkgdb", scratch);
+    CHECK(rejectsSnapshot(snapshot, path));
+
+    Pkg_FreeSnapshot(snapshot);
+}
+
+/* How long a poll waits for the events of an edit */
+#define POLL_TIMEOUT_MS 5000
+
+/*
+ * Watches a copy of the workspace while editing it
+ */
+static void
+testWatcher(const Pkg_Workspace *ws, const char *scratch)
+{
+    char copy[PATH_MAX];
+    char path[PATH_MAX];
+    joinPath(copy, scratch, "watch");
+    CHECK(0 == copyTree(ws->root, copy));
+    Pkg_Workspace *watched = Pkg_InitWorkspace();
+    Pkg_Watcher *watcher = Pkg_InitWatcher();
+    CHECK(0 == Pkg_WatchWorkspace(watcher, copy, 1, watched));
+    CHECK(4 == watched->package_count);
+    const Pkg_Graph *graph = Pkg_WatcherGetGraph(watcher);
+    CHECK(2 == graph->cycle_length);
+    Pkg_WorkspaceDiff *diff = Pkg_InitWorkspaceDiff();
+
+    /* Nothing happened yet */
+    CHECK(0 == Pkg_WatcherPoll(watcher, 0, diff));
+    CHECK(0 == diff->change_count);
+
+    /* Saving gamma with only a comment added parses it again but changes
+     * nothing, the graph points at the new package */
+    const Pkg_Package *gamma = findPackage(watched, "gamma");
+    joinPath(path, copy, "cycle/gamma/package.xml");
+    CHECK(0 == editFile(path, "</package>", "<!-- saved -->\n</package>"));
+    CHECK(0 == Pkg_WatcherPoll(watcher, POLL_TIMEOUT_MS, diff));
+    CHECK(0 == diff->change_count);
+    CHECK(gamma != findPackage(watched, "gamma"));
+    graph = Pkg_WatcherGetGraph(watcher);
+    size_t vertex = Pkg_GraphFindPackage(graph, "gamma");
+    CHECK(PKG_GRAPH_NOT_FOUND != vertex &&
+          graph->packages[vertex] == findPackage(watched, "gamma"));
+    CHECK(2 == graph->cycle_length);
+
+    /* Dropping delta's dependency on gamma breaks the cycle */
+    joinPath(path, copy, "cycle/delta/package.xml");
+    CHECK(0 == editFile(path, "<run_depend>gamma</run_depend>", ""));
+    CHECK(1 == Pkg_WatcherPoll(watcher, POLL_TIMEOUT_MS, diff));
+    CHECK(1 == diff->change_count);
+    const Pkg_PackageChange *delta = findChange(diff, "delta");
+    CHECK(delta && PKG_CHANGE_DEPENDENCIES == delta->changes);
+    graph = Pkg_WatcherGetGraph(watcher);
+    CHECK(0 == graph->cycle_length);
+    CHECK(4 == graph->ordered_count);
+
+    /* A new package directory */
+    joinPath(path, copy, "epsilon");
+    CHECK(0 == mkdir(path, 0755));
+    joinPath(path, copy, "epsilon/package.xml");
+    CHECK(0 == writeFile(path,
+                         "<package>\n"
+                         "  <name>epsilon</name>\n"
+                         "  <version>0.1.0</version>\n"
+                         "</package>\n"));
+    CHECK(1 == Pkg_WatcherPoll(watcher, POLL_TIMEOUT_MS, diff));
+    const Pkg_PackageChange *epsilon = findChange(diff, "epsilon");
+    CHECK(1 == diff->change_count);
+    CHECK(epsilon && PKG_CHANGE_ADDED == epsilon->changes);
+    CHECK(5 == watched->package_count);
+
+    /* An ignore marker hides a package, removing the directory another */
+    joinPath(path, copy, "alpha/CATKIN_IGNORE");
+    CHECK(0 == writeFile(path, ""));
+    joinPath(path, copy, "beta");
+    removeTree(path);
+    CHECK(1 == Pkg_WatcherPoll(watcher, POLL_TIMEOUT_MS, diff));
+    CHECK(2 == diff->change_count);
+    const Pkg_PackageChange *alpha = findChange(diff, "alpha");
+    CHECK(alpha && PKG_CHANGE_REMOVED == alpha->changes);
+    const Pkg_PackageChange *beta = findChange(diff, "beta");
+    CHECK(beta && PKG_CHANGE_REMOVED == beta->changes);
+    CHECK(3 == watched->package_count);
+    CHECK(PKG_GRAPH_NOT_FOUND == \
+          Pkg_GraphFindPackage(Pkg_WatcherGetGraph(watcher), "alpha"));
+
+    Pkg_FreeWorkspaceDiff(diff);
+    Pkg_FreeWatcher(watcher);
+    Pkg_FreeWorkspace(watched);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <path/to/tests>\n", argv[0]);
+        return 1;
+    }
+    const char *tests = argv[1];
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/workspace", tests);
+    Pkg_Workspace *ws = Pkg_InitWorkspace();
+    CHECK(0 == Pkg_ParseWorkspace(path, 1, ws));
+    CHECK(4 == ws->package_count);
+    CHECK(findPackage(ws, "alpha") && findPackage(ws, "delta"));
+
+    testBlob(ws);
+    testClosure(ws);
+
+    snprintf(path, sizeof(path), "%s/package_manifests/catkin/package.xml",
+             tests);
+    testExports(ws, path);
+    testFields(path);
+    const Pkg_Package *alpha = findPackage(ws, "alpha");
+    if (alpha) testFields(alpha->filename);
+    testMapped(ws, tests);
+    testConstraints(ws);
+    checkConstraintReport(ws, 1);
+    checkConstraintReport(ws, 4);
+
+    /* Scratch directory for the edited copies of the workspace */
+    const char *tmp = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/test_api.XXXXXX", tmp ? tmp : "/tmp");
+    if (mkdtemp(path))
+    {
+        char *scratch = strdup(path);
+        testCache(ws, scratch);
+        testSnapshot(ws, scratch);
+        testDiff(ws, scratch);
+        testWatcher(ws, scratch);
+        removeTree(scratch);
+        free(scratch);
+    }
+    else
+    {
+        fprintf(stderr, "Failed to create a scratch directory %s\n", path);
+        failures++;
+    }
+
+    Pkg_FreeWorkspace(ws);
+    if (failures) fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}